@@ -0,0 +1,40 @@
+#version 330
+#ifndef LIGHTING
+#define LIGHTING 0
+#endif
+out vec4 fragColor;
+in vec2 TexCoord;
+flat in uvec2 Material;
+#if LIGHTING == 1
+in vec3 Normal;
+//世界空间里固定的方向光
+const vec3 lightDir = normalize(vec3(0.4, 1.0, 0.6));
+#endif
+#ifdef TEXTURED
+uniform sampler2DArray textures;
+//每个region在纹理数组里的位置: rect是归一化的(x, y, w, h), layer.x是层号
+layout (std140) uniform Regions
+{
+    vec4 regionRect[64];
+    vec4 regionLayer[64];
+};
+
+vec4 sampleRegion(uint region)
+{
+    vec4 rect = regionRect[region];
+    return texture(textures, vec3(rect.xy + TexCoord * rect.zw, regionLayer[region].x));
+}
+#endif
+
+void main()
+{
+#ifdef TEXTURED
+    vec4 color = mix(sampleRegion(Material.x), sampleRegion(Material.y), 0.2);
+#else
+    vec4 color = vec4(0.8, 0.8, 0.8, 1.0);
+#endif
+#if LIGHTING == 1
+    color.rgb *= 0.25 + 0.75 * max(dot(normalize(Normal), lightDir), 0.0);
+#endif
+    fragColor = color;
+}
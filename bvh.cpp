@@ -0,0 +1,277 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+static bool boxOutsidePlane(const glm::vec3 &min, const glm::vec3 &max, const glm::vec4 &plane)
+{
+    //离平面最远的顶点(p-vertex)都在外面, 整个盒子在外面
+    const glm::vec3 positive(plane.x >= 0.0f ? max.x : min.x,
+                             plane.y >= 0.0f ? max.y : min.y,
+                             plane.z >= 0.0f ? max.z : min.z);
+    return glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f;
+}
+
+static bool boxInsidePlane(const glm::vec3 &min, const glm::vec3 &max, const glm::vec4 &plane)
+{
+    //最近的顶点(n-vertex)也在里面
+    const glm::vec3 negative(plane.x >= 0.0f ? min.x : max.x,
+                             plane.y >= 0.0f ? min.y : max.y,
+                             plane.z >= 0.0f ? min.z : max.z);
+    return glm::dot(glm::vec3(plane), negative) + plane.w >= 0.0f;
+}
+
+static bool boxesOverlap(const glm::vec3 &minA, const glm::vec3 &maxA, const glm::vec3 &minB, const glm::vec3 &maxB)
+{
+    return !(glm::any(glm::lessThan(maxA, minB)) || glm::any(glm::greaterThan(minA, maxB)));
+}
+
+static float surfaceArea(const glm::vec3 &min, const glm::vec3 &max)
+{
+    const glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void Bvh::clear()
+{
+    m_nodes.clear();
+    m_indices.clear();
+    m_bounds.clear();
+}
+
+void Bvh::build(const std::vector<Aabb> &bounds)
+{
+    clear();
+    if(bounds.empty())
+        return;
+
+    const int count = int(bounds.size());
+    std::vector<glm::vec3> centroids(count);
+    m_indices.resize(count);
+    for(int i=0; i < count; ++i)
+    {
+        centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+        m_indices[i] = unsigned(i);
+    }
+
+    m_nodes.reserve(2 * count / MaxLeafSize + 1);
+    buildNode(0, count, 0, bounds, centroids);
+
+    m_bounds.resize(count);
+    for(int i=0; i < count; ++i)
+        m_bounds[i] = bounds[m_indices[i]];
+}
+
+int Bvh::buildNode(int first, int count, int depth, const std::vector<Aabb> &bounds,
+                   const std::vector<glm::vec3> &centroids)
+{
+    const int index = int(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(-std::numeric_limits<float>::max());
+    glm::vec3 cmin = min, cmax = max;
+    for(int i=first; i < first + count; ++i)
+    {
+        const unsigned prim = m_indices[i];
+        min = glm::min(min, bounds[prim].min);
+        max = glm::max(max, bounds[prim].max);
+        cmin = glm::min(cmin, centroids[prim]);
+        cmax = glm::max(cmax, centroids[prim]);
+    }
+    m_nodes[index].min = min;
+    m_nodes[index].max = max;
+    m_nodes[index].rightOrFirst = first;
+    m_nodes[index].count = count;
+
+    if(count <= MaxLeafSize || depth >= MaxDepth)
+        return index;
+
+    //每个轴把质心范围分成SahBins个桶, 在桶边界里找代价最小的划分
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1, bestSplit = 0;
+    for(int axis=0; axis < 3; ++axis)
+    {
+        const float extent = cmax[axis] - cmin[axis];
+        if(extent <= 0.0f)
+            continue;
+        const float scale = SahBins / extent;
+
+        int binCount[SahBins] = {};
+        glm::vec3 binMin[SahBins], binMax[SahBins];
+        for(int b=0; b < SahBins; ++b)
+        {
+            binMin[b] = glm::vec3(std::numeric_limits<float>::max());
+            binMax[b] = glm::vec3(-std::numeric_limits<float>::max());
+        }
+        for(int i=first; i < first + count; ++i)
+        {
+            const unsigned prim = m_indices[i];
+            const int b = std::min(SahBins - 1, int((centroids[prim][axis] - cmin[axis]) * scale));
+            ++binCount[b];
+            binMin[b] = glm::min(binMin[b], bounds[prim].min);
+            binMax[b] = glm::max(binMax[b], bounds[prim].max);
+        }
+
+        //从右往左累计出每个划分右侧的面积和个数, 再从左往右算代价
+        float rightArea[SahBins];
+        int rightCount[SahBins];
+        glm::vec3 accMin(std::numeric_limits<float>::max()), accMax(-std::numeric_limits<float>::max());
+        int acc = 0;
+        for(int b=SahBins - 1; b > 0; --b)
+        {
+            acc += binCount[b];
+            accMin = glm::min(accMin, binMin[b]);
+            accMax = glm::max(accMax, binMax[b]);
+            rightCount[b] = acc;
+            rightArea[b] = acc ? surfaceArea(accMin, accMax) : 0.0f;
+        }
+        accMin = glm::vec3(std::numeric_limits<float>::max());
+        accMax = glm::vec3(-std::numeric_limits<float>::max());
+        acc = 0;
+        for(int b=0; b < SahBins - 1; ++b)
+        {
+            acc += binCount[b];
+            accMin = glm::min(accMin, binMin[b]);
+            accMax = glm::max(accMax, binMax[b]);
+            if(acc == 0 || rightCount[b + 1] == 0)
+                continue;
+            const float cost = acc * surfaceArea(accMin, accMax) + rightCount[b + 1] * rightArea[b + 1];
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    //划分不比整个做叶子更便宜(遍历一个节点按一次图元测试算)就不再往下分
+    const float leafCost = count * surfaceArea(min, max);
+    if(bestAxis < 0 || bestCost + surfaceArea(min, max) >= leafCost)
+        return index;
+
+    const float scale = SahBins / (cmax[bestAxis] - cmin[bestAxis]);
+    unsigned *begin = m_indices.data() + first;
+    unsigned *mid = std::partition(begin, begin + count, [&](unsigned prim) {
+        return std::min(SahBins - 1, int((centroids[prim][bestAxis] - cmin[bestAxis]) * scale)) < bestSplit;
+    });
+    const int leftCount = int(mid - begin);
+
+    m_nodes[index].count = 0;
+    buildNode(first, leftCount, depth + 1, bounds, centroids);
+    const int right = buildNode(first + leftCount, count - leftCount, depth + 1, bounds, centroids);
+    m_nodes[index].rightOrFirst = right;
+    return index;
+}
+
+//孩子的下标总比父节点大, 倒序走一遍就是自底向上
+void Bvh::refit(const std::vector<Aabb> &bounds)
+{
+    for(int index=int(m_nodes.size()) - 1; index >= 0; --index)
+    {
+        Node &node = m_nodes[index];
+        if(node.count > 0)
+        {
+            node.min = glm::vec3(std::numeric_limits<float>::max());
+            node.max = glm::vec3(-std::numeric_limits<float>::max());
+            for(int i=node.rightOrFirst; i < node.rightOrFirst + node.count; ++i)
+            {
+                m_bounds[i] = bounds[m_indices[i]];
+                node.min = glm::min(node.min, m_bounds[i].min);
+                node.max = glm::max(node.max, m_bounds[i].max);
+            }
+        }
+        else
+        {
+            const Node &left = m_nodes[index + 1];
+            const Node &right = m_nodes[node.rightOrFirst];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void Bvh::queryFrustum(const glm::vec4 planes[6], std::vector<unsigned> &result) const
+{
+    result.clear();
+    if(m_nodes.empty())
+        return;
+
+    //栈里带着还需要测试的平面掩码, 掩码为0说明整个子树都在视锥内
+    struct Entry { int node; int mask; };
+    Entry stack[2 * MaxDepth + 4];
+    int top = 0;
+    stack[top++] = { 0, 0x3f };
+
+    while(top > 0)
+    {
+        const Entry entry = stack[--top];
+        const Node &node = m_nodes[entry.node];
+
+        int mask = entry.mask;
+        bool outside = false;
+        for(int p=0; p < 6 && mask; ++p)
+        {
+            if(!(mask & (1 << p)))
+                continue;
+            if(boxOutsidePlane(node.min, node.max, planes[p]))
+            {
+                outside = true;
+                break;
+            }
+            //子树以后不用再测这个平面
+            if(boxInsidePlane(node.min, node.max, planes[p]))
+                mask &= ~(1 << p);
+        }
+        if(outside)
+            continue;
+
+        if(node.count > 0)
+        {
+            for(int i=node.rightOrFirst; i < node.rightOrFirst + node.count; ++i)
+            {
+                bool visible = true;
+                for(int p=0; p < 6 && visible; ++p)
+                {
+                    if(mask & (1 << p))
+                        visible = !boxOutsidePlane(m_bounds[i].min, m_bounds[i].max, planes[p]);
+                }
+                if(visible)
+                    result.push_back(m_indices[i]);
+            }
+            continue;
+        }
+        stack[top++] = { node.rightOrFirst, mask };
+        stack[top++] = { entry.node + 1, mask };
+    }
+}
+
+void Bvh::queryBox(const glm::vec3 &min, const glm::vec3 &max, std::vector<unsigned> &result) const
+{
+    result.clear();
+    if(m_nodes.empty())
+        return;
+
+    int stack[2 * MaxDepth + 4];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0)
+    {
+        const int index = stack[--top];
+        const Node &node = m_nodes[index];
+        if(!boxesOverlap(node.min, node.max, min, max))
+            continue;
+
+        if(node.count > 0)
+        {
+            for(int i=node.rightOrFirst; i < node.rightOrFirst + node.count; ++i)
+            {
+                if(boxesOverlap(m_bounds[i].min, m_bounds[i].max, min, max))
+                    result.push_back(m_indices[i]);
+            }
+            continue;
+        }
+        stack[top++] = node.rightOrFirst;
+        stack[top++] = index + 1;
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+struct Aabb
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+//场景空间索引: 按SAH(分桶)自顶向下建树, 节点按深度优先顺序放在一个连续数组里,
+//左孩子总是紧跟在父节点后面, 节点里只存右孩子下标, 叶子里存图元区间.
+//物体移动后用refit自底向上更新包围盒, 不改变树的结构.
+class Bvh
+{
+public:
+    //MaxDepth保证遍历用的定长栈不会溢出
+    enum { MaxLeafSize = 4, SahBins = 12, MaxDepth = 60 };
+
+    //32字节, 两个节点正好一条cache line
+    struct Node
+    {
+        glm::vec3 min;
+        int rightOrFirst;   //内部节点: 右孩子下标; 叶子: m_indices里的起点
+        glm::vec3 max;
+        int count;          //0表示内部节点
+    };
+
+    void build(const std::vector<Aabb> &bounds);
+    //图元个数和顺序必须和build时一致
+    void refit(const std::vector<Aabb> &bounds);
+    void clear();
+
+    bool isEmpty() const { return m_nodes.empty(); }
+    int nodeCount() const { return int(m_nodes.size()); }
+    int primitiveCount() const { return int(m_indices.size()); }
+    const std::vector<Node> &nodes() const { return m_nodes; }
+
+    //和视锥(6个指向内部的平面)相交的图元, 完全在视锥内的子树不再测试平面, 结果不保证顺序
+    void queryFrustum(const glm::vec4 planes[6], std::vector<unsigned> &result) const;
+    //包围盒和[min, max]相交的图元
+    void queryBox(const glm::vec3 &min, const glm::vec3 &max, std::vector<unsigned> &result) const;
+
+    //最近命中: hit(primitive, distance)在图元被射中且比distance近时更新distance并返回true.
+    //返回命中的图元, 没有命中返回-1; 按近的孩子优先遍历, 远处被挡住的子树直接跳过
+    template<typename HitFunc>
+    int raycast(const glm::vec3 &origin, const glm::vec3 &dir, HitFunc hit,
+                float &distance) const;
+
+private:
+    int buildNode(int first, int count, int depth, const std::vector<Aabb> &bounds,
+                  const std::vector<glm::vec3> &centroids);
+    static bool slab(const Node &node, const glm::vec3 &origin, const glm::vec3 &invDir,
+                     float maxDistance, float &entry);
+
+    std::vector<Node> m_nodes;
+    std::vector<unsigned> m_indices;
+    //按m_indices的顺序存的图元包围盒, 叶子里的精确测试是顺序访问
+    std::vector<Aabb> m_bounds;
+};
+
+inline bool Bvh::slab(const Node &node, const glm::vec3 &origin, const glm::vec3 &invDir,
+                      float maxDistance, float &entry)
+{
+    const glm::vec3 t0 = (node.min - origin) * invDir;
+    const glm::vec3 t1 = (node.max - origin) * invDir;
+    const glm::vec3 tmin = glm::min(t0, t1);
+    const glm::vec3 tmax = glm::max(t0, t1);
+    entry = glm::max(glm::max(tmin.x, tmin.y), glm::max(tmin.z, 0.0f));
+    const float exit = glm::min(glm::min(tmax.x, tmax.y), glm::min(tmax.z, maxDistance));
+    return entry <= exit;
+}
+
+template<typename HitFunc>
+int Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &dir, HitFunc hit,
+                 float &distance) const
+{
+    int result = -1;
+    if(m_nodes.empty())
+        return result;
+
+    const glm::vec3 invDir = 1.0f / dir;
+    int stack[MaxDepth + 4];
+    int top = 0;
+    float entry;
+    if(!slab(m_nodes[0], origin, invDir, distance, entry))
+        return result;
+    stack[top++] = 0;
+
+    while(top > 0)
+    {
+        const Node &node = m_nodes[stack[--top]];
+        if(node.count > 0)
+        {
+            for(int i=0; i < node.count; ++i)
+            {
+                const unsigned prim = m_indices[node.rightOrFirst + i];
+                if(hit(prim, distance))
+                    result = int(prim);
+            }
+            continue;
+        }
+
+        const int left = int(&node - m_nodes.data()) + 1;
+        const int right = node.rightOrFirst;
+        float leftEntry, rightEntry;
+        const bool hitLeft = slab(m_nodes[left], origin, invDir, distance, leftEntry);
+        const bool hitRight = slab(m_nodes[right], origin, invDir, distance, rightEntry);
+        //近的后压栈, 先出栈
+        if(hitLeft && hitRight)
+        {
+            stack[top++] = leftEntry < rightEntry ? right : left;
+            stack[top++] = leftEntry < rightEntry ? left : right;
+        }
+        else if(hitLeft)
+            stack[top++] = left;
+        else if(hitRight)
+            stack[top++] = right;
+    }
+    return result;
+}
+
+#endif // BVH_H
@@ -0,0 +1,226 @@
+#include "entitystore.h"
+#include "jobsystem.h"
+
+#include <cstring>
+
+//每种组件一个元素的大小, 顺序和ComponentBit的位一致
+static const size_t componentSizes[ComponentKinds] = {
+    sizeof(Component<PositionComponent>::Type),
+    sizeof(Component<RotationComponent>::Type),
+    sizeof(Component<BoundsComponent>::Type),
+    sizeof(Component<MaterialComponent>::Type),
+    sizeof(Component<MeshComponent>::Type),
+    sizeof(Component<InstanceComponent>::Type),
+};
+
+//forEach并行时每个任务处理的块数
+enum { ChunkGrain = 8 };
+
+static size_t alignToCacheLine(size_t offset)
+{
+    return (offset + EntityStore::CacheLine - 1) / EntityStore::CacheLine * EntityStore::CacheLine;
+}
+
+EntityStore::EntityStore()
+    : m_count(0)
+{
+}
+
+EntityStore::~EntityStore()
+{
+    clear();
+}
+
+void EntityStore::clear()
+{
+    for(Archetype *archetype : m_archetypes)
+    {
+        for(Chunk *chunk : archetype->chunks)
+        {
+            qFreeAligned(chunk->m_data);
+            delete chunk;
+        }
+        delete archetype;
+    }
+    m_archetypes.clear();
+    m_locations.clear();
+    m_freeIndices.clear();
+    m_count = 0;
+}
+
+//组件组合第一次出现时定好块里的布局: 按每个实体的总字节数算出一块放几个, 每个数组的起点对齐到缓存行
+int EntityStore::archetype(int components)
+{
+    for(size_t i=0; i < m_archetypes.size(); ++i)
+    {
+        if(m_archetypes[i]->components == components)
+            return int(i);
+    }
+
+    Archetype *archetype = new Archetype;
+    archetype->components = components;
+    size_t entityBytes = sizeof(Entity);
+    int arrays = 1;
+    for(int i=0; i < ComponentKinds; ++i)
+    {
+        if(components & (1 << i))
+        {
+            entityBytes += componentSizes[i];
+            ++arrays;
+        }
+    }
+    archetype->capacity = int((ChunkBytes - arrays * CacheLine) / entityBytes);
+
+    size_t offset = alignToCacheLine(archetype->capacity * sizeof(Entity));
+    for(int i=0; i < ComponentKinds; ++i)
+    {
+        archetype->offsets[i] = 0;
+        if(components & (1 << i))
+        {
+            archetype->offsets[i] = offset;
+            offset = alignToCacheLine(offset + archetype->capacity * componentSizes[i]);
+        }
+    }
+    Q_ASSERT(offset <= ChunkBytes);
+    m_archetypes.push_back(archetype);
+    return int(m_archetypes.size() - 1);
+}
+
+EntityStore::Chunk *EntityStore::allocateChunk(const Archetype &archetype)
+{
+    Chunk *chunk = new Chunk;
+    chunk->m_data = static_cast<unsigned char *>(qMallocAligned(ChunkBytes, CacheLine));
+    chunk->m_offsets = archetype.offsets;
+    chunk->m_count = 0;
+    chunk->m_capacity = archetype.capacity;
+    return chunk;
+}
+
+Entity EntityStore::create(int components)
+{
+    const int a = archetype(components);
+    Archetype &archetype = *m_archetypes[a];
+    if(archetype.chunks.empty() || archetype.chunks.back()->m_count == archetype.capacity)
+        archetype.chunks.push_back(allocateChunk(archetype));
+    Chunk &chunk = *archetype.chunks.back();
+    const int row = chunk.m_count++;
+
+    Entity entity;
+    if(m_freeIndices.empty())
+    {
+        entity.index = quint32(m_locations.size());
+        entity.generation = 0;
+        m_locations.push_back(Location());
+    }
+    else
+    {
+        entity.index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+        entity.generation = m_locations[entity.index].generation;
+    }
+    Location &location = m_locations[entity.index];
+    location.archetype = quint32(a);
+    location.chunk = quint32(archetype.chunks.size() - 1);
+    location.row = quint32(row);
+    location.generation = entity.generation;
+    location.alive = true;
+
+    reinterpret_cast<Entity *>(chunk.m_data)[row] = entity;
+    for(int i=0; i < ComponentKinds; ++i)
+    {
+        if(archetype.offsets[i])
+            memset(chunk.m_data + archetype.offsets[i] + row * componentSizes[i], 0, componentSizes[i]);
+    }
+    ++m_count;
+    return entity;
+}
+
+bool EntityStore::destroy(Entity entity)
+{
+    const Location *found = find(entity);
+    if(!found)
+        return false;
+    const Location location = *found;
+    Archetype &archetype = *m_archetypes[location.archetype];
+    Chunk &chunk = *archetype.chunks[location.chunk];
+    Chunk &last = *archetype.chunks.back();
+    const int lastRow = last.m_count - 1;
+
+    //archetype里的最后一个实体搬进空位, 块保持紧凑
+    if(&chunk != &last || int(location.row) != lastRow)
+    {
+        const Entity moved = reinterpret_cast<Entity *>(last.m_data)[lastRow];
+        reinterpret_cast<Entity *>(chunk.m_data)[location.row] = moved;
+        for(int i=0; i < ComponentKinds; ++i)
+        {
+            if(archetype.offsets[i])
+                memcpy(chunk.m_data + archetype.offsets[i] + location.row * componentSizes[i],
+                       last.m_data + archetype.offsets[i] + lastRow * componentSizes[i], componentSizes[i]);
+        }
+        m_locations[moved.index].chunk = location.chunk;
+        m_locations[moved.index].row = location.row;
+    }
+    --last.m_count;
+    //最后一块空了就还回去, 留一块给下一次创建
+    if(last.m_count == 0 && archetype.chunks.size() > 1)
+    {
+        qFreeAligned(last.m_data);
+        delete &last;
+        archetype.chunks.pop_back();
+    }
+
+    Location &dead = m_locations[entity.index];
+    dead.alive = false;
+    ++dead.generation;
+    m_freeIndices.push_back(entity.index);
+    --m_count;
+    return true;
+}
+
+const EntityStore::Location *EntityStore::find(Entity entity) const
+{
+    if(entity.index >= m_locations.size())
+        return nullptr;
+    const Location &location = m_locations[entity.index];
+    return location.alive && location.generation == entity.generation ? &location : nullptr;
+}
+
+bool EntityStore::isAlive(Entity entity) const
+{
+    return find(entity) != nullptr;
+}
+
+int EntityStore::components(Entity entity) const
+{
+    const Location *location = find(entity);
+    return location ? m_archetypes[location->archetype]->components : 0;
+}
+
+void EntityStore::chunks(int required, std::vector<Chunk *> &out) const
+{
+    out.clear();
+    for(const Archetype *archetype : m_archetypes)
+    {
+        if((archetype->components & required) != required)
+            continue;
+        for(Chunk *chunk : archetype->chunks)
+        {
+            if(chunk->m_count > 0)
+                out.push_back(chunk);
+        }
+    }
+}
+
+void EntityStore::forEach(int required, JobSystem *jobs, const std::function<void(Chunk &chunk)> &body) const
+{
+    std::vector<Chunk *> matching;
+    chunks(required, matching);
+    auto run = [&](int begin, int end) {
+        for(int c=begin; c < end; ++c)
+            body(*matching[c]);
+    };
+    if(jobs)
+        jobs->parallelFor(int(matching.size()), ChunkGrain, run);
+    else
+        run(0, int(matching.size()));
+}
@@ -0,0 +1,134 @@
+#ifndef ENTITYSTORE_H
+#define ENTITYSTORE_H
+
+#include <QtGlobal>
+
+#include <vector>
+#include <functional>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "bvh.h"
+
+class JobSystem;
+
+//组件种类, 每种一位
+enum ComponentBit
+{
+    PositionComponent = 0x1,    //世界空间的位置
+    RotationComponent = 0x2,    //基础朝向, 动画在它上面叠加
+    BoundsComponent = 0x4,      //世界空间包围盒
+    MaterialComponent = 0x8,    //(底图region, 叠加图region)
+    MeshComponent = 0x10,       //模型句柄
+    InstanceComponent = 0x20,   //在渲染器各个按实例编号的数组(变换层次/剔除/LOD)里的下标
+    ComponentKinds = 6
+};
+
+template<int Bit> struct Component;
+template<> struct Component<PositionComponent> { typedef glm::vec3 Type; };
+template<> struct Component<RotationComponent> { typedef glm::quat Type; };
+template<> struct Component<BoundsComponent> { typedef Aabb Type; };
+template<> struct Component<MaterialComponent> { typedef glm::u16vec2 Type; };
+template<> struct Component<MeshComponent> { typedef quint16 Type; };
+template<> struct Component<InstanceComponent> { typedef quint32 Type; };
+
+//实体句柄: index可以被删掉的实体重用, generation区分先后用过同一个index的实体
+struct Entity
+{
+    quint32 index;
+    quint32 generation;
+};
+
+//按archetype(组件组合)分组的组件存储: 同一组合的实体放在若干个ChunkBytes大的块里,
+//块里每种组件一个数组(SoA), 每个数组从缓存行边界开始, 遍历某几种组件时只读这几个数组.
+//一个archetype里除了最后一块都是满的; 删除时把最后一个实体搬进空位(swap-back), 增删都是O(1),
+//但会改变遍历顺序. 结构上的修改(增删实体)不是线程安全的, 只有forEach可以多线程.
+class EntityStore
+{
+public:
+    enum { ChunkBytes = 16384, CacheLine = 64 };
+
+    class Chunk
+    {
+    public:
+        int count() const { return m_count; }
+        int capacity() const { return m_capacity; }
+        const Entity *entities() const { return reinterpret_cast<const Entity *>(m_data); }
+        //这一块的archetype没有这种组件时返回空
+        template<int Bit> typename Component<Bit>::Type *get() const
+        {
+            const size_t offset = m_offsets[componentIndex(Bit)];
+            return offset ? reinterpret_cast<typename Component<Bit>::Type *>(m_data + offset) : nullptr;
+        }
+
+    private:
+        friend class EntityStore;
+        unsigned char *m_data;
+        const size_t *m_offsets;
+        int m_count;
+        int m_capacity;
+    };
+
+    EntityStore();
+    ~EntityStore();
+
+    void clear();
+    //新实体的组件都是0
+    Entity create(int components);
+    //最后一个实体搬进空位; 句柄已经失效时返回false
+    bool destroy(Entity entity);
+    bool isAlive(Entity entity) const;
+    int count() const { return m_count; }
+    int components(Entity entity) const;
+
+    //实体没有这种组件(或已经删掉)时返回空; 指针在下一次增删实体之前有效
+    template<int Bit> typename Component<Bit>::Type *get(Entity entity) const
+    {
+        const Location *location = find(entity);
+        if(!location)
+            return nullptr;
+        typename Component<Bit>::Type *values = m_archetypes[location->archetype]->chunks[location->chunk]->get<Bit>();
+        return values ? values + location->row : nullptr;
+    }
+
+    //包含required里所有组件的块, 按archetype创建的顺序和块的顺序
+    void chunks(int required, std::vector<Chunk *> &out) const;
+    //对每个符合的块调用body; jobs不为空时按块分组并行, body只能改组件的值
+    void forEach(int required, JobSystem *jobs, const std::function<void(Chunk &chunk)> &body) const;
+
+    static constexpr int componentIndex(int bit) { return bit == 1 ? 0 : 1 + componentIndex(bit >> 1); }
+
+private:
+    Q_DISABLE_COPY(EntityStore)
+
+    struct Archetype
+    {
+        int components;
+        int capacity;
+        //offsets[i]是第i种组件的数组在块里的偏移, 0表示没有这种组件(实体句柄数组在偏移0)
+        size_t offsets[ComponentKinds];
+        std::vector<Chunk *> chunks;
+    };
+
+    struct Location
+    {
+        quint32 archetype;
+        quint32 chunk;
+        quint32 row;
+        quint32 generation;
+        bool alive;
+    };
+
+    const Location *find(Entity entity) const;
+    int archetype(int components);
+    Chunk *allocateChunk(const Archetype &archetype);
+
+    std::vector<Archetype *> m_archetypes;
+    std::vector<Location> m_locations;
+    std::vector<quint32> m_freeIndices;
+    int m_count;
+};
+
+#endif // ENTITYSTORE_H
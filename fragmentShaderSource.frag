@@ -1,10 +1,30 @@
 #version 330
+#ifndef LIGHTING
+#define LIGHTING 0
+#endif
 out vec4 fragColor;
 in vec2 TexCoord;
+#if LIGHTING == 1
+in vec3 Normal;
+//世界空间里固定的方向光
+const vec3 lightDir = normalize(vec3(0.4, 1.0, 0.6));
+#endif
+#ifdef TEXTURED
 uniform sampler2D texture1;
 uniform sampler2D texture2;
+#endif
+//鼠标选中的物体往高亮色混合
+uniform float highlight;
 
 void main()
 {
-    fragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+#ifdef TEXTURED
+    vec4 color = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+#else
+    vec4 color = vec4(0.8, 0.8, 0.8, 1.0);
+#endif
+#if LIGHTING == 1
+    color.rgb *= 0.25 + 0.75 * max(dot(normalize(Normal), lightDir), 0.0);
+#endif
+    fragColor = mix(color, vec4(1.0, 0.8, 0.2, 1.0), highlight);
 }
@@ -0,0 +1,201 @@
+#include "frameprofiler.h"
+
+#include <QOpenGLTimerQuery>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+
+#include <QDebug>
+
+FrameProfiler::FrameProfiler(int historySize)
+    : m_history(qMax(historySize, int(Latency)))
+    , m_frameIndex(0)
+    , m_lastResolved(-1)
+    , m_gpuTiming(false)
+    , m_inFrame(false)
+{
+    m_clock.start();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+}
+
+void FrameProfiler::initialize()
+{
+    //先试着建一个查询, 建不出来(比如ES或没有ARB_timer_query)就只做CPU统计
+    QOpenGLTimerQuery probe;
+    m_gpuTiming = probe.create();
+    probe.destroy();
+    if(!m_gpuTiming)
+        qDebug("profiler: timer queries unavailable, CPU scopes only");
+}
+
+void FrameProfiler::cleanup()
+{
+    for(QuerySlot &slot : m_slots)
+    {
+        for(QOpenGLTimerQuery *q : slot.queries)
+            delete q;
+        slot.queries.clear();
+        slot.historyIndex = -1;
+        slot.used = 0;
+    }
+}
+
+QOpenGLTimerQuery *FrameProfiler::query(QuerySlot &slot, int index)
+{
+    while(int(slot.queries.size()) <= index)
+    {
+        QOpenGLTimerQuery *q = new QOpenGLTimerQuery;
+        q->create();
+        slot.queries.push_back(q);
+    }
+    return slot.queries[index];
+}
+
+void FrameProfiler::resolve(QuerySlot &slot)
+{
+    if(slot.historyIndex < 0)
+        return;
+
+    Frame &frame = m_history[slot.historyIndex];
+    bool available = true;
+    for(int i=0; i < slot.used && available; ++i)
+        available = slot.queries[i]->isResultAvailable();
+
+    if(available)
+    {
+        for(size_t i=0; i < frame.scopes.size(); ++i)
+        {
+            frame.scopes[i].gpuBegin = qint64(slot.queries[2 * i]->waitForResult());
+            frame.scopes[i].gpuEnd = qint64(slot.queries[2 * i + 1]->waitForResult());
+        }
+        frame.gpuResolved = true;
+        m_lastResolved = slot.historyIndex;
+    }
+    slot.historyIndex = -1;
+    slot.used = 0;
+}
+
+void FrameProfiler::beginFrame()
+{
+    //Latency帧之前用过这一组查询, 现在去取结果(取不到就丢掉), 然后给本帧复用
+    if(m_gpuTiming)
+        resolve(m_slots[m_frameIndex % Latency]);
+
+    m_current.index = m_frameIndex;
+    m_current.gpuResolved = false;
+    m_current.scopes.clear();
+    m_stack.clear();
+    m_inFrame = true;
+    pushScope("frame");
+}
+
+void FrameProfiler::endFrame()
+{
+    popScope();
+    m_inFrame = false;
+
+    const int historyIndex = int(m_frameIndex % qint64(m_history.size()));
+    m_history[historyIndex] = m_current;
+    if(m_lastResolved == historyIndex)
+        m_lastResolved = -1;
+
+    if(m_gpuTiming)
+    {
+        QuerySlot &slot = m_slots[m_frameIndex % Latency];
+        slot.historyIndex = historyIndex;
+        slot.used = int(m_current.scopes.size()) * 2;
+    }
+    ++m_frameIndex;
+}
+
+void FrameProfiler::pushScope(const char *name)
+{
+    if(!m_inFrame)
+        return;
+
+    Scope scope;
+    scope.name = name;
+    scope.depth = int(m_stack.size());
+    scope.cpuBegin = m_clock.nsecsElapsed();
+    scope.cpuEnd = scope.cpuBegin;
+    scope.gpuBegin = scope.gpuEnd = -1;
+
+    const int index = int(m_current.scopes.size());
+    m_current.scopes.push_back(scope);
+    m_stack.push_back(index);
+
+    if(m_gpuTiming)
+        query(m_slots[m_frameIndex % Latency], 2 * index)->recordTimestamp();
+}
+
+void FrameProfiler::popScope()
+{
+    if(!m_inFrame || m_stack.empty())
+        return;
+
+    const int index = m_stack.back();
+    m_stack.pop_back();
+    m_current.scopes[index].cpuEnd = m_clock.nsecsElapsed();
+
+    if(m_gpuTiming)
+        query(m_slots[m_frameIndex % Latency], 2 * index + 1)->recordTimestamp();
+}
+
+const FrameProfiler::Frame *FrameProfiler::lastResolvedFrame() const
+{
+    if(m_lastResolved < 0)
+        return nullptr;
+    return &m_history[m_lastResolved];
+}
+
+//CPU段放在tid 1, GPU段放在tid 2; GPU时间戳按每帧第一个时间戳对齐到这一帧的CPU起点
+bool FrameProfiler::writeChromeTrace(const QString &fileName) const
+{
+    QJsonArray events;
+    for(const Frame &frame : m_history)
+    {
+        if(frame.index < 0 || frame.scopes.empty())
+            continue;
+
+        const qint64 gpuOrigin = frame.scopes.front().gpuBegin;
+        const qint64 cpuOrigin = frame.scopes.front().cpuBegin;
+        for(const Scope &scope : frame.scopes)
+        {
+            QJsonObject cpu;
+            cpu["name"] = QString::fromLatin1(scope.name);
+            cpu["cat"] = "cpu";
+            cpu["ph"] = "X";
+            cpu["pid"] = 1;
+            cpu["tid"] = 1;
+            cpu["ts"] = scope.cpuBegin / 1000.0;
+            cpu["dur"] = (scope.cpuEnd - scope.cpuBegin) / 1000.0;
+            cpu["args"] = QJsonObject{ { "frame", frame.index } };
+            events.append(cpu);
+
+            if(!frame.gpuResolved)
+                continue;
+            QJsonObject gpu = cpu;
+            gpu["cat"] = "gpu";
+            gpu["tid"] = 2;
+            gpu["ts"] = (cpuOrigin + scope.gpuBegin - gpuOrigin) / 1000.0;
+            gpu["dur"] = (scope.gpuEnd - scope.gpuBegin) / 1000.0;
+            events.append(gpu);
+        }
+    }
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "profiler: cannot write" << fileName;
+        return false;
+    }
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ns";
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <vector>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLTimerQuery)
+
+//分层的帧性能统计: CPU段用QElapsedTimer(纳秒), GPU段在段首/段尾各记录一个时间戳查询.
+//查询结果延迟Latency帧再读, 读的时候还没出结果就放弃这一帧的GPU数据, 所以永远不会等GPU.
+//最近historySize帧保存在环形数组里, 可以导出成Chrome trace(chrome://tracing)格式.
+class FrameProfiler
+{
+public:
+    enum { Latency = 3 };
+
+    struct Scope
+    {
+        const char *name;
+        int depth;
+        qint64 cpuBegin, cpuEnd;    //纳秒, 相对profiler创建的时刻
+        qint64 gpuBegin, gpuEnd;    //纳秒, GPU时钟; 拿不到结果时为-1
+    };
+
+    struct Frame
+    {
+        qint64 index = -1;
+        bool gpuResolved = false;
+        std::vector<Scope> scopes;
+    };
+
+    explicit FrameProfiler(int historySize = 120);
+    ~FrameProfiler();
+
+    //需要当前有GL context; 不支持计时查询时只统计CPU
+    void initialize();
+    void cleanup();
+
+    void beginFrame();
+    void endFrame();
+    void pushScope(const char *name);
+    void popScope();
+
+    //最近一帧GPU结果已经回来的数据, 没有时返回nullptr
+    const Frame *lastResolvedFrame() const;
+    bool writeChromeTrace(const QString &fileName) const;
+
+private:
+    struct QuerySlot
+    {
+        std::vector<QOpenGLTimerQuery *> queries;
+        int historyIndex = -1;
+        int used = 0;
+    };
+
+    void resolve(QuerySlot &slot);
+    QOpenGLTimerQuery *query(QuerySlot &slot, int index);
+
+    QElapsedTimer m_clock;
+    std::vector<Frame> m_history;
+    Frame m_current;
+    std::vector<int> m_stack;
+    QuerySlot m_slots[Latency];
+    qint64 m_frameIndex;
+    int m_lastResolved;
+    bool m_gpuTiming;
+    bool m_inFrame;
+};
+
+//作用域结束时自动popScope
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler *profiler, const char *name) : m_profiler(profiler) { m_profiler->pushScope(name); }
+    ~ProfileScope() { m_profiler->popScope(); }
+
+private:
+    FrameProfiler *m_profiler;
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,63 @@
+#include "framescheduler.h"
+
+#include <QWidget>
+#include <QGuiApplication>
+#include <QScreen>
+
+FrameScheduler::FrameScheduler(QWidget *widget)
+    : QObject(widget)
+    , m_widget(widget)
+    , m_dirty(Camera | Projection | Scene)
+    , m_pending(false)
+    , m_interval(16)
+    , m_eventsReceived(0)
+    , m_framesRendered(0)
+{
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if(screen && screen->refreshRate() > 1.0)
+        m_interval = qMax(1, int(1000.0 / screen->refreshRate()));
+
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &FrameScheduler::onTimeout);
+    m_sinceLastFrame.start();
+}
+
+void FrameScheduler::markDirty(DirtyFlags flags)
+{
+    m_dirty |= flags;
+}
+
+void FrameScheduler::requestFrame(DirtyFlags flags)
+{
+    ++m_eventsReceived;
+    scheduleFrame(flags);
+}
+
+void FrameScheduler::scheduleFrame(DirtyFlags flags)
+{
+    m_dirty |= flags;
+    if(m_pending)
+        return;
+
+    //距离上一帧不足一个刷新周期就等到周期结束, 期间的事件都合并进这一帧
+    m_pending = true;
+    const qint64 wait = m_interval - m_sinceLastFrame.elapsed();
+    m_timer.start(int(qMax<qint64>(0, wait)));
+}
+
+FrameScheduler::DirtyFlags FrameScheduler::takeDirty()
+{
+    DirtyFlags dirty = m_dirty;
+    m_dirty = DirtyFlags();
+    m_pending = false;
+    m_timer.stop();
+    m_sinceLastFrame.restart();
+    ++m_framesRendered;
+    return dirty;
+}
+
+void FrameScheduler::onTimeout()
+{
+    m_widget->update();
+}
@@ -0,0 +1,53 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+QT_FORWARD_DECLARE_CLASS(QWidget)
+
+//把输入事件引起的状态变化合并成每个刷新周期最多一次重绘, 并记录哪些状态需要重新计算
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum DirtyFlag {
+        Camera     = 0x1,   //cameraPos/cameraFront变化, 需要重新lookAt
+        Projection = 0x2,   //窗口尺寸变化, 需要重新perspective
+        Scene      = 0x4    //实例数量/绘制模式变化
+    };
+    Q_DECLARE_FLAGS(DirtyFlags, DirtyFlag)
+
+    explicit FrameScheduler(QWidget *widget);
+
+    //只标记状态, 不安排重绘(比如resizeGL之后Qt本来就会重绘)
+    void markDirty(DirtyFlags flags);
+    //输入事件用: 标记状态并安排一次重绘, 同一刷新周期内的多次请求会合并; 计入eventsReceived
+    void requestFrame(DirtyFlags flags);
+    //程序内部触发的重绘(纹理解码完/shader还在编译), 和requestFrame一样合并, 但不算输入事件
+    void scheduleFrame(DirtyFlags flags);
+    //paintGL开始时调用, 取走累计的脏标记
+    DirtyFlags takeDirty();
+
+    qint64 eventsReceived() const { return m_eventsReceived; }
+    qint64 framesRendered() const { return m_framesRendered; }
+
+private slots:
+    void onTimeout();
+
+private:
+    QWidget *m_widget;
+    QTimer m_timer;
+    QElapsedTimer m_sinceLastFrame;
+    DirtyFlags m_dirty;
+    bool m_pending;
+    int m_interval;
+
+    qint64 m_eventsReceived;
+    qint64 m_framesRendered;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(FrameScheduler::DirtyFlags)
+
+#endif // FRAMESCHEDULER_H
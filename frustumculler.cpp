@@ -0,0 +1,173 @@
+#include "frustumculler.h"
+
+#include <algorithm>
+
+//GLM_ARCH在GLM_FORCE_INTRINSICS时由编译器的-msse/-mavx决定, 并且已经include了对应的intrinsics头文件
+#include <glm/simd/platform.h>
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//最低的置位在第几位, mask不能是0; MSVC没有__builtin_ctz
+static inline int countTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return int(bit);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+void FrustumCuller::resize(int count)
+{
+    m_count = count;
+    const int padded = (count + Batch - 1) / Batch * Batch;
+    m_x.resize(padded, 0.0f);
+    m_y.resize(padded, 0.0f);
+    m_z.resize(padded, 0.0f);
+    //已有物体的半径保留; 缩小后补齐用的尾部也要重新标成剔除
+    m_r.resize(padded, -1.0f);
+    std::fill(m_r.begin() + count, m_r.end(), -1.0f);
+}
+
+void FrustumCuller::setSphere(int index, const glm::vec3 &center, float radius)
+{
+    m_x[index] = center.x;
+    m_y[index] = center.y;
+    m_z[index] = center.z;
+    m_r[index] = radius;
+}
+
+void FrustumCuller::setViewProjection(const glm::mat4 &viewProjection)
+{
+    extractPlanes(viewProjection, m_planes);
+}
+
+//Gribb/Hartmann: glm是列主序, 第i行是(m[0][i], m[1][i], m[2][i], m[3][i])
+void FrustumCuller::extractPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6])
+{
+    const glm::mat4 &m = viewProjection;
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0;  //左
+    planes[1] = row3 - row0;  //右
+    planes[2] = row3 + row1;  //下
+    planes[3] = row3 - row1;  //上
+    planes[4] = row3 + row2;  //近
+    planes[5] = row3 - row2;  //远
+
+    for(int i=0; i < 6; ++i)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+const char *FrustumCuller::path()
+{
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    return "avx";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+//球心到平面的有符号距离 >= -r 对全部6个平面成立才可见
+int FrustumCuller::cull(std::vector<unsigned> &visible) const
+{
+    visible.resize(m_count);
+    const int visibleCount = cull(0, m_count, visible.data());
+    visible.resize(visibleCount);
+    return visibleCount;
+}
+
+int FrustumCuller::cull(int begin, int end, unsigned *out) const
+{
+    unsigned *const first = out;
+    //end不是Batch的倍数时只能是count, 补齐到一批后多出来的都是半径为负的球
+    const int padded = std::min((end + Batch - 1) / Batch * Batch, int(m_r.size()));
+
+#if GLM_ARCH & GLM_ARCH_AVX_BIT
+    __m256 px[6], py[6], pz[6], pw[6];
+    for(int p=0; p < 6; ++p)
+    {
+        px[p] = _mm256_set1_ps(m_planes[p].x);
+        py[p] = _mm256_set1_ps(m_planes[p].y);
+        pz[p] = _mm256_set1_ps(m_planes[p].z);
+        pw[p] = _mm256_set1_ps(m_planes[p].w);
+    }
+    for(int i=begin; i < padded; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&m_x[i]);
+        const __m256 y = _mm256_loadu_ps(&m_y[i]);
+        const __m256 z = _mm256_loadu_ps(&m_z[i]);
+        const __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&m_r[i]));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p=0; p < 6; ++p)
+        {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(x, px[p]), pw[p]);
+            d = _mm256_add_ps(d, _mm256_mul_ps(y, py[p]));
+            d = _mm256_add_ps(d, _mm256_mul_ps(z, pz[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+        }
+        //补齐部分的半径是负数, 一定不会通过, 所以不用单独处理尾部
+        int mask = _mm256_movemask_ps(inside);
+        while(mask)
+        {
+            const int bit = countTrailingZeros(unsigned(mask));
+            *out++ = unsigned(i + bit);
+            mask &= mask - 1;
+        }
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    __m128 px[6], py[6], pz[6], pw[6];
+    for(int p=0; p < 6; ++p)
+    {
+        px[p] = _mm_set1_ps(m_planes[p].x);
+        py[p] = _mm_set1_ps(m_planes[p].y);
+        pz[p] = _mm_set1_ps(m_planes[p].z);
+        pw[p] = _mm_set1_ps(m_planes[p].w);
+    }
+    for(int i=begin; i < padded; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&m_x[i]);
+        const __m128 y = _mm_loadu_ps(&m_y[i]);
+        const __m128 z = _mm_loadu_ps(&m_z[i]);
+        const __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_r[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p=0; p < 6; ++p)
+        {
+            __m128 d = _mm_add_ps(_mm_mul_ps(x, px[p]), pw[p]);
+            d = _mm_add_ps(d, _mm_mul_ps(y, py[p]));
+            d = _mm_add_ps(d, _mm_mul_ps(z, pz[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+        }
+        int mask = _mm_movemask_ps(inside);
+        while(mask)
+        {
+            const int bit = countTrailingZeros(unsigned(mask));
+            *out++ = unsigned(i + bit);
+            mask &= mask - 1;
+        }
+    }
+#else
+    for(int i=begin; i < padded; ++i)
+    {
+        const glm::vec3 c(m_x[i], m_y[i], m_z[i]);
+        bool inside = true;
+        for(int p=0; p < 6 && inside; ++p)
+            inside = glm::dot(glm::vec3(m_planes[p]), c) + m_planes[p].w >= -m_r[i];
+        if(inside)
+            *out++ = unsigned(i);
+    }
+#endif
+
+    return int(out - first);
+}
@@ -0,0 +1,42 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//CPU视锥剔除: 从projection * view里取出6个平面, 用包围球测试物体.
+//包围球按SoA存放(x/y/z/r各一个数组, 长度补齐到8的倍数), 按GLM在simd/platform.h里选好的
+//指令集一次测4个(SSE)或8个(AVX)球, 没有SIMD时退回逐个测试.
+class FrustumCuller
+{
+public:
+    enum { Batch = 8 };
+
+    //重新设置物体个数, 新增的球半径为负, 总是被剔除
+    void resize(int count);
+    int count() const { return m_count; }
+    void setSphere(int index, const glm::vec3 &center, float radius);
+
+    //viewProjection = projection * view, 平面法线指向视锥内部并归一化
+    void setViewProjection(const glm::mat4 &viewProjection);
+    const glm::vec4 *planes() const { return m_planes; }
+    //Bvh等其他空间查询也用同样的平面
+    static void extractPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]);
+
+    //把可见物体的下标按升序写进visible, 返回可见个数
+    int cull(std::vector<unsigned> &visible) const;
+    //只测[begin, end), begin和end是Batch的倍数(end也可以是count), 用来分块并行;
+    //out至少要有end - begin个位置, 返回写进去的个数
+    int cull(int begin, int end, unsigned *out) const;
+
+    //当前编译进来的是哪条路径: "avx", "sse2"或"scalar"
+    static const char *path();
+
+private:
+    int m_count = 0;
+    std::vector<float> m_x, m_y, m_z, m_r;
+    glm::vec4 m_planes[6];
+};
+
+#endif // FRUSTUMCULLER_H
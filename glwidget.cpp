@@ -1,8 +1,8 @@
 ﻿#include "glwidget.h"
-#include <QOpenGLShaderProgram>
 #include <QKeyEvent>
 #include <QApplication>
 #include <QWheelEvent>
+#include <QPainter>
 
 #include <QDebug>
 
@@ -14,6 +14,8 @@ public:
 
 GLWidget::GLWidget(QWidget *parent) : QOpenGLWidget(parent)
   , data(new GLWidgetData)
+  , m_scheduler(new FrameScheduler(this))
+  , m_showOverlay(false)
   , m_cameraSpeed(0.1f)
 {
     setFocusPolicy(Qt::ClickFocus);
@@ -24,6 +26,8 @@ GLWidget::GLWidget(QWidget *parent) : QOpenGLWidget(parent)
 }
 
 GLWidget::GLWidget(const GLWidget &rhs) : data(rhs.data)
+  , m_scheduler(new FrameScheduler(this))
+  , m_showOverlay(false)
 {
 
 }
@@ -35,77 +39,13 @@ GLWidget::~GLWidget()
 
 void GLWidget::cleanup()
 {
-    if (m_program == nullptr)
+    if (!m_renderer.isInitialized())
         return;
     makeCurrent();
-    m_vbo.destroy();
-    delete m_program;
-    m_program = 0;
+    m_renderer.cleanup();
     doneCurrent();
 }
 
-GLfloat vertices[] = {
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-};
-
-glm::vec3 cubePositions[] = {
-    glm::vec3( 0.0f,  0.0f,  0.0f),
-    glm::vec3( 2.0f,  5.0f, -15.0f),
-    glm::vec3(-1.5f, -2.2f, -2.5f),
-    glm::vec3(-3.8f, -2.0f, -12.3f),
-    glm::vec3( 2.4f, -0.4f, -3.5f),
-    glm::vec3(-1.7f,  3.0f, -7.5f),
-    glm::vec3( 1.3f, -2.0f, -2.5f),
-    glm::vec3( 1.5f,  2.0f, -2.5f),
-    glm::vec3( 1.5f,  0.2f, -1.5f),
-    glm::vec3(-1.3f,  1.0f, -1.5f)
-};
-
-GLenum indices[] = {
-    0, 1, 3, // 第一个三角形
-    1, 2, 3  // 第二个三角形
-};
-
 void GLWidget::initializeGL()
 {
     //    QTimer *timer = new QTimer(this);
@@ -120,108 +60,59 @@ void GLWidget::initializeGL()
     connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &GLWidget::cleanup);
 
     initializeOpenGLFunctions();
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-
-    m_program = new QOpenGLShaderProgram;
-
-    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertexShaderSource.vert");
-    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragmentShaderSource.frag");
-
-    if(m_program->link())
-    {
-        qDebug("link success");
-    }
-    else
-    {
-        qDebug("link failed");
-    }
-
-    m_program->bind();
-    m_modelLoc = m_program->uniformLocation("model");
-    m_cameraLoc = m_program->uniformLocation("view");
-    m_projLoc = m_program->uniformLocation("projection");
-
-    m_vao.create();
-    m_vbo.create();
-    m_ebo.create();
-
-    m_vao.bind();
-
-    //定点属性绑定
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo.bufferId());
-    glBufferData(GL_ARRAY_BUFFER,  sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    //纹理相关代码初始化
-    m_texture1 = new QOpenGLTexture(QImage(":/container.jpg"));
-    glBindTexture(GL_TEXTURE_2D, m_texture1->textureId());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    m_texture2 = new QOpenGLTexture(QImage(":/awesomeface.png").mirrored());
-    glBindTexture(GL_TEXTURE_2D, m_texture2->textureId());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof (GLfloat)));
-
-    m_vao.release();
-    m_program->release();
+    m_renderer.initialize();
+
+    //纹理解码完成后安排一次重绘, 在paintGL里上传
+    connect(&m_renderer.textureLoader(), &TextureLoader::textureDecoded, this, [this]{
+        m_scheduler->scheduleFrame(FrameScheduler::Scene);
+    });
+    //shader文件改了, 下一帧开始重新编译, 编译完之前一直出帧
+    m_renderer.shaderVariants().setChangeCallback([this]{
+        m_scheduler->scheduleFrame(FrameScheduler::Scene);
+    });
 }
 
 void GLWidget::paintGL()
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    //glEnable(GL_CULL_FACE);
-
-    // 设置顺时针方向 CW : Clock Wind 顺时针方向
-    // 默认是 GL_CCW : Counter Clock Wind 逆时针方向
-    //glFrontFace(GL_CW);
-
-    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
-    m_program->bind();
-
-    //绑定纹理
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_texture1->textureId());
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_texture2->textureId());
-    m_program->setUniformValue("texture1", 0);
-    m_program->setUniformValue("texture2", 1);
-
-    m_camera = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    m_renderer.setCamera(cameraPos, cameraFront, cameraUp);
+    m_renderer.render(m_scheduler->takeDirty());
+    //变体在后台编译, 编译完的那一帧才会换上
+    if(m_renderer.shadersPending())
+        m_scheduler->scheduleFrame(FrameScheduler::Scene);
+
+    if(m_showOverlay)
+        drawProfilerOverlay();
+}
 
-    glUniformMatrix4fv(m_cameraLoc, 1, GL_FALSE, glm::value_ptr(m_camera));
+//左上角显示最近一帧GPU结果已经回来的各段耗时(ms), 按层级缩进
+void GLWidget::drawProfilerOverlay()
+{
+    const FrameProfiler::Frame *frame = m_renderer.profiler().lastResolvedFrame();
+    if(frame == nullptr)
+        return;
 
-    glUniformMatrix4fv(m_projLoc, 1, GL_FALSE, glm::value_ptr(m_proj));
+    QPainter painter(this);
+    painter.setPen(Qt::white);
+    painter.setFont(QFont("monospace", 9));
 
-    for(int i=0; i < 10; ++i)
+    int y = 16;
+    for(const FrameProfiler::Scope &scope : frame->scopes)
     {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, cubePositions[i]);
-
-        float angle = 20.0f * i;
-        model = glm::rotate(model,  glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-        glUniformMatrix4fv(m_modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        const QString line = QString("%1%2  cpu %3  gpu %4")
+                .arg(QString(scope.depth * 2, ' '))
+                .arg(QString::fromLatin1(scope.name), -16)
+                .arg((scope.cpuEnd - scope.cpuBegin) / 1e6, 7, 'f', 3)
+                .arg((scope.gpuEnd - scope.gpuBegin) / 1e6, 7, 'f', 3);
+        painter.drawText(8, y, line);
+        y += 14;
     }
-    //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    m_program->release();
 }
 
+//resize之后Qt一定会重绘, 这里只记下宽高比, 投影矩阵在paintGL里按需重新计算
 void GLWidget::resizeGL(int w, int h)
 {
-    m_proj = glm::mat4(1.0f);
-    m_proj = glm::perspective(glm::radians(45.0f), GLfloat(w) / h, 0.1f, 100.0f);
+    m_renderer.resize(w, h);
+    m_scheduler->markDirty(FrameScheduler::Projection);
 }
 
 //旋转,可以沿着X Y Z轴旋转
@@ -230,6 +121,18 @@ void GLWidget::mousePressEvent(QMouseEvent *event)
     m_lastPos = event->localPos();
 }
 
+//按下和松开的位置几乎不动算作点击, 选中鼠标下最近的立方体; 拖动仍然是转视角
+void GLWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if((event->localPos() - m_lastPos).manhattanLength() > 4.0)
+        return;
+
+    const glm::vec2 cursor(float(event->localPos().x()), float(height() - event->localPos().y()));
+    const int hit = m_renderer.pick(cursor, glm::vec4(0.0f, 0.0f, width(), height()));
+    m_renderer.setSelected(hit);
+    m_scheduler->requestFrame(FrameScheduler::Scene);
+}
+
 void GLWidget::mouseMoveEvent(QMouseEvent *event)
 {
     float xoffset = event->x() - m_lastPos.x();
@@ -254,7 +157,7 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
     front.z = sin(glm::radians(m_yaw)) * cos(glm::radians(m_pitch));
     cameraFront = glm::normalize(front);
 
-    update();
+    m_scheduler->requestFrame(FrameScheduler::Camera);
 }
 
 //前后移动
@@ -263,7 +166,7 @@ void GLWidget::wheelEvent(QWheelEvent *event)
     if(QApplication::keyboardModifiers () == Qt::ControlModifier)
     {
         event->delta() > 0  ? cameraPos += m_cameraSpeed * cameraFront : cameraPos -= m_cameraSpeed * cameraFront;
-        update();
+        m_scheduler->requestFrame(FrameScheduler::Camera);
     }
     else
     {
@@ -274,6 +177,7 @@ void GLWidget::wheelEvent(QWheelEvent *event)
 //上下左右控制
 void GLWidget::keyPressEvent(QKeyEvent *event)
 {
+    FrameScheduler::DirtyFlags dirty = FrameScheduler::Camera;
     switch (event->key()) {
     case Qt::Key_Up:
         cameraPos += m_cameraSpeed * cameraUp;
@@ -287,6 +191,69 @@ void GLWidget::keyPressEvent(QKeyEvent *event)
     case Qt::Key_Right:
         cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * m_cameraSpeed;
         break;
+    case Qt::Key_I:
+        m_renderer.setInstanced(!m_renderer.instanced());
+        qDebug() << "instanced:" << m_renderer.instanced();
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_B:
+        makeCurrent();
+        m_renderer.setCamera(cameraPos, cameraFront, cameraUp);
+        m_renderer.runInstanceBenchmark();
+        doneCurrent();
+        dirty = FrameScheduler::Camera | FrameScheduler::Projection | FrameScheduler::Scene;
+        break;
+    case Qt::Key_C:
+        //不剔除/逐个测试/BVH/GPU之间切换
+        m_renderer.setCullMode(SceneRenderer::CullMode((m_renderer.cullMode() + 1) % SceneRenderer::CullModeCount));
+        qDebug() << "culling:" << SceneRenderer::cullModeName(m_renderer.cullMode());
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_M:
+    {
+        //在无mipmap/三线性/各向异性之间切换
+        const int filter = (m_renderer.textureFilter() + 1) % 3;
+        m_renderer.setTextureFilter(SceneRenderer::TextureFilter(filter));
+        qDebug() << "texture filter:" << filter;
+        dirty = FrameScheduler::Scene;
+        break;
+    }
+    case Qt::Key_L:
+        //不受光/Lambert, 新的变体编译好之前还是原来的样子
+        m_renderer.setShaderFeatures(m_renderer.shaderFeatures() ^ ShaderVariants::Lambert);
+        qDebug() << "shader features:" << ShaderVariants::featureNames(m_renderer.shaderFeatures());
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_X:
+        m_renderer.setShaderFeatures(m_renderer.shaderFeatures() ^ ShaderVariants::Textured);
+        qDebug() << "shader features:" << ShaderVariants::featureNames(m_renderer.shaderFeatures());
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_D:
+        //LOD0和按屏幕误差选的LOD对比
+        m_renderer.setLodEnabled(!m_renderer.lodEnabled());
+        qDebug() << "lod:" << m_renderer.lodEnabled();
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_P:
+        m_showOverlay = !m_showOverlay;
+        //overlay用的是已经出结果的旧帧, 打开后连续刷新才能看到变化
+        dirty = FrameScheduler::Scene;
+        break;
+    case Qt::Key_T:
+        if(m_renderer.profiler().writeChromeTrace("profile_trace.json"))
+            qDebug("profile trace written to profile_trace.json");
+        return;
+    case Qt::Key_F:
+        qDebug() << "events:" << eventsReceived() << "frames:" << framesRendered()
+                 << "visible:" << m_renderer.visibleCount() << "/" << m_renderer.instanceCount()
+                 << "cull ms:" << m_renderer.cullNsecs() / 1e6
+                 << "triangles:" << m_renderer.trianglesDrawn() << "/" << m_renderer.trianglesFullDetail();
+        return;
+    default:
+        //不处理的按键不触发重绘
+        QOpenGLWidget::keyPressEvent(event);
+        return;
     }
-    update();
+    m_scheduler->requestFrame(dirty);
 }
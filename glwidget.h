@@ -4,9 +4,6 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
 #include <QSharedDataPointer>
-#include <QOpenGLVertexArrayObject>
-#include <QOpenGLBuffer>
-#include <QOpenGLTexture>
 #include <QMatrix4x4>
 #include <QTimer>
 
@@ -16,9 +13,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-class GLWidgetData;
+#include "scenerenderer.h"
+#include "framescheduler.h"
 
-QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+class GLWidgetData;
 
 class GLWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
@@ -28,6 +26,16 @@ public:
     GLWidget(const GLWidget &);
     ~GLWidget();
 
+    //要在第一次显示(initializeGL)之前调用, 见SceneRenderer::setMeshFile
+    void setMeshFile(const QString &fileName) { m_renderer.setMeshFile(fileName); }
+    void setVertexFormat(const VertexFormat &format) { m_renderer.setVertexFormat(format); }
+    //开发模式, 从磁盘读shader并热重载, 见ShaderVariants::setSourceDirectory
+    void setShaderDirectory(const QString &directory) { m_renderer.setShaderDirectory(directory); }
+
+    //输入事件数和实际渲染帧数, 用来确认重绘是否被合并
+    qint64 eventsReceived() const { return m_scheduler->eventsReceived(); }
+    qint64 framesRendered() const { return m_scheduler->framesRendered(); }
+
 public slots:
     void cleanup();
 
@@ -39,16 +47,17 @@ protected:
     void wheelEvent(QWheelEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
 
 private:
+    void drawProfilerOverlay();
+
     QSharedDataPointer<GLWidgetData> data;
 
-    QOpenGLVertexArrayObject m_vao;
-    QOpenGLBuffer m_vbo;
-    QOpenGLBuffer m_ebo;
-    QOpenGLTexture *m_texture1, *m_texture2;
-    QOpenGLShaderProgram *m_program;
+    SceneRenderer m_renderer;
+    FrameScheduler *m_scheduler;
+    bool m_showOverlay;
 
     int t;
     QPointF m_lastPos;
@@ -56,10 +65,7 @@ private:
     float m_yaw;	// yaw is initialized to -90.0 degrees since a yaw of 0.0 results in a direction vector pointing to the right so we initially rotate a bit to the left.
     float m_pitch;
     float m_fov;
-    int m_modelLoc, m_cameraLoc, m_projLoc;
     glm::vec3 cameraPos, cameraFront, cameraUp;
-    glm::mat4 m_camera;
-    glm::mat4 m_proj;
     QMatrix4x4 m_world;
 };
 
@@ -0,0 +1,284 @@
+#include "gpuculler.h"
+#include "frustumculler.h"
+#include "programcache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QVector3D>
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDebug>
+
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+//shader里材质按uint读, 两个region号在低16位和高16位
+static_assert(sizeof(glm::u16vec2) == sizeof(GLuint), "material must pack into one uint");
+
+GpuCuller::GpuCuller()
+    : m_supported(false)
+    , m_count(0)
+    , m_levels(0)
+    , m_cullProgram(nullptr)
+    , m_compactProgram(nullptr)
+    , m_statsValid(false)
+    , m_multiDrawElementsIndirect(nullptr)
+{
+    for(int i=0; i < BufferCount; ++i)
+        m_buffers[i] = 0;
+    for(int l=0; l < MaxMeshLods; ++l)
+        m_lodInstances[l] = 0;
+}
+
+GpuCuller::~GpuCuller()
+{
+}
+
+bool GpuCuller::create()
+{
+    m_supported = false;
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    if(ctx == nullptr)
+        return false;
+    initializeOpenGLFunctions();
+
+    //glMultiDrawElementsIndirect不在QOpenGLExtraFunctions里(ES没有), 单独取
+    if(ctx->isOpenGLES() || ctx->format().version() < qMakePair(4, 3))
+    {
+        qDebug("GPU culling needs OpenGL 4.3, context is %d.%d", ctx->format().majorVersion(), ctx->format().minorVersion());
+        return false;
+    }
+    m_multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirect>(ctx->getProcAddress("glMultiDrawElementsIndirect"));
+    m_cullProgram = buildPass(0);
+    m_compactProgram = buildPass(1);
+    if(!m_multiDrawElementsIndirect || !m_cullProgram || !m_compactProgram)
+    {
+        destroy();
+        return false;
+    }
+
+    glGenBuffers(BufferCount, m_buffers);
+    const DrawCommand commands[MaxMeshLods] = {};
+    upload(CommandBuffer, commands, sizeof(commands), true);
+    upload(StatsBuffer, commands, sizeof(commands), true);
+    setInstances(nullptr, nullptr, 0);
+    m_supported = true;
+    return true;
+}
+
+void GpuCuller::destroy()
+{
+    delete m_cullProgram;
+    delete m_compactProgram;
+    m_cullProgram = m_compactProgram = nullptr;
+    if(m_buffers[0])
+        glDeleteBuffers(BufferCount, m_buffers);
+    for(int i=0; i < BufferCount; ++i)
+        m_buffers[i] = 0;
+    m_supported = false;
+    m_statsValid = false;
+    m_count = 0;
+}
+
+QOpenGLShaderProgram *GpuCuller::buildPass(int pass)
+{
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+    const QByteArray source = ProgramCache::source(QStringLiteral(":/cullShaderSource.comp"),
+                                                   "#define PASS " + QByteArray::number(pass) + "\n");
+    if(!program->addShaderFromSourceCode(QOpenGLShader::Compute, source) || !program->link())
+    {
+        qWarning() << "GPU culling: compute pass" << pass << "failed:" << program->log();
+        delete program;
+        return nullptr;
+    }
+    return program;
+}
+
+//上传都走GL_COPY_WRITE_BUFFER, 不改变GL_ARRAY_BUFFER和VAO里的绑定
+void GpuCuller::upload(Buffer buffer, const void *data, GLsizeiptr bytes, bool resize)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffers[buffer]);
+    if(resize)
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+    else
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+//实例数为0时也分配一个元素, 空的缓冲不能绑成SSBO
+void GpuCuller::setInstances(const glm::vec4 *spheres, const glm::u16vec2 *materials, int count)
+{
+    m_count = count;
+    const GLsizeiptr capacity = qMax(count, 1);
+    upload(SphereBuffer, count ? spheres : nullptr, capacity * sizeof(glm::vec4), true);
+    upload(MaterialBuffer, count ? materials : nullptr, capacity * sizeof(glm::u16vec2), true);
+    upload(ModelBuffer, nullptr, capacity * sizeof(glm::mat4), true);
+    upload(OutModelBuffer, nullptr, capacity * sizeof(glm::mat4), true);
+    upload(OutMaterialBuffer, nullptr, capacity * sizeof(glm::u16vec2), true);
+    upload(OutInstanceBuffer, nullptr, capacity * sizeof(GLuint), true);
+    const std::vector<GLuint> states(capacity, 0);
+    upload(StateBuffer, states.data(), capacity * sizeof(GLuint), true);
+}
+
+void GpuCuller::setModels(const glm::mat4 *models, int count)
+{
+    Q_ASSERT(count == m_count);
+    if(count > 0)
+        upload(ModelBuffer, models, GLsizeiptr(count) * sizeof(glm::mat4), false);
+}
+
+void GpuCuller::resetLods()
+{
+    const std::vector<GLuint> states(qMax(m_count, 1), 0);
+    upload(StateBuffer, states.data(), GLsizeiptr(states.size()) * sizeof(GLuint), false);
+}
+
+void GpuCuller::readCommands(Buffer buffer, DrawCommand commands[MaxMeshLods])
+{
+    const GLsizeiptr bytes = sizeof(DrawCommand) * MaxMeshLods;
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[buffer]);
+    const void *mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if(mapped)
+    {
+        memcpy(commands, mapped, bytes);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+    else
+    {
+        memset(commands, 0, bytes);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GpuCuller::dispatch(const std::vector<MeshLod> &lods, const Parameters &parameters)
+{
+    //上一帧拷出来的计数这时GPU早已写完
+    if(m_statsValid)
+    {
+        DrawCommand stats[MaxMeshLods];
+        readCommands(StatsBuffer, stats);
+        for(int l=0; l < MaxMeshLods; ++l)
+            m_lodInstances[l] = int(stats[l].instanceCount);
+    }
+
+    //每帧从实例数为0的命令开始, 没有的级别索引数也是0
+    DrawCommand commands[MaxMeshLods] = {};
+    float errors[MaxMeshLods] = {};
+    m_levels = qMin(int(lods.size()), int(MaxMeshLods));
+    for(int l=0; l < m_levels; ++l)
+    {
+        commands[l].count = lods[l].indexCount;
+        commands[l].firstIndex = lods[l].firstIndex;
+        errors[l] = lods[l].error;
+    }
+    upload(CommandBuffer, commands, sizeof(commands), false);
+    for(int b=0; b < StorageBufferCount; ++b)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, m_buffers[b]);
+
+    glm::vec4 planes[6];
+    FrustumCuller::extractPlanes(parameters.viewProjection, planes);
+    const GLuint groups = GLuint(m_count + GroupSize - 1) / GroupSize;
+    m_cullProgram->bind();
+    m_cullProgram->setUniformValue("instanceCount", GLuint(m_count));
+    glUniform4fv(m_cullProgram->uniformLocation("planes"), 6, &planes[0].x);
+    m_cullProgram->setUniformValue("cameraPos", QVector3D(parameters.cameraPos.x, parameters.cameraPos.y, parameters.cameraPos.z));
+    m_cullProgram->setUniformValue("pixelsPerUnit", parameters.pixelsPerUnit);
+    m_cullProgram->setUniformValue("lodThreshold", parameters.lodThreshold);
+    m_cullProgram->setUniformValue("lodCoarsen", parameters.lodThreshold * (1.0f - parameters.lodHysteresis));
+    m_cullProgram->setUniformValue("levels", GLuint(parameters.lodEnabled ? m_levels : 1));
+    glUniform1fv(m_cullProgram->uniformLocation("lodErrors"), MaxMeshLods, errors);
+    if(groups > 0)
+        glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    //没有实例也要跑一个组, 由第0个调用写baseInstance
+    m_compactProgram->bind();
+    m_compactProgram->setUniformValue("instanceCount", GLuint(m_count));
+    glDispatchCompute(qMax(groups, 1u), 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    m_compactProgram->release();
+
+    //计数拷到另一个缓冲, 下一帧再读
+    glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[CommandBuffer]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffers[StatsBuffer]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(commands));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_statsValid = true;
+}
+
+void GpuCuller::draw(GLenum indexType)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffers[OutModelBuffer]);
+    for(int i=0; i < 4; ++i)
+    {
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffers[OutMaterialBuffer]);
+    glVertexAttribIPointer(6, 2, GL_UNSIGNED_SHORT, sizeof(glm::u16vec2), (void*)0);
+    //命令里的baseInstance让每级从输出缓冲里自己那一段开始读实例属性
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_buffers[CommandBuffer]);
+    m_multiDrawElementsIndirect(GL_TRIANGLES, indexType, nullptr, m_levels, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+int GpuCuller::visibleCount() const
+{
+    int visible = 0;
+    for(int l=0; l < MaxMeshLods; ++l)
+        visible += m_lodInstances[l];
+    return visible;
+}
+
+void GpuCuller::readBack(std::vector<unsigned> &visible, std::vector<unsigned char> &lods)
+{
+    DrawCommand commands[MaxMeshLods];
+    readCommands(CommandBuffer, commands);
+    int total = 0;
+    for(int l=0; l < MaxMeshLods; ++l)
+        total += int(commands[l].instanceCount);
+
+    visible.resize(total);
+    lods.assign(m_count, 0);
+    if(total > 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[OutInstanceBuffer]);
+        const void *mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, GLsizeiptr(total) * sizeof(GLuint), GL_MAP_READ_BIT);
+        if(mapped)
+        {
+            memcpy(visible.data(), mapped, size_t(total) * sizeof(GLuint));
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+    if(m_count > 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[StateBuffer]);
+        const GLuint *states = static_cast<const GLuint *>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, GLsizeiptr(m_count) * sizeof(GLuint), GL_MAP_READ_BIT));
+        if(states)
+        {
+            for(int i=0; i < m_count; ++i)
+                lods[i] = static_cast<unsigned char>(states[i] & 0xFFu);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
@@ -0,0 +1,92 @@
+#ifndef GPUCULLER_H
+#define GPUCULLER_H
+
+#include <QOpenGLExtraFunctions>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "meshbuilder.h"
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+
+//GPU驱动的实例化绘制, 要求GL 4.3(compute shader, SSBO, glMultiDrawElementsIndirect).
+//实例的包围球/材质/世界矩阵放在SSBO里, 每帧两次dispatch: 第一次对每个实例测视锥并按投影误差选LOD
+//(和SceneRenderer::selectLods同样的规则, 每个实例当前的级别留在GPU上), 可见的实例在自己那一级的
+//间接绘制命令上原子加一; 第二次按各级的个数把矩阵和材质压紧写进输出缓冲, 并填好每条命令的baseInstance.
+//绘制时实例属性指向输出缓冲, 所有级别一次glMultiDrawElementsIndirect, CPU不读回可见性.
+class GpuCuller : protected QOpenGLExtraFunctions
+{
+public:
+    struct Parameters
+    {
+        glm::mat4 viewProjection;
+        glm::vec3 cameraPos;
+        float pixelsPerUnit = 1.0f;     //距离为1处每单位长度的像素数
+        bool lodEnabled = true;         //关掉时都画LOD0
+        float lodThreshold = 1.0f;      //像素
+        float lodHysteresis = 0.0f;
+    };
+
+    GpuCuller();
+    ~GpuCuller();
+
+    //需要当前有GL context; 版本不够或者compute shader编译失败时返回false, 调用方走CPU剔除
+    bool create();
+    void destroy();
+    bool isSupported() const { return m_supported; }
+
+    //重建场景时调用, spheres是(中心, 半径); 所有实例的LOD回到0
+    void setInstances(const glm::vec4 *spheres, const glm::u16vec2 *materials, int count);
+    //世界矩阵变了时整段重新上传
+    void setModels(const glm::mat4 *models, int count);
+    void resetLods();
+    int count() const { return m_count; }
+
+    //剔除并选LOD, 写好间接绘制命令和压紧的实例数据; 会改变当前的program
+    void dispatch(const std::vector<MeshLod> &lods, const Parameters &parameters);
+    //实例属性2~6指向输出缓冲(要求VAO已绑定), 一次画完所有级别
+    void draw(GLenum indexType);
+
+    //上一次dispatch之前那一帧每级画的实例数, 从GPU拷出来晚一帧读, 不会等当前帧
+    const int *lodInstances() const { return m_lodInstances; }
+    int visibleCount() const;
+    //等GPU做完当前帧, 读回可见实例(升序)和每个实例的LOD, 和CPU剔除对比用
+    void readBack(std::vector<unsigned> &visible, std::vector<unsigned char> &lods);
+
+private:
+    //SSBO的下标就是shader里的binding
+    enum Buffer { SphereBuffer, MaterialBuffer, ModelBuffer, StateBuffer, CommandBuffer,
+                  OutModelBuffer, OutMaterialBuffer, OutInstanceBuffer, StatsBuffer, BufferCount };
+    enum { StorageBufferCount = StatsBuffer, GroupSize = 64 };
+
+    //和DrawElementsIndirectCommand一一对应
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLuint baseVertex;
+        GLuint baseInstance;
+    };
+
+    QOpenGLShaderProgram *buildPass(int pass);
+    void upload(Buffer buffer, const void *data, GLsizeiptr bytes, bool resize);
+    void readCommands(Buffer buffer, DrawCommand commands[MaxMeshLods]);
+
+    bool m_supported;
+    int m_count;
+    int m_levels;
+    GLuint m_buffers[BufferCount];
+    QOpenGLShaderProgram *m_cullProgram;
+    QOpenGLShaderProgram *m_compactProgram;
+    bool m_statsValid;
+    int m_lodInstances[MaxMeshLods];
+
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void *indirect, GLsizei drawCount, GLsizei stride);
+    MultiDrawElementsIndirect m_multiDrawElementsIndirect;
+};
+
+#endif // GPUCULLER_H
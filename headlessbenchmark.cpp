@@ -0,0 +1,1137 @@
+#include "headlessbenchmark.h"
+#include "scenerenderer.h"
+#include "meshimporter.h"
+#include "meshfile.h"
+#include "programcache.h"
+#include "scenegraph.h"
+#include "entitystore.h"
+#include "jobsystem.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/intersect.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+#include <QTemporaryDir>
+#include <QCoreApplication>
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <atomic>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <QDebug>
+
+HeadlessBenchmark::HeadlessBenchmark(const Options &options)
+    : m_options(options)
+{
+}
+
+//按最近秩取百分位, frameTimes已经排好序
+static double percentile(const std::vector<double> &frameTimes, double p)
+{
+    if(frameTimes.empty())
+        return 0.0;
+    size_t index = size_t(p * (frameTimes.size() - 1) + 0.5);
+    return frameTimes[std::min(index, frameTimes.size() - 1)];
+}
+
+//渲染frames帧, 每帧glFinish后计时, 返回排好序的帧时间(ms)
+//cullMs不为空时摄像机每帧都当作移动过, 累加每帧视锥剔除的CPU时间
+static std::vector<double> measureFrames(SceneRenderer &renderer, int frames, double *cullMs = nullptr)
+{
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    std::vector<double> frameTimes;
+    frameTimes.reserve(frames);
+    QElapsedTimer timer;
+    for(int i=0; i < frames; ++i)
+    {
+        timer.start();
+        renderer.render(cullMs ? FrameScheduler::Camera : FrameScheduler::DirtyFlags());
+        f->glFinish();
+        frameTimes.push_back(timer.nsecsElapsed() / 1e6);
+        if(cullMs)
+            *cullMs += renderer.cullNsecs() / 1e6;
+    }
+    std::sort(frameTimes.begin(), frameTimes.end());
+    return frameTimes;
+}
+
+//摄像机往后退, 立方体在屏幕上越来越小, 纹理缩小得越厉害;
+//软件光栅下帧时间基本由采样时读的纹素数决定, 用来比较无mipmap/三线性/各向异性在远处的带宽开销
+QJsonArray HeadlessBenchmark::filterSweep(SceneRenderer &renderer)
+{
+    const char *names[] = { "bilinear", "trilinear", "anisotropic" };
+    const float distances[] = { 3.0f, 15.0f, 40.0f, 80.0f };
+    const SceneRenderer::TextureFilter filter = renderer.textureFilter();
+
+    QJsonArray results;
+    for(int mode=0; mode < 3; ++mode)
+    {
+        renderer.setTextureFilter(SceneRenderer::TextureFilter(mode));
+        for(float distance : distances)
+        {
+            renderer.setCamera(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            renderer.render(FrameScheduler::Camera);
+            const std::vector<double> frameTimes = measureFrames(renderer, qMax(1, m_options.frames / 10));
+
+            QJsonObject entry;
+            entry["filter"] = names[mode];
+            entry["distance"] = distance;
+            entry["medianMs"] = percentile(frameTimes, 0.5);
+            results.append(entry);
+        }
+    }
+
+    renderer.setTextureFilter(filter);
+    return results;
+}
+
+//单位立方体(包围球半径sqrt(3)/2)均匀分布, 范围随个数增大保持密度不变;
+//每种规模测建树, 抖动后refit, 100个视角的视锥查询(和逐个SIMD测试对比), 1000次范围查询和1万条射线
+QJsonArray HeadlessBenchmark::bvhSweep()
+{
+    const int sizes[] = { 100000, 1000000, 10000000 };
+    const float radius = 0.8660254f;
+
+    QJsonArray results;
+    for(int count : sizes)
+    {
+        std::mt19937 rng(1234);
+        const float extent = 2.0f * std::cbrt(float(count));
+        std::uniform_real_distribution<float> position(-extent, extent);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        std::vector<glm::vec3> centers(count);
+        std::vector<Aabb> bounds(count);
+        FrustumCuller culler;
+        culler.resize(count);
+        for(int i=0; i < count; ++i)
+        {
+            centers[i] = glm::vec3(position(rng), position(rng), position(rng));
+            bounds[i].min = centers[i] - glm::vec3(radius);
+            bounds[i].max = centers[i] + glm::vec3(radius);
+            culler.setSphere(i, centers[i], radius);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        Bvh bvh;
+        bvh.build(bounds);
+        const double buildMs = timer.nsecsElapsed() / 1e6;
+
+        for(int i=0; i < count; ++i)
+        {
+            const glm::vec3 offset(unit(rng) * 0.1f, unit(rng) * 0.1f, unit(rng) * 0.1f);
+            bounds[i].min += offset;
+            bounds[i].max += offset;
+        }
+        timer.start();
+        bvh.refit(bounds);
+        const double refitMs = timer.nsecsElapsed() / 1e6;
+
+        //摄像机在中心绕一圈, 远平面100
+        const int views = 100;
+        const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+        std::vector<unsigned> visible;
+        qint64 bvhNsecs = 0, flatNsecs = 0;
+        size_t visibleTotal = 0;
+        for(int v=0; v < views; ++v)
+        {
+            const float angle = glm::two_pi<float>() * v / views;
+            const glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(std::sin(angle), 0.0f, -std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::vec4 planes[6];
+            FrustumCuller::extractPlanes(viewProjection, planes);
+
+            timer.start();
+            bvh.queryFrustum(planes, visible);
+            bvhNsecs += timer.nsecsElapsed();
+            visibleTotal += visible.size();
+
+            timer.start();
+            culler.setViewProjection(viewProjection);
+            culler.cull(visible);
+            flatNsecs += timer.nsecsElapsed();
+        }
+
+        const int boxes = 1000;
+        timer.start();
+        for(int b=0; b < boxes; ++b)
+        {
+            const glm::vec3 center(position(rng), position(rng), position(rng));
+            bvh.queryBox(center - glm::vec3(5.0f), center + glm::vec3(5.0f), visible);
+        }
+        const double boxNsecs = double(timer.nsecsElapsed());
+
+        const int rays = 10000;
+        int hits = 0;
+        timer.start();
+        for(int r=0; r < rays; ++r)
+        {
+            const glm::vec3 origin(position(rng), position(rng), position(rng));
+            const glm::vec3 dir = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-4f));
+            float distance = std::numeric_limits<float>::max();
+            const int hit = bvh.raycast(origin, dir, [&](unsigned prim, float &closest) {
+                float t;
+                if(glm::intersectRaySphere(origin, dir, centers[prim], radius * radius, t) && t < closest)
+                {
+                    closest = t;
+                    return true;
+                }
+                return false;
+            }, distance);
+            if(hit >= 0)
+                ++hits;
+        }
+        const double rayNsecs = double(timer.nsecsElapsed());
+
+        QJsonObject entry;
+        entry["primitives"] = count;
+        entry["nodes"] = bvh.nodeCount();
+        entry["buildMs"] = buildMs;
+        entry["refitMs"] = refitMs;
+        entry["visiblePerView"] = double(visibleTotal) / views;
+        entry["bvhFrustumMs"] = bvhNsecs / 1e6 / views;
+        entry["flatFrustumMs"] = flatNsecs / 1e6 / views;
+        entry["boxQueriesPerSec"] = boxes / (boxNsecs / 1e9);
+        entry["raysPerSec"] = rays / (rayNsecs / 1e9);
+        entry["rayHits"] = hits;
+        results.append(entry);
+        qDebug().noquote() << QJsonDocument(entry).toJson(QJsonDocument::Compact);
+    }
+    return results;
+}
+
+//在当前场景上随机点m_options.picks次, 和GLWidget点击时走同一个SceneRenderer::pick;
+//BVH的构建时间单独统计, 不算进单次拾取的延迟
+QJsonObject HeadlessBenchmark::pickLatency(SceneRenderer &renderer)
+{
+    QElapsedTimer timer;
+    timer.start();
+    renderer.sceneIndex();
+    const double indexMs = timer.nsecsElapsed() / 1e6;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> x(0.0f, float(m_options.size.width()));
+    std::uniform_real_distribution<float> y(0.0f, float(m_options.size.height()));
+    const glm::vec4 viewport(0.0f, 0.0f, m_options.size.width(), m_options.size.height());
+
+    std::vector<double> latencies;
+    latencies.reserve(m_options.picks);
+    int hits = 0;
+    for(int i=0; i < m_options.picks; ++i)
+    {
+        const glm::vec2 cursor(x(rng), y(rng));
+        timer.start();
+        const int hit = renderer.pick(cursor, viewport);
+        latencies.push_back(timer.nsecsElapsed() / 1e6);
+        if(hit >= 0)
+            ++hits;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    QJsonObject json;
+    json["picks"] = m_options.picks;
+    json["hits"] = hits;
+    json["indexBuildMs"] = indexMs;
+    json["medianMs"] = percentile(latencies, 0.5);
+    json["p99Ms"] = percentile(latencies, 0.99);
+    json["maxMs"] = latencies.empty() ? 0.0 : latencies.back();
+    return json;
+}
+
+//10万个实例, 几个摄像机位置下分别用CPU(FlatCulling + selectLods)和compute shader剔除并选LOD, 按实例号对比结果.
+//两边的平面和距离公式相同, 只可能在正好贴着平面或LOD阈值的实例上因为浮点误差不同
+QJsonObject HeadlessBenchmark::gpuCullValidation(SceneRenderer &renderer)
+{
+    QJsonObject json;
+    json["supported"] = renderer.gpuCullingSupported();
+    if(!renderer.gpuCullingSupported())
+        return json;
+
+    const int instances = 100000;
+    const glm::vec3 positions[] = { glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 30.0f),
+                                    glm::vec3(30.0f, 5.0f, -20.0f), glm::vec3(0.0f, 0.0f, -120.0f) };
+    const glm::vec3 fronts[] = { glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                                 glm::normalize(glm::vec3(-1.0f, -0.1f, -0.5f)), glm::vec3(0.0f, 0.0f, 1.0f) };
+    renderer.setInstanceCount(instances);
+    QJsonArray views;
+    int mismatches = 0;
+    for(int v=0; v < 4; ++v)
+    {
+        renderer.setCamera(positions[v], fronts[v], glm::vec3(0.0f, 1.0f, 0.0f));
+        const SceneRenderer::GpuCullCheck check = renderer.validateGpuCulling();
+        QJsonObject entry;
+        entry["cameraZ"] = positions[v].z;
+        entry["cpuVisible"] = check.cpuVisible;
+        entry["gpuVisible"] = check.gpuVisible;
+        entry["missing"] = check.missing;
+        entry["extra"] = check.extra;
+        entry["lodMismatches"] = check.lodMismatches;
+        views.append(entry);
+        mismatches += check.missing + check.extra + check.lodMismatches;
+    }
+    if(mismatches > 0)
+        qWarning() << "headless: GPU culling differs from CPU culling on" << mismatches << "instances";
+
+    renderer.setCamera(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    renderer.setInstanceCount(m_options.instances);
+    json["instances"] = instances;
+    json["views"] = views;
+    json["mismatches"] = mismatches;
+    return json;
+}
+
+//和实体的组件一样的数据按实体放在一个结构体里, 对比用
+struct EntityRecord
+{
+    glm::vec3 position;
+    glm::quat rotation;
+    Aabb bounds;
+    glm::u16vec2 material;
+    quint16 mesh;
+    quint32 instance;
+};
+
+//100万个实体分别放在EntityStore和一个EntityRecord数组里, 跑两种遍历: bounds从位置算包围盒(读12字节写24字节),
+//materials把材质加起来(只读4字节). 每种单线程和多线程各测一遍, 输出每个实体的纳秒数.
+//churn是随机删掉10%的实体再建回来, 每次增删的平均纳秒数
+QJsonObject HeadlessBenchmark::entityBenchmark(JobSystem &jobs)
+{
+    const int count = 1000000;
+    const int repeats = 10;
+    const int grain = 16384;
+    const float radius = 0.866f;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    const int components = PositionComponent | RotationComponent | BoundsComponent | MaterialComponent | MeshComponent | InstanceComponent;
+    EntityStore store;
+    std::vector<Entity> entities(count);
+    std::vector<EntityRecord> records(count);
+    for(int i=0; i < count; ++i)
+    {
+        EntityRecord &record = records[i];
+        record.position = glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f;
+        record.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        record.bounds = Aabb();
+        record.material = glm::u16vec2(i % 2, 2);
+        record.mesh = 0;
+        record.instance = quint32(i);
+
+        entities[i] = store.create(components);
+        *store.get<PositionComponent>(entities[i]) = record.position;
+        *store.get<RotationComponent>(entities[i]) = record.rotation;
+        *store.get<MaterialComponent>(entities[i]) = record.material;
+        *store.get<InstanceComponent>(entities[i]) = record.instance;
+    }
+
+    auto boundsSoa = [&](EntityStore::Chunk &chunk) {
+        const glm::vec3 *positions = chunk.get<PositionComponent>();
+        Aabb *bounds = chunk.get<BoundsComponent>();
+        for(int k=0; k < chunk.count(); ++k)
+        {
+            bounds[k].min = positions[k] - glm::vec3(radius);
+            bounds[k].max = positions[k] + glm::vec3(radius);
+        }
+    };
+    auto boundsAos = [&](int begin, int end) {
+        for(int i=begin; i < end; ++i)
+        {
+            records[i].bounds.min = records[i].position - glm::vec3(radius);
+            records[i].bounds.max = records[i].position + glm::vec3(radius);
+        }
+    };
+    std::atomic<qint64> materialSum(0);
+    auto materialsSoa = [&](EntityStore::Chunk &chunk) {
+        const glm::u16vec2 *materials = chunk.get<MaterialComponent>();
+        qint64 sum = 0;
+        for(int k=0; k < chunk.count(); ++k)
+            sum += materials[k].x + materials[k].y;
+        materialSum += sum;
+    };
+    auto materialsAos = [&](int begin, int end) {
+        qint64 sum = 0;
+        for(int i=begin; i < end; ++i)
+            sum += records[i].material.x + records[i].material.y;
+        materialSum += sum;
+    };
+
+    //返回每个实体的纳秒数的中位数
+    auto measure = [&](const std::function<void()> &body) {
+        std::vector<double> times;
+        body();
+        for(int k=0; k < repeats; ++k)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            body();
+            times.push_back(double(timer.nsecsElapsed()) / count);
+        }
+        std::sort(times.begin(), times.end());
+        return percentile(times, 0.5);
+    };
+
+    QJsonArray workloads;
+    const char *names[] = { "bounds", "materials" };
+    for(int w=0; w < 2; ++w)
+    {
+        const int required = w == 0 ? PositionComponent | BoundsComponent : int(MaterialComponent);
+        const std::function<void(EntityStore::Chunk &)> soa = w == 0 ? std::function<void(EntityStore::Chunk &)>(boundsSoa) : materialsSoa;
+        const std::function<void(int, int)> aos = w == 0 ? std::function<void(int, int)>(boundsAos) : materialsAos;
+        QJsonObject entry;
+        entry["name"] = names[w];
+        entry["chunksNsPerEntity"] = measure([&]() { store.forEach(required, nullptr, soa); });
+        entry["chunksThreadedNsPerEntity"] = measure([&]() { store.forEach(required, &jobs, soa); });
+        entry["structsNsPerEntity"] = measure([&]() { aos(0, count); });
+        entry["structsThreadedNsPerEntity"] = measure([&]() { jobs.parallelFor(count, grain, aos); });
+        workloads.append(entry);
+    }
+
+    //随机删掉10%再建回来, 建回来的实体补上位置, 不影响下一轮
+    const int churn = count / 10;
+    std::vector<double> destroyTimes, createTimes;
+    for(int k=0; k < repeats; ++k)
+    {
+        std::vector<int> victims(churn);
+        for(int &victim : victims)
+            victim = int(rng() % unsigned(count));
+        std::sort(victims.begin(), victims.end());
+        victims.erase(std::unique(victims.begin(), victims.end()), victims.end());
+
+        QElapsedTimer timer;
+        timer.start();
+        for(int victim : victims)
+            store.destroy(entities[victim]);
+        destroyTimes.push_back(double(timer.nsecsElapsed()) / victims.size());
+        timer.start();
+        for(int victim : victims)
+            entities[victim] = store.create(components);
+        createTimes.push_back(double(timer.nsecsElapsed()) / victims.size());
+        for(int victim : victims)
+            *store.get<PositionComponent>(entities[victim]) = records[victim].position;
+    }
+    std::sort(destroyTimes.begin(), destroyTimes.end());
+    std::sort(createTimes.begin(), createTimes.end());
+
+    std::vector<EntityStore::Chunk *> chunks;
+    store.chunks(components, chunks);
+    QJsonObject json;
+    json["entities"] = store.count();
+    json["chunks"] = int(chunks.size());
+    json["chunkCapacity"] = chunks.empty() ? 0 : chunks.front()->capacity();
+    json["recordBytes"] = int(sizeof(EntityRecord));
+    json["threads"] = jobs.threadCount();
+    json["workloads"] = workloads;
+    json["destroyNs"] = percentile(destroyTimes, 0.5);
+    json["createNs"] = percentile(createTimes, 0.5);
+    return json;
+}
+
+//100万个节点的变换层次: 1000个根, 每个根9个子节点, 每个子节点110个叶子, 按深度优先加进去再排序.
+//分别让0%, 1%和100%的节点换一个旋转, 只计update的时间(多线程和单线程各测一遍);
+//rebuildMs是原来的做法: 每帧对每个节点都用glm::translate/rotate从头建矩阵
+QJsonObject HeadlessBenchmark::sceneGraphBenchmark(JobSystem &jobs)
+{
+    const int roots = 1000, arms = 9, leaves = 110;
+    const int repeats = 10;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto randomRotation = [&]() {
+        return glm::angleAxis(unit(rng) * glm::pi<float>(), glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f)));
+    };
+
+    SceneGraph graph;
+    for(int r=0; r < roots; ++r)
+    {
+        const int root = graph.addNode(SceneGraph::NoParent, glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f, randomRotation());
+        for(int a=0; a < arms; ++a)
+        {
+            const int arm = graph.addNode(root, glm::vec3(unit(rng), unit(rng), unit(rng)) * 5.0f, randomRotation());
+            for(int l=0; l < leaves; ++l)
+                graph.addNode(arm, glm::vec3(unit(rng), unit(rng), unit(rng)), randomRotation(), glm::vec3(0.5f));
+        }
+    }
+    QElapsedTimer timer;
+    timer.start();
+    graph.sortByDepth();
+    const double sortMs = timer.nsecsElapsed() / 1e6;
+    graph.update(&jobs);
+    const int count = graph.count();
+
+    //原来的做法, 单线程
+    std::vector<glm::mat4> rebuilt(count);
+    std::vector<double> rebuildTimes;
+    for(int k=0; k < repeats; ++k)
+    {
+        timer.start();
+        for(int i=0; i < count; ++i)
+        {
+            const glm::quat &q = graph.rotation(i);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), graph.translation(i));
+            model = glm::rotate(model, glm::angle(q), glm::axis(q));
+            model = glm::scale(model, graph.scale(i));
+            const int parent = graph.parent(i);
+            rebuilt[i] = parent == SceneGraph::NoParent ? model : rebuilt[parent] * model;
+        }
+        rebuildTimes.push_back(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(rebuildTimes.begin(), rebuildTimes.end());
+
+    const double fractions[] = { 0.0, 0.01, 1.0 };
+    QJsonArray updates;
+    for(double fraction : fractions)
+    {
+        const int moved = int(count * fraction);
+        std::vector<double> times[2];
+        SceneGraph::Stats stats;
+        for(int threaded=0; threaded < 2; ++threaded)
+        {
+            for(int k=0; k < repeats; ++k)
+            {
+                for(int m=0; m < moved; ++m)
+                    graph.setRotation(moved == count ? m : int(rng() % unsigned(count)), randomRotation());
+                graph.update(threaded ? &jobs : nullptr);
+                times[threaded].push_back(graph.stats().nsecs / 1e6);
+                stats = graph.stats();
+            }
+            std::sort(times[threaded].begin(), times[threaded].end());
+        }
+
+        QJsonObject entry;
+        entry["movedFraction"] = fraction;
+        entry["movedNodes"] = moved;
+        entry["dirtyNodes"] = stats.dirtyNodes;
+        entry["updatedMatrices"] = stats.updated;
+        entry["fullUpdate"] = stats.full;
+        entry["medianMs"] = percentile(times[1], 0.5);
+        entry["singleThreadMs"] = percentile(times[0], 0.5);
+        updates.append(entry);
+    }
+
+    QJsonObject json;
+    json["nodes"] = count;
+    json["depth"] = graph.depthCount();
+    json["path"] = SceneGraph::path();
+    json["threads"] = jobs.threadCount();
+    json["sortMs"] = sortMs;
+    json["rebuildMs"] = percentile(rebuildTimes, 0.5);
+    json["updates"] = updates;
+    return json;
+}
+
+//帧准备分别用1, 2, 4...到CPU核数个线程; 每帧推进动画并强制重新剔除, 动画/剔除/建队列每帧都要完整做一遍
+QJsonArray HeadlessBenchmark::jobScaling(SceneRenderer &renderer)
+{
+    const int previous = renderer.threadCount();
+    const int ideal = qMax(1, QThread::idealThreadCount());
+    std::vector<int> counts;
+    for(int threads=1; threads < ideal; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(ideal);
+    const int frames = qMax(1, m_options.frames / 4);
+
+    QJsonArray results;
+    double single = 0.0;
+    for(int threads : counts)
+    {
+        renderer.setThreadCount(threads);
+        renderer.jobs().resetStats();
+        std::vector<double> prepareTimes;
+        for(int f=0; f < frames; ++f)
+        {
+            renderer.setAnimationTime(f / 60.0f);
+            renderer.render(FrameScheduler::Camera);
+            prepareTimes.push_back(renderer.prepareNsecs() / 1e6);
+        }
+        QOpenGLContext::currentContext()->functions()->glFinish();
+        std::sort(prepareTimes.begin(), prepareTimes.end());
+
+        const double median = percentile(prepareTimes, 0.5);
+        if(threads == 1)
+            single = median;
+        const JobSystem::Stats stats = renderer.jobs().stats();
+        QJsonObject entry;
+        entry["threads"] = threads;
+        entry["prepareMedianMs"] = median;
+        entry["prepareP99Ms"] = percentile(prepareTimes, 0.99);
+        entry["speedup"] = median > 0.0 ? single / median : 0.0;
+        entry["jobsPerFrame"] = double(stats.jobs) / frames;
+        entry["stealsPerFrame"] = double(stats.steals) / frames;
+        results.append(entry);
+    }
+
+    renderer.setThreadCount(previous);
+    renderer.setAnimationTime(0.0f);
+    return results;
+}
+
+//同一个场景换几种顶点编码重新上传再画; 软件光栅下顶点取数和解码都在CPU上, 顶点多的模型(--mesh)才看得出差别.
+//.gmesh文件的编码是写入时定的, 这时每一项都一样
+QJsonArray HeadlessBenchmark::vertexFormatSweep(SceneRenderer &renderer)
+{
+    const char *formats[] = { "float", "half,unorm16,oct", "snorm16,unorm16,oct", "snorm16,unorm16,3x10" };
+    const VertexFormat previous = renderer.vertexFormat();
+
+    QJsonArray results;
+    for(const char *name : formats)
+    {
+        VertexFormat format;
+        VertexFormat::parse(QLatin1String(name), format);
+        renderer.setVertexFormat(format);
+        renderer.loadMesh(renderer.meshFile());
+        renderer.render(FrameScheduler::Camera);
+        const std::vector<double> frameTimes = measureFrames(renderer, qMax(1, m_options.frames / 4));
+
+        QJsonObject entry;
+        entry["format"] = format.name();
+        entry["vertexStride"] = renderer.meshVertexStride();
+        entry["vertexBytes"] = double(renderer.meshVertexBytes());
+        entry["medianMs"] = percentile(frameTimes, 0.5);
+        entry["p99Ms"] = percentile(frameTimes, 0.99);
+        results.append(entry);
+    }
+
+    renderer.setVertexFormat(previous);
+    renderer.loadMesh(renderer.meshFile());
+    return results;
+}
+
+//把文件从页缓存里踢出去, 下一次读一定要走磁盘; 其他平台上做不到, 冷加载实际上也是热的
+static bool evictFromPageCache(const QString &fileName)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    fdatasync(fd);
+    const bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return ok;
+#else
+    Q_UNUSED(fileName);
+    return false;
+#endif
+}
+
+//同一个模型三种加载方式, 时间都包括上传到GPU(glFinish):
+//text: 解析文本 + 焊接/重排 + 编码; cold: 页缓存清掉后映射.gmesh; warm: 再映射一次.gmesh
+QJsonObject HeadlessBenchmark::meshLoad(SceneRenderer &renderer)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    const QString source = m_options.meshLoadBenchmark;
+    const QString binary = QDir::temp().filePath(QFileInfo(source).completeBaseName() + QStringLiteral(".gmesh"));
+    const QString previous = renderer.meshFile();
+    QJsonObject json;
+
+    QElapsedTimer timer;
+    timer.start();
+    Mesh mesh;
+    QString error;
+    if(!MeshImporter::import(source, mesh, nullptr, &error))
+    {
+        qWarning() << "mesh load benchmark:" << source << error;
+        json["error"] = error;
+        return json;
+    }
+    const double importMs = timer.nsecsElapsed() / 1e6;
+    timer.start();
+    MeshFile::write(binary, mesh);
+    const double writeMs = timer.nsecsElapsed() / 1e6;
+
+    timer.start();
+    renderer.loadMesh(source);
+    gl->glFinish();
+    const double textMs = timer.nsecsElapsed() / 1e6;
+
+    const bool evicted = evictFromPageCache(binary);
+    timer.start();
+    renderer.loadMesh(binary);
+    gl->glFinish();
+    const double coldMs = timer.nsecsElapsed() / 1e6;
+
+    timer.start();
+    renderer.loadMesh(binary);
+    gl->glFinish();
+    const double warmMs = timer.nsecsElapsed() / 1e6;
+
+    renderer.loadMesh(previous);
+
+    json["source"] = source;
+    json["sourceBytes"] = double(QFileInfo(source).size());
+    json["gmeshBytes"] = double(QFileInfo(binary).size());
+    json["vertices"] = int(mesh.vertices.size());
+    json["triangles"] = int(mesh.lods[0].indexCount / 3);
+    json["lods"] = int(mesh.lods.size());
+    json["importMs"] = importMs;
+    json["writeMs"] = writeMs;
+    json["textLoadMs"] = textMs;
+    json["coldLoadMs"] = coldMs;
+    json["coldEvicted"] = evicted;
+    json["warmLoadMs"] = warmMs;
+    QFile::remove(binary);
+    return json;
+}
+
+//场景里的两个基础变体, 每种方式都在新的ProgramCache上建一遍(glFinish后计时):
+//uncached: 不用缓存直接编译链接; cold: 空的缓存目录, 编译链接后再取二进制写盘; warm: 同一个目录再建一次, 只加载二进制.
+//驱动自己也可能有着色器缓存(例如Mesa), uncached先跑, 所以cold和uncached里的编译多半已经被驱动缓存了
+QJsonObject HeadlessBenchmark::programCacheBenchmark()
+{
+    static const char *const programs[][2] = {
+        { ":/vertexShaderSource.vert", ":/fragmentShaderSource.frag" },
+        { ":/instanceShaderSource.vert", ":/arrayShaderSource.frag" },
+    };
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    auto build = [&](ProgramCache &cache) -> double {
+        QElapsedTimer timer;
+        timer.start();
+        for(const auto &program : programs)
+            delete cache.create(QString::fromLatin1(program[0]), QString::fromLatin1(program[1]), "#define TEXTURED\n");
+        gl->glFinish();
+        return timer.nsecsElapsed() / 1e6;
+    };
+
+    QJsonObject json;
+    ProgramCache uncached{QString()};
+    uncached.initialize();
+    json["supported"] = uncached.isSupported();
+    json["programs"] = int(sizeof(programs) / sizeof(programs[0]));
+    json["uncachedMs"] = build(uncached);
+
+    QTemporaryDir directory;
+    ProgramCache cache(directory.path());
+    cache.initialize();
+    json["coldMs"] = build(cache);
+    json["warmMs"] = build(cache);
+    json["hits"] = cache.stats().hits;
+    json["misses"] = cache.stats().misses;
+    json["rejected"] = cache.stats().rejected;
+    qint64 bytes = 0;
+    for(const QFileInfo &info : QDir(directory.path()).entryInfoList(QDir::Files))
+        bytes += info.size();
+    json["binaryBytes"] = double(bytes);
+    return json;
+}
+
+//依次换到几种还没编译过的特性组合, 每帧glFinish后计时, 直到变体编译完换上为止.
+//异步编译时这些帧照常用基础变体画, maxFrameMs应该和平时差不多; 同步编译时编译时间全落在第一帧上.
+//测的时候关掉二进制缓存, 否则第二次运行时变体直接从缓存加载
+QJsonArray HeadlessBenchmark::shaderVariantBenchmark(SceneRenderer &renderer)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    const int previous = renderer.shaderFeatures();
+    const QString directory = renderer.programCache().directory();
+    renderer.programCache().setDirectory(QString());
+
+    const int featureSets[] = { 0, ShaderVariants::Lambert, ShaderVariants::Textured | ShaderVariants::Lambert };
+    QJsonArray results;
+    for(int features : featureSets)
+    {
+        renderer.setShaderFeatures(features);
+        QElapsedTimer total;
+        total.start();
+        double maxMs = 0.0;
+        int frames = 0;
+        //至少画一帧, 让变体开始编译
+        do
+        {
+            QElapsedTimer timer;
+            timer.start();
+            renderer.render(FrameScheduler::Scene);
+            gl->glFinish();
+            maxMs = qMax(maxMs, timer.nsecsElapsed() / 1e6);
+            ++frames;
+        } while(renderer.shadersPending() && frames < 100000);
+
+        QJsonObject json;
+        json["features"] = ShaderVariants::featureNames(features);
+        json["framesUntilReady"] = frames;
+        json["readyMs"] = total.nsecsElapsed() / 1e6;
+        json["maxFrameMs"] = maxMs;
+        results.append(json);
+    }
+
+    renderer.setShaderFeatures(previous);
+    renderer.programCache().setDirectory(directory);
+    return results;
+}
+
+//把shader拷到临时目录切到开发模式, 然后在片元shader末尾追加几次注释(内容变了, 只有这个阶段要重新编译),
+//最后一次追加一行语法错误, 确认失败后继续用原来的program. 从写文件开始计时, 一直处理事件(文件监视)并出帧,
+//直到这次修改涉及的变体都换上或失败; latencyMs包括文件监视的通知延迟, reloadMs从收到通知算起
+QJsonArray HeadlessBenchmark::shaderReload(SceneRenderer &renderer)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    const QString previous = renderer.shaderVariants().sourceDirectory();
+    QTemporaryDir directory;
+    const char *const names[] = { "vertexShaderSource.vert", "fragmentShaderSource.frag",
+                                  "instanceShaderSource.vert", "arrayShaderSource.frag" };
+    for(const char *name : names)
+    {
+        const QString target = directory.filePath(QString::fromLatin1(name));
+        QFile::copy(QStringLiteral(":/") + QString::fromLatin1(name), target);
+        //从资源拷出来的文件是只读的
+        QFile::setPermissions(target, QFile::ReadOwner | QFile::WriteOwner);
+    }
+    //源码和资源里的一样, 切换目录不会重新编译
+    renderer.setShaderDirectory(directory.path());
+    renderer.render(FrameScheduler::Scene);
+    gl->glFinish();
+
+    const int edits = 4;
+    QJsonArray results;
+    for(int i=0; i < edits; ++i)
+    {
+        const bool broken = i == edits - 1;
+        const ShaderVariants::Stats before = renderer.shaderVariants().stats();
+        QFile file(directory.filePath(QStringLiteral("fragmentShaderSource.frag")));
+        if(file.open(QIODevice::WriteOnly | QIODevice::Append))
+        {
+            file.write(broken ? QByteArray("\nthis is not glsl\n") : QByteArray("\n// edit ") + QByteArray::number(i) + "\n");
+            file.close();
+        }
+
+        QElapsedTimer total;
+        total.start();
+        double maxMs = 0.0;
+        int frames = 0;
+        bool done = false;
+        while(!done && total.elapsed() < 5000)
+        {
+            QCoreApplication::processEvents();
+            QElapsedTimer timer;
+            timer.start();
+            renderer.render(FrameScheduler::Scene);
+            gl->glFinish();
+            maxMs = qMax(maxMs, timer.nsecsElapsed() / 1e6);
+            ++frames;
+            const ShaderVariants::Stats &after = renderer.shaderVariants().stats();
+            done = (after.reloads != before.reloads || after.reloadFailures != before.reloadFailures)
+                   && !renderer.shadersPending();
+        }
+
+        const ShaderVariants::Stats &after = renderer.shaderVariants().stats();
+        QJsonObject json;
+        json["broken"] = broken;
+        json["completed"] = done;
+        json["reloaded"] = after.reloads - before.reloads;
+        json["failed"] = after.reloadFailures - before.reloadFailures;
+        json["stagesCompiled"] = after.stagesCompiled - before.stagesCompiled;
+        json["latencyMs"] = total.nsecsElapsed() / 1e6;
+        json["reloadMs"] = after.lastReloadNsecs / 1e6;
+        json["frames"] = frames;
+        json["maxFrameMs"] = maxMs;
+        results.append(json);
+    }
+
+    renderer.setShaderDirectory(previous);
+    do
+    {
+        renderer.render(FrameScheduler::Scene);
+        gl->glFinish();
+    } while(renderer.shadersPending());
+    return results;
+}
+
+//写一个经纬度细分的单位球(.obj, 带纹理坐标和光滑法线), 只有经线0和两极是接缝, 简化器能一路减下去
+static bool writeSphere(const QString &fileName, int slices, int stacks)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QByteArray obj;
+    for(int j=0; j <= stacks; ++j)
+    {
+        for(int i=0; i <= slices; ++i)
+        {
+            const float theta = glm::pi<float>() * j / stacks;
+            const float phi = 2.0f * glm::pi<float>() * i / slices;
+            const glm::vec3 p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            obj += "v " + QByteArray::number(p.x) + ' ' + QByteArray::number(p.y) + ' ' + QByteArray::number(p.z) + '\n';
+            obj += "vt " + QByteArray::number(float(i) / slices) + ' ' + QByteArray::number(1.0f - float(j) / stacks) + '\n';
+            obj += "vn " + QByteArray::number(p.x) + ' ' + QByteArray::number(p.y) + ' ' + QByteArray::number(p.z) + '\n';
+        }
+    }
+    auto corner = [&](int i, int j) {
+        const QByteArray k = QByteArray::number(j * (slices + 1) + i + 1);
+        return k + '/' + k + '/' + k;
+    };
+    for(int j=0; j < stacks; ++j)
+    {
+        for(int i=0; i < slices; ++i)
+        {
+            if(j > 0)
+                obj += "f " + corner(i, j) + ' ' + corner(i, j + 1) + ' ' + corner(i + 1, j) + '\n';
+            if(j < stacks - 1)
+                obj += "f " + corner(i + 1, j) + ' ' + corner(i, j + 1) + ' ' + corner(i + 1, j + 1) + '\n';
+        }
+    }
+    return file.write(obj) == obj.size();
+}
+
+//把场景里的模型换成3万多个三角形的球, 在1千和1万个实例上各画一遍LOD0和按屏幕误差选的LOD:
+//实例大多在几十个单位外, 只占几个像素, LOD能省掉大部分三角形; 软件光栅下帧时间基本跟三角形数走
+QJsonArray HeadlessBenchmark::lodBenchmark(SceneRenderer &renderer)
+{
+    const QString previous = renderer.meshFile();
+    const int instances = renderer.instanceCount();
+    const bool enabled = renderer.lodEnabled();
+    QTemporaryDir directory;
+    const QString sphere = directory.filePath(QStringLiteral("sphere.obj"));
+    QJsonArray results;
+    if(!writeSphere(sphere, 128, 128) || !renderer.loadMesh(sphere))
+    {
+        qWarning("headless: cannot create the LOD benchmark mesh");
+        return results;
+    }
+
+    const int counts[] = { 1000, 10000 };
+    for(int count : counts)
+    {
+        renderer.setInstanceCount(count);
+        for(int mode=0; mode < 2; ++mode)
+        {
+            renderer.setLodEnabled(mode == 1);
+            renderer.render(FrameScheduler::Camera);
+            const std::vector<double> frameTimes = measureFrames(renderer, qMax(1, m_options.frames / 10));
+
+            QJsonObject entry;
+            entry["instances"] = count;
+            entry["lod"] = renderer.lodEnabled();
+            entry["meshLods"] = int(renderer.meshLods().size());
+            entry["visibleInstances"] = renderer.visibleCount();
+            entry["trianglesPerFrame"] = double(renderer.trianglesDrawn());
+            entry["fullDetailTrianglesPerFrame"] = double(renderer.trianglesFullDetail());
+            entry["triangleSavings"] = renderer.trianglesFullDetail() > 0
+                    ? 1.0 - double(renderer.trianglesDrawn()) / renderer.trianglesFullDetail() : 0.0;
+            entry["medianMs"] = percentile(frameTimes, 0.5);
+            entry["p99Ms"] = percentile(frameTimes, 0.99);
+            results.append(entry);
+        }
+    }
+
+    renderer.setLodEnabled(enabled);
+    renderer.loadMesh(previous);
+    renderer.setInstanceCount(instances);
+    return results;
+}
+
+int HeadlessBenchmark::run()
+{
+    QOpenGLContext context;
+    context.setFormat(QSurfaceFormat::defaultFormat());
+    if(!context.create())
+    {
+        qWarning("headless: failed to create OpenGL context");
+        return 1;
+    }
+
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if(!context.makeCurrent(&surface))
+    {
+        qWarning("headless: failed to make context current");
+        return 1;
+    }
+
+    int result = 0;
+    QElapsedTimer startup;
+    startup.start();
+    {
+        QOpenGLFramebufferObject fbo(m_options.size, QOpenGLFramebufferObject::CombinedDepthStencil);
+        fbo.bind();
+        context.functions()->glViewport(0, 0, m_options.size.width(), m_options.size.height());
+
+        SceneRenderer renderer;
+        if(!m_options.textureCache)
+            renderer.textureLoader().setCacheDirectory(QString());
+        if(!m_options.programCache)
+            renderer.programCache().setDirectory(QString());
+        renderer.setMeshFile(m_options.mesh);
+        if(m_options.threads > 0)
+            renderer.setThreadCount(m_options.threads);
+        VertexFormat format;
+        if(!VertexFormat::parse(m_options.vertexFormat, format))
+            qWarning() << "headless: unknown vertex format" << m_options.vertexFormat;
+        renderer.setVertexFormat(format);
+        int features = ShaderVariants::Textured;
+        if(!ShaderVariants::parseFeatures(m_options.shaderFeatures, features))
+            qWarning() << "headless: unknown shader features" << m_options.shaderFeatures;
+        renderer.setShaderFeatures(features);
+        renderer.setShaderDirectory(m_options.shaderDirectory);
+        renderer.initialize();
+        renderer.resize(m_options.size.width(), m_options.size.height());
+        renderer.setInstanced(m_options.instanced);
+        renderer.setLodEnabled(m_options.lod);
+        renderer.setLodThreshold(m_options.lodThreshold);
+        for(int mode=SceneRenderer::NoCulling; mode < SceneRenderer::CullModeCount; ++mode)
+        {
+            if(m_options.cullMode == QLatin1String(SceneRenderer::cullModeName(SceneRenderer::CullMode(mode))))
+                renderer.setCullMode(SceneRenderer::CullMode(mode));
+        }
+        renderer.setInstanceCount(m_options.instances);
+
+        //第一帧算全部矩阵并预热驱动, 不计入统计; 这时纹理多半还是占位纹理
+        renderer.render(FrameScheduler::Camera | FrameScheduler::Projection | FrameScheduler::Scene);
+        context.functions()->glFinish();
+        const double firstFrameMs = startup.nsecsElapsed() / 1e6;
+
+        //统计的帧要用真实纹理
+        renderer.textureLoader().finish();
+        context.functions()->glFinish();
+        const double texturesMs = startup.nsecsElapsed() / 1e6;
+
+        //统计的帧也要用请求的变体
+        while(renderer.shadersPending())
+        {
+            renderer.render(FrameScheduler::Scene);
+            context.functions()->glFinish();
+        }
+        const double shadersMs = startup.nsecsElapsed() / 1e6;
+        const ShaderVariants::Stats variantStats = renderer.shaderVariants().stats();
+
+        double cullMs = 0.0;
+        const std::vector<double> frameTimes = measureFrames(renderer, m_options.frames, &cullMs);
+        const int drawCalls = renderer.drawCalls();
+        const int visible = renderer.visibleCount();
+        const bool gpuCulling = renderer.gpuCulling();
+        const qint64 triangles = renderer.trianglesDrawn();
+        const qint64 fullDetailTriangles = renderer.trianglesFullDetail();
+        const int textureBinds = renderer.textureBinds();
+        const StateTracker::Stats stateStats = renderer.stateStats();
+        const QJsonObject picking = m_options.picks > 0 ? pickLatency(renderer) : QJsonObject();
+        const QJsonArray sweep = m_options.filterSweep ? filterSweep(renderer) : QJsonArray();
+        const QJsonObject loading = m_options.meshLoadBenchmark.isEmpty() ? QJsonObject() : meshLoad(renderer);
+        const QJsonArray formats = m_options.vertexFormatSweep ? vertexFormatSweep(renderer) : QJsonArray();
+        const QJsonArray scaling = m_options.jobScaling ? jobScaling(renderer) : QJsonArray();
+        const QJsonObject programs = m_options.programCacheBenchmark ? programCacheBenchmark() : QJsonObject();
+        const QJsonArray variants = m_options.shaderVariantBenchmark ? shaderVariantBenchmark(renderer) : QJsonArray();
+        const QJsonArray reloads = m_options.shaderReloadBenchmark ? shaderReload(renderer) : QJsonArray();
+        const QJsonArray lods = m_options.lodBenchmark ? lodBenchmark(renderer) : QJsonArray();
+        const QJsonObject sceneGraph = m_options.sceneGraphBenchmark ? sceneGraphBenchmark(renderer.jobs()) : QJsonObject();
+        const QJsonObject entityStore = m_options.entityBenchmark ? entityBenchmark(renderer.jobs()) : QJsonObject();
+        const QJsonObject gpuCullCheck = m_options.gpuCullValidation ? gpuCullValidation(renderer) : QJsonObject();
+        const TextureLoader::Stats textureStats = renderer.textureLoader().stats();
+        const ProgramCache::Stats programStats = renderer.programCache().stats();
+        if(!m_options.trace.isEmpty())
+            renderer.profiler().writeChromeTrace(m_options.trace);
+
+        renderer.cleanup();
+        fbo.release();
+
+        QJsonObject json;
+        json["renderer"] = QString::fromLatin1(reinterpret_cast<const char *>(context.functions()->glGetString(GL_RENDERER)));
+        json["width"] = m_options.size.width();
+        json["height"] = m_options.size.height();
+        json["frames"] = m_options.frames;
+        json["instances"] = m_options.instances;
+        json["instanced"] = m_options.instanced;
+        json["drawCallsPerFrame"] = drawCalls;
+        json["cullMode"] = SceneRenderer::cullModeName(renderer.cullMode());
+        json["cullPath"] = FrustumCuller::path();
+        json["gpuCulling"] = gpuCulling;
+        json["visibleInstances"] = visible;
+        json["cullMsPerFrame"] = cullMs / qMax(1, m_options.frames);
+        json["threads"] = renderer.threadCount();
+        json["textureBindsPerFrame"] = textureBinds;
+        json["programBindsPerFrame"] = stateStats.programBinds;
+        json["vertexArrayBindsPerFrame"] = stateStats.vertexArrayBinds;
+        json["skippedBindsPerFrame"] = stateStats.skipped;
+        json["mesh"] = renderer.meshFile();
+        json["meshInputVertices"] = renderer.meshStats().inputVertices;
+        json["meshVertices"] = renderer.meshStats().outputVertices;
+        json["meshAcmrBefore"] = renderer.meshStats().acmrBefore;
+        json["meshAcmrAfter"] = renderer.meshStats().acmrAfter;
+        json["vertexFormat"] = renderer.vertexFormat().name();
+        json["meshVertexStride"] = renderer.meshVertexStride();
+        json["meshVertexBytes"] = double(renderer.meshVertexBytes());
+        json["meshLods"] = int(renderer.meshLods().size());
+        json["lod"] = renderer.lodEnabled();
+        json["lodThreshold"] = renderer.lodThreshold();
+        json["trianglesPerFrame"] = double(triangles);
+        json["fullDetailTrianglesPerFrame"] = double(fullDetailTriangles);
+        json["programCacheHits"] = programStats.hits;
+        json["programCacheMisses"] = programStats.misses;
+        json["programCacheRejected"] = programStats.rejected;
+        json["programBuildMs"] = programStats.buildNsecs / 1e6;
+        json["shaderFeatures"] = ShaderVariants::featureNames(renderer.shaderFeatures());
+        json["shaderCompilePath"] = ShaderVariants::compilePathName(renderer.shaderVariants().compilePath());
+        json["shaderVariantsCompiled"] = variantStats.compiled;
+        json["shaderVariantCacheLoads"] = variantStats.cacheLoads;
+        json["shaderVariantFallbacks"] = double(variantStats.fallbacks);
+        json["shaderVariantReadyMs"] = variantStats.readyNsecs / 1e6;
+        json["timeToFirstFrameMs"] = firstFrameMs;
+        json["timeToTexturesMs"] = texturesMs;
+        json["timeToShadersMs"] = shadersMs;
+        json["textureCacheHits"] = textureStats.cacheHits;
+        json["textureCacheMisses"] = textureStats.cacheMisses;
+        json["textureUncompressed"] = textureStats.uncompressed;
+        json["textureRgbaBytes"] = double(textureStats.rgbaBytes);
+        json["textureGpuBytes"] = double(textureStats.gpuBytes);
+        json["textureLoadMs"] = textureStats.loadNsecs / 1e6;
+        json["minMs"] = frameTimes.empty() ? 0.0 : frameTimes.front();
+        json["medianMs"] = percentile(frameTimes, 0.5);
+        json["p99Ms"] = percentile(frameTimes, 0.99);
+        if(m_options.filterSweep)
+            json["filterSweep"] = sweep;
+        if(m_options.picks > 0)
+            json["pickLatency"] = picking;
+        if(m_options.bvhSweep)
+            json["bvhSweep"] = bvhSweep();
+        if(!m_options.meshLoadBenchmark.isEmpty())
+            json["meshLoad"] = loading;
+        if(m_options.vertexFormatSweep)
+            json["vertexFormatSweep"] = formats;
+        if(m_options.jobScaling)
+            json["jobScaling"] = scaling;
+        if(m_options.programCacheBenchmark)
+            json["programCache"] = programs;
+        if(m_options.shaderVariantBenchmark)
+            json["shaderVariants"] = variants;
+        if(m_options.shaderReloadBenchmark)
+            json["shaderReload"] = reloads;
+        if(m_options.lodBenchmark)
+            json["lodBenchmark"] = lods;
+        if(m_options.sceneGraphBenchmark)
+            json["sceneGraph"] = sceneGraph;
+        if(m_options.entityBenchmark)
+            json["entities"] = entityStore;
+        if(m_options.gpuCullValidation)
+            json["gpuCullValidation"] = gpuCullCheck;
+
+        QFile file(m_options.output);
+        if(file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            file.write(QJsonDocument(json).toJson());
+        }
+        else
+        {
+            qWarning() << "headless: cannot write" << m_options.output;
+            result = 1;
+        }
+
+        qDebug().noquote() << QJsonDocument(json).toJson(QJsonDocument::Compact);
+    }
+
+    context.doneCurrent();
+    return result;
+}
@@ -0,0 +1,74 @@
+#ifndef HEADLESSBENCHMARK_H
+#define HEADLESSBENCHMARK_H
+
+#include <QString>
+#include <QSize>
+#include <QJsonArray>
+#include <QJsonObject>
+
+class SceneRenderer;
+class JobSystem;
+
+//不需要窗口的渲染基准: QOffscreenSurface + QOpenGLFramebufferObject,
+//用和GLWidget相同的SceneRenderer画N帧, 把帧时间统计写进JSON.
+//可以在 -platform offscreen + Mesa llvmpipe 下运行.
+class HeadlessBenchmark
+{
+public:
+    struct Options
+    {
+        int frames = 300;
+        int instances = 10;
+        bool instanced = false;
+        QString cullMode = QStringLiteral("flat");     //none, flat, bvh, gpu
+        QSize size = QSize(800, 800);
+        QString output = QStringLiteral("bench_output.json");
+        QString trace;      //非空时额外导出Chrome trace
+        bool textureCache = true;
+        bool programCache = true;
+        bool programCacheBenchmark = false; //额外对比program从源码编译和从二进制缓存加载的时间
+        QString shaderFeatures = QStringLiteral("textured");    //见ShaderVariants::parseFeatures
+        bool shaderVariantBenchmark = false;    //额外测切换到没编译过的变体时的帧时间和就绪前的帧数
+        QString shaderDirectory;    //非空时从这里读shader(开发模式)
+        bool shaderReloadBenchmark = false;     //额外测改了shader文件之后热重载的延迟
+        bool filterSweep = false;   //额外测不同纹理过滤方式在不同距离下的帧时间
+        bool bvhSweep = false;      //额外测BVH在10万~1000万个图元上的建树/refit/查询性能, 只用CPU
+        int picks = 0;              //在随机像素上做多少次鼠标拾取, 统计延迟
+        QString mesh;               //场景里画的模型, 空是立方体
+        QString meshLoadBenchmark;  //非空时对比这个.obj/.gltf的文本导入和转成.gmesh后的冷/热加载
+        QString vertexFormat = QStringLiteral("float");     //见VertexFormat::parse
+        bool vertexFormatSweep = false;     //额外用几种压缩顶点格式各画一遍, 比较顶点缓冲大小和帧时间
+        int threads = 0;            //帧准备的线程数, 0是CPU核数
+        bool jobScaling = false;    //额外测1到N个线程时帧准备(动画/剔除/建渲染队列)的时间
+        bool lod = true;            //按屏幕空间误差选LOD, 关掉时都画LOD0
+        float lodThreshold = 1.0f;  //像素
+        bool lodBenchmark = false;  //额外在一个密的球上对比开关LOD时每帧的三角形数和帧时间
+        bool sceneGraphBenchmark = false;   //额外测100万个节点的变换层次在0%/1%/100%节点移动时的更新时间, 只用CPU
+        bool entityBenchmark = false;       //额外对比100万个实体按块存和按结构体存时的遍历速度, 以及增删的开销, 只用CPU
+        bool gpuCullValidation = false;     //额外在几个摄像机位置对比compute shader和CPU的剔除/LOD结果, 要求GL 4.3
+    };
+
+    explicit HeadlessBenchmark(const Options &options);
+
+    //返回值作为进程退出码, 0表示成功
+    int run();
+
+private:
+    QJsonArray filterSweep(SceneRenderer &renderer);
+    QJsonArray bvhSweep();
+    QJsonObject pickLatency(SceneRenderer &renderer);
+    QJsonObject meshLoad(SceneRenderer &renderer);
+    QJsonArray vertexFormatSweep(SceneRenderer &renderer);
+    QJsonArray jobScaling(SceneRenderer &renderer);
+    QJsonObject programCacheBenchmark();
+    QJsonArray shaderVariantBenchmark(SceneRenderer &renderer);
+    QJsonArray shaderReload(SceneRenderer &renderer);
+    QJsonArray lodBenchmark(SceneRenderer &renderer);
+    QJsonObject sceneGraphBenchmark(JobSystem &jobs);
+    QJsonObject entityBenchmark(JobSystem &jobs);
+    QJsonObject gpuCullValidation(SceneRenderer &renderer);
+
+    Options m_options;
+};
+
+#endif // HEADLESSBENCHMARK_H
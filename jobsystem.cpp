@@ -0,0 +1,190 @@
+#include "jobsystem.h"
+
+//工作线程只是跑JobSystem::workerLoop
+class JobWorker : public QThread
+{
+public:
+    JobWorker(JobSystem *system, int queue) : m_system(system), m_queue(queue) {}
+
+protected:
+    void run() override { m_system->workerLoop(m_queue); }
+
+private:
+    JobSystem *m_system;
+    int m_queue;
+};
+
+//当前线程在哪个JobSystem里是几号队列; 不是工作线程的都用0号
+static thread_local const JobSystem *t_system = nullptr;
+static thread_local int t_queue = 0;
+
+JobSystem::JobSystem(int threads)
+    : m_queued(0)
+    , m_quit(false)
+    , m_jobCount(0)
+    , m_stealCount(0)
+{
+    threads = qMax(1, threads);
+    for(int i=0; i < threads; ++i)
+        m_queues.push_back(new Queue);
+    for(int i=1; i < threads; ++i)
+    {
+        QThread *thread = new JobWorker(this, i);
+        thread->start();
+        m_threads.push_back(thread);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        QMutexLocker lock(&m_sleepMutex);
+        m_quit = true;
+        m_wake.wakeAll();
+    }
+    for(QThread *thread : m_threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+    for(Queue *queue : m_queues)
+        delete queue;
+}
+
+int JobSystem::currentQueue() const
+{
+    return t_system == this ? t_queue : 0;
+}
+
+void JobSystem::run(Group &group, const std::function<void()> &job)
+{
+    group.m_pending.ref();
+    push(currentQueue(), Job{ job, &group });
+    wakeWorkers();
+}
+
+void JobSystem::wait(Group &group)
+{
+    const int queue = currentQueue();
+    Job job;
+    while(group.m_pending.loadAcquire() > 0)
+    {
+        if(pop(queue, job) || steal(queue, job))
+            execute(job);
+        else
+            QThread::yieldCurrentThread();
+    }
+}
+
+void JobSystem::parallelFor(int count, int grain, const std::function<void(int begin, int end)> &body)
+{
+    grain = qMax(1, grain);
+    if(count <= grain || threadCount() == 1)
+    {
+        if(count > 0)
+            body(0, count);
+        return;
+    }
+
+    Group group;
+    const int queue = currentQueue();
+    for(int begin=0; begin < count; begin += grain)
+    {
+        const int end = qMin(count, begin + grain);
+        group.m_pending.ref();
+        push(queue, Job{ [&body, begin, end]() { body(begin, end); }, &group });
+    }
+    wakeWorkers();
+    wait(group);
+}
+
+void JobSystem::push(int queue, const Job &job)
+{
+    {
+        QMutexLocker lock(&m_queues[queue]->mutex);
+        m_queues[queue]->jobs.push_back(job);
+    }
+    m_queued.ref();
+}
+
+bool JobSystem::pop(int queue, Job &job)
+{
+    QMutexLocker lock(&m_queues[queue]->mutex);
+    std::deque<Job> &jobs = m_queues[queue]->jobs;
+    if(jobs.empty())
+        return false;
+    job = jobs.back();
+    jobs.pop_back();
+    m_queued.deref();
+    return true;
+}
+
+//从下一个队列开始轮流找, 偷最早放进去的(通常是最大的一块)
+bool JobSystem::steal(int queue, Job &job)
+{
+    const int count = threadCount();
+    for(int k=1; k < count; ++k)
+    {
+        Queue *victim = m_queues[(queue + k) % count];
+        QMutexLocker lock(&victim->mutex);
+        if(victim->jobs.empty())
+            continue;
+        job = victim->jobs.front();
+        victim->jobs.pop_front();
+        m_queued.deref();
+        m_stealCount.ref();
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+    job.function();
+    m_jobCount.ref();
+    job.group->m_pending.deref();
+}
+
+//在m_sleepMutex里通知: 工作线程检查m_queued和开始等待之间不会漏掉
+void JobSystem::wakeWorkers()
+{
+    if(m_threads.empty())
+        return;
+    QMutexLocker lock(&m_sleepMutex);
+    m_wake.wakeAll();
+}
+
+void JobSystem::workerLoop(int queue)
+{
+    t_system = this;
+    t_queue = queue;
+    Job job;
+    for(;;)
+    {
+        if(pop(queue, job) || steal(queue, job))
+        {
+            execute(job);
+            continue;
+        }
+
+        QMutexLocker lock(&m_sleepMutex);
+        if(m_quit)
+            return;
+        if(m_queued.loadAcquire() <= 0)
+            m_wake.wait(&m_sleepMutex);
+    }
+}
+
+JobSystem::Stats JobSystem::stats() const
+{
+    Stats stats;
+    stats.jobs = m_jobCount.loadAcquire();
+    stats.steals = m_stealCount.loadAcquire();
+    return stats;
+}
+
+void JobSystem::resetStats()
+{
+    m_jobCount.storeRelease(0);
+    m_stealCount.storeRelease(0);
+}
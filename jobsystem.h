@@ -0,0 +1,82 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+#include <deque>
+#include <vector>
+#include <functional>
+
+//帧准备用的任务系统: 每个线程一个双端队列, 自己从尾部取(后进先出, 数据还在缓存里), 空了就从别的队列头部偷.
+//提交任务的线程(GUI线程)占0号队列, 在wait里也帮着执行, 所以threads个线程里只有threads - 1个是工作线程.
+class JobSystem
+{
+public:
+    //wait等组里所有任务完成; 任务里可以继续往同一个组或别的组提交
+    class Group
+    {
+    public:
+        Group() : m_pending(0) {}
+    private:
+        friend class JobSystem;
+        QAtomicInt m_pending;
+    };
+
+    struct Stats
+    {
+        qint64 jobs = 0;
+        qint64 steals = 0;
+    };
+
+    explicit JobSystem(int threads = QThread::idealThreadCount());
+    ~JobSystem();
+
+    int threadCount() const { return int(m_queues.size()); }
+
+    void run(Group &group, const std::function<void()> &job);
+    void wait(Group &group);
+    //[0, count)切成最多grain个一块, 每块一个任务, 返回时全部完成; 只有一块时直接在调用线程里执行
+    void parallelFor(int count, int grain, const std::function<void(int begin, int end)> &body);
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+    friend class JobWorker;
+
+    struct Job
+    {
+        std::function<void()> function;
+        Group *group;
+    };
+
+    struct Queue
+    {
+        QMutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    int currentQueue() const;
+    void push(int queue, const Job &job);
+    bool pop(int queue, Job &job);
+    bool steal(int queue, Job &job);
+    void execute(Job &job);
+    void wakeWorkers();
+    void workerLoop(int queue);
+
+    std::vector<Queue *> m_queues;
+    std::vector<QThread *> m_threads;
+    //所有队列里还没被取走的任务数, 为0时工作线程睡在m_wake上
+    QAtomicInt m_queued;
+    QMutex m_sleepMutex;
+    QWaitCondition m_wake;
+    bool m_quit;
+
+    QAtomicInt m_jobCount;
+    QAtomicInt m_stealCount;
+};
+
+#endif // JOBSYSTEM_H
@@ -1,11 +1,134 @@
 #include "mainwindow.h"
+#include "headlessbenchmark.h"
+#include "meshimporter.h"
+#include "meshfile.h"
 
 #include <QApplication>
+#include <QSurfaceFormat>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
 
 int main(int argc, char *argv[])
 {
+    //3.3 core: 软件光栅(Mesa llvmpipe)下也能拿到实例化/UBO/fence, 驱动支持时会给更高版本
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption headlessOption("headless", "Render offscreen and write frame statistics instead of opening a window.");
+    QCommandLineOption framesOption("frames", "Number of measured frames.", "n", "300");
+    QCommandLineOption instancesOption("instances", "Number of cubes in the scene.", "n", "10");
+    QCommandLineOption instancedOption("instanced", "Use the instanced draw path.");
+    QCommandLineOption cullOption("cull", "Frustum culling: none, flat (SIMD test of every cube), bvh, or gpu (compute shader + multi-draw indirect, instanced path on GL 4.3; falls back to flat).", "mode", "flat");
+    QCommandLineOption sizeOption("size", "Framebuffer size.", "WxH", "800x800");
+    QCommandLineOption outputOption("output", "JSON result file.", "file", "bench_output.json");
+    QCommandLineOption traceOption("trace", "Also write a Chrome trace of the last frames.", "file");
+    QCommandLineOption noCacheOption("no-texture-cache", "Decode textures with QImage on every run instead of using the compressed cache.");
+    QCommandLineOption noProgramCacheOption("no-program-cache", "Compile and link shaders from source on every run instead of loading cached program binaries.");
+    QCommandLineOption programCacheBenchmarkOption("program-cache-benchmark", "Also compare building the shader programs from source with cold and warm program binary cache loads.");
+    QCommandLineOption shaderFeaturesOption("shader-features", "Shader variant features, comma separated: textured, lambert (or unlit).", "features", "textured");
+    QCommandLineOption shaderVariantBenchmarkOption("shader-variant-benchmark", "Also measure frame times while switching to shader variants that still have to be compiled.");
+    QCommandLineOption shaderDirOption("shader-dir", "Development mode: read shaders from this directory and reload them when they change.", "dir");
+    QCommandLineOption shaderReloadBenchmarkOption("shader-reload-benchmark", "Also measure hot-reload latency of edited shaders in a temporary shader directory.");
+    QCommandLineOption filterSweepOption("filter-sweep", "Also measure bilinear/trilinear/anisotropic filtering at increasing camera distances.");
+    QCommandLineOption bvhSweepOption("bvh-sweep", "Also benchmark BVH build, refit and queries on 100k to 10M primitives.");
+    QCommandLineOption picksOption("picks", "Measure mouse-picking latency over n random cursor positions.", "n", "0");
+    QCommandLineOption meshOption("mesh", "Draw this model instead of the cube (.gmesh, .obj, .gltf or .glb).", "file");
+    QCommandLineOption convertOption("convert-mesh", "Import an .obj/.gltf/.glb model, write it as .gmesh next to it and exit.", "file");
+    QCommandLineOption meshLoadOption("mesh-load-benchmark", "Compare text import of an .obj/.gltf model with cold and warm .gmesh loads.", "file");
+    QCommandLineOption vertexFormatOption("vertex-format", "Vertex encoding, comma separated: float, half, snorm16, unorm16, oct, 3x10.", "format", "float");
+    QCommandLineOption vertexFormatSweepOption("vertex-format-sweep", "Also compare VBO size and frame time of the compressed vertex formats.");
+    QCommandLineOption threadsOption("threads", "Threads used for frame preparation (animation, culling, render queue); 0 uses every core.", "n", "0");
+    QCommandLineOption jobScalingOption("job-scaling", "Also measure frame preparation time with 1 to N threads.");
+    QCommandLineOption noLodOption("no-lod", "Always draw the full-detail mesh instead of selecting a level of detail by screen-space error.");
+    QCommandLineOption lodThresholdOption("lod-threshold", "Largest projected geometric error of the selected level of detail, in pixels.", "pixels", "1");
+    QCommandLineOption sceneGraphBenchmarkOption("scene-graph-benchmark", "Also measure world-matrix updates of a 1M-node transform hierarchy when 0%, 1% and 100% of the nodes move.");
+    QCommandLineOption entityBenchmarkOption("entity-benchmark", "Also compare iteration over 1M entities stored in component chunks and in an array of structs, plus add/remove cost.");
+    QCommandLineOption gpuCullValidationOption("gpu-cull-validate", "Also compare compute-shader culling and LOD selection with the CPU path on 100k cubes.");
+    QCommandLineOption lodBenchmarkOption("lod-benchmark", "Also compare triangles and frame time with and without level-of-detail selection on a dense sphere.");
+    parser.addOptions({ headlessOption, framesOption, instancesOption, instancedOption, cullOption, sizeOption, outputOption, traceOption, noCacheOption, noProgramCacheOption, programCacheBenchmarkOption, shaderFeaturesOption, shaderVariantBenchmarkOption, shaderDirOption, shaderReloadBenchmarkOption, filterSweepOption, bvhSweepOption, picksOption, meshOption, convertOption, meshLoadOption, vertexFormatOption, vertexFormatSweepOption, threadsOption, jobScalingOption, noLodOption, lodThresholdOption, lodBenchmarkOption, sceneGraphBenchmarkOption, entityBenchmarkOption, gpuCullValidationOption });
+    parser.process(a);
+
+    VertexFormat vertexFormat;
+    if(!VertexFormat::parse(parser.value(vertexFormatOption), vertexFormat))
+    {
+        qWarning() << "unknown vertex format" << parser.value(vertexFormatOption);
+        return 1;
+    }
+
+    if(parser.isSet(convertOption))
+    {
+        const QString source = parser.value(convertOption);
+        const QFileInfo info(source);
+        Mesh mesh;
+        MeshBuilder::Stats stats;
+        QString error;
+        if(!MeshImporter::import(source, mesh, &stats, &error))
+        {
+            qWarning() << source << error;
+            return 1;
+        }
+        const QString target = info.dir().filePath(info.completeBaseName() + ".gmesh");
+        qDebug("%s: %d -> %d vertices, %d triangles, ACMR %.3f -> %.3f, %d LODs",
+               qPrintable(target), stats.inputVertices, stats.outputVertices, stats.triangles,
+               stats.acmrBefore, stats.acmrAfter, stats.lodLevels);
+        return MeshFile::write(target, mesh, vertexFormat) ? 0 : 1;
+    }
+
+#ifdef OPENGL_BENCH
+    const bool headless = true;
+#else
+    const bool headless = parser.isSet(headlessOption);
+#endif
+    if(headless)
+    {
+        HeadlessBenchmark::Options options;
+        options.frames = parser.value(framesOption).toInt();
+        options.instances = parser.value(instancesOption).toInt();
+        options.instanced = parser.isSet(instancedOption);
+        options.cullMode = parser.value(cullOption);
+        const QStringList size = parser.value(sizeOption).split('x');
+        if(size.size() == 2)
+            options.size = QSize(size[0].toInt(), size[1].toInt());
+        options.output = parser.value(outputOption);
+        options.trace = parser.value(traceOption);
+        options.textureCache = !parser.isSet(noCacheOption);
+        options.programCache = !parser.isSet(noProgramCacheOption);
+        options.programCacheBenchmark = parser.isSet(programCacheBenchmarkOption);
+        options.shaderFeatures = parser.value(shaderFeaturesOption);
+        options.shaderVariantBenchmark = parser.isSet(shaderVariantBenchmarkOption);
+        options.shaderDirectory = parser.value(shaderDirOption);
+        options.shaderReloadBenchmark = parser.isSet(shaderReloadBenchmarkOption);
+        options.filterSweep = parser.isSet(filterSweepOption);
+        options.bvhSweep = parser.isSet(bvhSweepOption);
+        options.picks = parser.value(picksOption).toInt();
+        options.mesh = parser.value(meshOption);
+        options.meshLoadBenchmark = parser.value(meshLoadOption);
+        options.vertexFormat = parser.value(vertexFormatOption);
+        options.vertexFormatSweep = parser.isSet(vertexFormatSweepOption);
+        options.threads = parser.value(threadsOption).toInt();
+        options.jobScaling = parser.isSet(jobScalingOption);
+        options.lod = !parser.isSet(noLodOption);
+        options.lodThreshold = parser.value(lodThresholdOption).toFloat();
+        options.lodBenchmark = parser.isSet(lodBenchmarkOption);
+        options.sceneGraphBenchmark = parser.isSet(sceneGraphBenchmarkOption);
+        options.entityBenchmark = parser.isSet(entityBenchmarkOption);
+        options.gpuCullValidation = parser.isSet(gpuCullValidationOption);
+        return HeadlessBenchmark(options).run();
+    }
+
     MainWindow w;
+    w.setMeshFile(parser.value(meshOption));
+    w.setVertexFormat(vertexFormat);
+    w.setShaderDirectory(parser.value(shaderDirOption));
     w.show();
     return a.exec();
 }
@@ -13,3 +13,18 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::setMeshFile(const QString &fileName)
+{
+    ui->widget->setMeshFile(fileName);
+}
+
+void MainWindow::setVertexFormat(const VertexFormat &format)
+{
+    ui->widget->setVertexFormat(format);
+}
+
+void MainWindow::setShaderDirectory(const QString &directory)
+{
+    ui->widget->setShaderDirectory(directory);
+}
+
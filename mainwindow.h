@@ -3,6 +3,8 @@
 
 #include <QMainWindow>
 
+#include "meshfile.h"
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -15,6 +17,10 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    void setMeshFile(const QString &fileName);
+    void setVertexFormat(const VertexFormat &format);
+    void setShaderDirectory(const QString &directory);
+
 private:
     Ui::MainWindow *ui;
 };
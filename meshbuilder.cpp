@@ -0,0 +1,258 @@
+#include "meshbuilder.h"
+#include "meshsimplifier.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+namespace std
+{
+template<> struct hash<MeshVertex>
+{
+    size_t operator()(const MeshVertex &v) const
+    {
+        size_t seed = hash<glm::vec3>()(v.position);
+        seed ^= hash<glm::vec3>()(v.normal) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= hash<glm::vec2>()(v.texCoord) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+};
+}
+
+Mesh MeshBuilder::build(const float *data, int vertexCount, int stride, Stats *stats)
+{
+    std::vector<MeshVertex> triangles(vertexCount);
+    for(int i=0; i < vertexCount; ++i)
+    {
+        const float *v = data + i * stride;
+        triangles[i].position = glm::vec3(v[0], v[1], v[2]);
+        triangles[i].texCoord = glm::vec2(v[3], v[4]);
+    }
+    computeFaceNormals(triangles);
+    return build(triangles, stats);
+}
+
+Mesh MeshBuilder::build(const std::vector<MeshVertex> &triangles, Stats *stats)
+{
+    Mesh mesh = weld(triangles);
+    const float before = acmr(mesh.indices);
+    optimizeVertexCache(mesh.indices, int(mesh.vertices.size()));
+    optimizeVertexFetch(mesh);
+
+    if(stats)
+    {
+        stats->inputVertices = int(triangles.size());
+        stats->outputVertices = int(mesh.vertices.size());
+        stats->triangles = int(mesh.indices.size() / 3);
+        stats->acmrBefore = before;
+        stats->acmrAfter = acmr(mesh.indices);
+    }
+    //顶点顺序定下来之后再简化, 各级索引都指向同一个顶点数组
+    MeshSimplifier::buildLodChain(mesh);
+    if(stats)
+        stats->lodLevels = int(mesh.lods.size());
+    return mesh;
+}
+
+void MeshBuilder::computeFaceNormals(std::vector<MeshVertex> &triangles)
+{
+    for(size_t i=0; i + 2 < triangles.size(); i += 3)
+    {
+        const glm::vec3 n = glm::cross(triangles[i + 1].position - triangles[i].position,
+                                       triangles[i + 2].position - triangles[i].position);
+        const float length = glm::length(n);
+        const glm::vec3 normal = length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        triangles[i].normal = triangles[i + 1].normal = triangles[i + 2].normal = normal;
+    }
+}
+
+Mesh MeshBuilder::weld(const std::vector<MeshVertex> &triangles)
+{
+    Mesh mesh;
+    mesh.indices.reserve(triangles.size());
+    std::unordered_map<MeshVertex, unsigned> unique;
+    unique.reserve(triangles.size());
+    for(const MeshVertex &vertex : triangles)
+    {
+        auto it = unique.find(vertex);
+        if(it == unique.end())
+        {
+            it = unique.emplace(vertex, unsigned(mesh.vertices.size())).first;
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices.push_back(it->second);
+    }
+    return mesh;
+}
+
+//Tom Forsyth, "Linear-Speed Vertex Cache Optimisation": 顶点分数 = 在缓存里的位置分 + 剩余三角形越少越高的分,
+//每次输出分数最高的三角形, 只需要重新计算缓存里顶点所在的三角形
+namespace
+{
+const int ForsythCacheSize = 32;
+
+float vertexScore(int cachePosition, int remaining)
+{
+    if(remaining == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if(cachePosition >= 0)
+    {
+        //最近一个三角形的3个顶点给固定分, 防止总是在同一条带上来回
+        if(cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - float(cachePosition - 3) / (ForsythCacheSize - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt(float(remaining));
+}
+}
+
+void MeshBuilder::optimizeVertexCache(std::vector<unsigned> &indices, int vertexCount)
+{
+    const int triangleCount = int(indices.size() / 3);
+    if(triangleCount == 0)
+        return;
+
+    //每个顶点相邻的三角形列表(CSR)
+    std::vector<int> remaining(vertexCount, 0);
+    for(unsigned index : indices)
+        ++remaining[index];
+    std::vector<int> offsets(vertexCount + 1, 0);
+    for(int v=0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for(int t=0; t < triangleCount; ++t)
+    {
+        for(int k=0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for(int v=0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for(int t=0; t < triangleCount; ++t)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<unsigned> output;
+    output.reserve(indices.size());
+    std::vector<int> cache, nextCache;
+    cache.reserve(ForsythCacheSize + 3);
+    nextCache.reserve(ForsythCacheSize + 3);
+
+    int best = int(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    int scanCursor = 0;
+    while(best >= 0)
+    {
+        emitted[best] = 1;
+        const unsigned *tri = &indices[best * 3];
+        output.insert(output.end(), tri, tri + 3);
+
+        //新三角形的3个顶点放到缓存最前面, 其余的往后挪
+        nextCache.assign(tri, tri + 3);
+        for(int v : cache)
+        {
+            if(v != int(tri[0]) && v != int(tri[1]) && v != int(tri[2]))
+                nextCache.push_back(v);
+        }
+        for(int k=0; k < 3; ++k)
+        {
+            //从邻接表里删掉这个三角形
+            const int v = int(tri[k]);
+            int *begin = &adjacency[offsets[v]];
+            int *end = begin + remaining[v];
+            *std::find(begin, end, best) = *(end - 1);
+            --remaining[v];
+        }
+        for(size_t i=0; i < nextCache.size(); ++i)
+        {
+            const int v = nextCache[i];
+            cachePosition[v] = i < size_t(ForsythCacheSize) ? int(i) : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        //只有缓存里(包括刚挤出去的)顶点的三角形分数会变, 顺便在其中找下一个
+        best = -1;
+        float bestScore = -1.0f;
+        for(int v : nextCache)
+        {
+            for(int i=offsets[v]; i < offsets[v] + remaining[v]; ++i)
+            {
+                const int t = adjacency[i];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if(triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if(nextCache.size() > size_t(ForsythCacheSize))
+            nextCache.resize(ForsythCacheSize);
+        cache.swap(nextCache);
+
+        //缓存里的顶点已经没有剩余三角形, 顺序找一个还没输出的
+        if(best < 0)
+        {
+            while(scanCursor < triangleCount && emitted[scanCursor])
+                ++scanCursor;
+            if(scanCursor < triangleCount)
+                best = scanCursor;
+        }
+    }
+
+    indices.swap(output);
+}
+
+void MeshBuilder::optimizeVertexFetch(Mesh &mesh)
+{
+    std::vector<int> remap(mesh.vertices.size(), -1);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for(unsigned &index : mesh.indices)
+    {
+        if(remap[index] < 0)
+        {
+            remap[index] = int(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = unsigned(remap[index]);
+    }
+    mesh.vertices.swap(vertices);
+}
+
+float MeshBuilder::acmr(const std::vector<unsigned> &indices, int cacheSize)
+{
+    if(indices.size() < 3)
+        return 0.0f;
+
+    std::vector<unsigned> fifo;
+    fifo.reserve(cacheSize);
+    size_t head = 0;
+    int misses = 0;
+    for(unsigned index : indices)
+    {
+        if(std::find(fifo.begin(), fifo.end(), index) != fifo.end())
+            continue;
+        ++misses;
+        if(int(fifo.size()) < cacheSize)
+        {
+            fifo.push_back(index);
+        }
+        else
+        {
+            fifo[head] = index;
+            head = (head + 1) % cacheSize;
+        }
+    }
+    return float(misses) / float(indices.size() / 3);
+}
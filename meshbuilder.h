@@ -0,0 +1,74 @@
+#ifndef MESHBUILDER_H
+#define MESHBUILDER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//CPU端的顶点: 位置 + 法线 + 纹理坐标, 上传时按MeshFile里的布局描述编码
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+
+    bool operator==(const MeshVertex &o) const
+    {
+        return position == o.position && normal == o.normal && texCoord == o.texCoord;
+    }
+};
+
+//一级细节: Mesh::indices里从firstIndex开始的indexCount个索引; error是相对LOD0的距离误差(模型空间)
+struct MeshLod
+{
+    unsigned firstIndex;
+    unsigned indexCount;
+    float error;
+};
+
+//LOD级数上限, 渲染队列排序键的mesh字段放得下
+enum { MaxMeshLods = 8 };
+
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned> indices;
+    //空表示只有一级, 就是全部indices
+    std::vector<MeshLod> lods;
+};
+
+//把没有索引的三角形列表变成带索引的网格:
+//1. weld: 完全相同的顶点只留一个(用gtx/hash给glm向量做哈希)
+//2. optimizeVertexCache: Forsyth的线性时间算法重排三角形, 让变换后的顶点缓存命中更多
+//3. optimizeVertexFetch: 按索引里第一次出现的顺序重排顶点, 取顶点时顺序访问显存
+//4. MeshSimplifier::buildLodChain: 简化出的各级LOD接在indices后面
+class MeshBuilder
+{
+public:
+    struct Stats
+    {
+        int inputVertices = 0;
+        int outputVertices = 0;
+        int triangles = 0;
+        float acmrBefore = 0.0f;    //平均每个三角形的缓存未命中数, 越接近0.5越好, 最差3
+        float acmrAfter = 0.0f;
+        int lodLevels = 1;
+    };
+
+    //data是stride个float一个顶点, 前5个是位置和纹理坐标, 法线按三角形面法线补上
+    static Mesh build(const float *data, int vertexCount, int stride = 5, Stats *stats = nullptr);
+    //triangles每3个顶点一个三角形(导入器的输出)
+    static Mesh build(const std::vector<MeshVertex> &triangles, Stats *stats = nullptr);
+
+    //没有法线的三角形列表用面法线填上
+    static void computeFaceNormals(std::vector<MeshVertex> &triangles);
+
+    static Mesh weld(const std::vector<MeshVertex> &triangles);
+    static void optimizeVertexCache(std::vector<unsigned> &indices, int vertexCount);
+    static void optimizeVertexFetch(Mesh &mesh);
+
+    //用cacheSize项的FIFO模拟变换后的顶点缓存
+    static float acmr(const std::vector<unsigned> &indices, int cacheSize = 16);
+};
+
+#endif // MESHBUILDER_H
@@ -0,0 +1,439 @@
+#include "meshfile.h"
+#include "vertexpacking.h"
+
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <glm/gtc/packing.hpp>
+
+#include <cstring>
+#include <limits>
+
+#include <QDebug>
+
+//第5个字节是版本: 1没有LOD表, 2在属性描述后面有LOD表
+static const char fileIdentifier[8] = { '\xAB', 'G', 'M', 'S', '2', '\xBB', '\r', '\n' };
+enum { VersionByte = 4 };
+
+static qint64 align(qint64 offset)
+{
+    return (offset + MeshFile::Alignment - 1) / MeshFile::Alignment * MeshFile::Alignment;
+}
+
+bool MeshFile::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = m_file.size();
+    const uchar *data = m_file.map(0, size);
+    if(data == nullptr || !parse(data, size))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MeshFile::load(const QByteArray &data)
+{
+    close();
+    m_owned = data;
+    if(!parse(reinterpret_cast<const uchar *>(m_owned.constData()), m_owned.size()))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::close()
+{
+    //QFile::close会解除映射
+    m_file.close();
+    m_owned.clear();
+    m_data = nullptr;
+    m_size = 0;
+    m_attributes.clear();
+    m_lods.clear();
+}
+
+//一个分量的字节数; 打包格式返回整个属性的大小; 不支持的类型返回0
+static int attributeTypeSize(GLenum type)
+{
+    switch(type)
+    {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+    case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+    case GL_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_2_10_10_10_REV: return 4;
+    default: return 0;
+    }
+}
+
+//属性必须落在一个顶点里, location只能是网格自己的(2~6留给实例属性);
+//位置要能被MeshFile::position读出来: float/half/snorm16的3个分量
+static bool validAttribute(const MeshAttribute &attribute, int stride)
+{
+    if(attribute.location != MeshFile::PositionLocation && attribute.location != MeshFile::TexCoordLocation
+            && attribute.location != MeshFile::NormalLocation)
+        return false;
+    const int typeSize = attributeTypeSize(attribute.type);
+    const bool packed = attribute.type == GL_INT_2_10_10_10_REV || attribute.type == GL_UNSIGNED_INT_2_10_10_10_REV;
+    if(typeSize == 0 || attribute.components < 1 || attribute.components > 4 || (packed && attribute.components != 4))
+        return false;
+    if(attribute.location == MeshFile::PositionLocation && (attribute.components != 3
+            || (attribute.type != GL_FLOAT && attribute.type != GL_HALF_FLOAT && attribute.type != GL_SHORT)))
+        return false;
+    const quint64 bytes = packed ? quint64(typeSize) : quint64(typeSize) * quint64(attribute.components);
+    return quint64(attribute.offset) + bytes <= quint64(stride);
+}
+
+bool MeshFile::parse(const uchar *data, qint64 size)
+{
+    if(size < HeaderSize || memcmp(data, fileIdentifier, VersionByte) != 0
+            || memcmp(data + VersionByte + 1, fileIdentifier + VersionByte + 1, 8 - VersionByte - 1) != 0
+            || (data[VersionByte] != '1' && data[VersionByte] != '2'))
+        return false;
+
+    m_vertexCount = int(qFromLittleEndian<quint32>(data + 8));
+    m_indexCount = int(qFromLittleEndian<quint32>(data + 12));
+    m_indexType = qFromLittleEndian<quint32>(data + 16);
+    m_vertexStride = int(qFromLittleEndian<quint32>(data + 20));
+    const int attributeCount = int(qFromLittleEndian<quint32>(data + 24));
+    float bounds[6];
+    for(int i=0; i < 6; ++i)
+    {
+        const quint32 bits = qFromLittleEndian<quint32>(data + 28 + i * 4);
+        memcpy(&bounds[i], &bits, 4);
+    }
+    m_boundsMin = glm::vec3(bounds[0], bounds[1], bounds[2]);
+    m_boundsMax = glm::vec3(bounds[3], bounds[4], bounds[5]);
+    const quint64 vertexOffset = qFromLittleEndian<quint64>(data + 52);
+    const quint64 vertexBytes = qFromLittleEndian<quint64>(data + 60);
+    const quint64 indexOffset = qFromLittleEndian<quint64>(data + 68);
+    const quint64 indexBytes = qFromLittleEndian<quint64>(data + 76);
+
+    //偏移和长度先按无符号数和文件大小比, 转成qint64以后不会是负数, 相加也不会溢出
+    if(m_vertexCount < 0 || m_indexCount < 0 || m_vertexStride < 0 || attributeCount < 0
+            || HeaderSize + qint64(attributeCount) * AttributeSize > size
+            || vertexOffset > quint64(size) || vertexBytes > quint64(size) - vertexOffset
+            || indexOffset > quint64(size) || indexBytes > quint64(size) - indexOffset
+            || (m_indexType != GL_UNSIGNED_SHORT && m_indexType != GL_UNSIGNED_INT))
+        return false;
+    m_vertexOffset = qint64(vertexOffset);
+    m_vertexBytes = qint64(vertexBytes);
+    m_indexOffset = qint64(indexOffset);
+    m_indexBytes = qint64(indexBytes);
+    const int indexSize = m_indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    if(m_vertexBytes != qint64(m_vertexCount) * m_vertexStride || qint64(m_indexCount) * indexSize > m_indexBytes)
+        return false;
+
+    m_attributes.resize(attributeCount);
+    for(int i=0; i < attributeCount; ++i)
+    {
+        const uchar *a = data + HeaderSize + i * AttributeSize;
+        m_attributes[i].location = qFromLittleEndian<quint32>(a);
+        m_attributes[i].components = GLint(qFromLittleEndian<quint32>(a + 4));
+        m_attributes[i].type = qFromLittleEndian<quint32>(a + 8);
+        m_attributes[i].normalized = GLboolean(qFromLittleEndian<quint32>(a + 12));
+        m_attributes[i].offset = qFromLittleEndian<quint32>(a + 16);
+        if(!validAttribute(m_attributes[i], m_vertexStride))
+            return false;
+        //同一个location出现两次时后一个会覆盖前一个的glVertexAttribPointer
+        for(int j=0; j < i; ++j)
+        {
+            if(m_attributes[j].location == m_attributes[i].location)
+                return false;
+        }
+    }
+
+    //版本1的文件只有一级
+    m_lods.assign(1, MeshLod{ 0, unsigned(m_indexCount), 0.0f });
+    if(data[VersionByte] == '2')
+    {
+        const qint64 table = HeaderSize + qint64(attributeCount) * AttributeSize;
+        if(table + 4 > size)
+            return false;
+        const int lodCount = int(qFromLittleEndian<quint32>(data + table));
+        if(lodCount < 1 || lodCount > MaxMeshLods || table + 4 + qint64(lodCount) * LodSize > size)
+            return false;
+        m_lods.resize(lodCount);
+        for(int i=0; i < lodCount; ++i)
+        {
+            const uchar *l = data + table + 4 + i * LodSize;
+            m_lods[i].firstIndex = qFromLittleEndian<quint32>(l);
+            m_lods[i].indexCount = qFromLittleEndian<quint32>(l + 4);
+            const quint32 bits = qFromLittleEndian<quint32>(l + 8);
+            memcpy(&m_lods[i].error, &bits, 4);
+            if(quint64(m_lods[i].firstIndex) + m_lods[i].indexCount > quint64(m_indexCount) || m_lods[i].indexCount % 3 != 0)
+                return false;
+        }
+    }
+
+    m_data = data;
+    m_size = size;
+
+    //索引只在这里检查一次, 之后拾取/包围盒和GPU直接用; 失败时open/load会close
+    for(int i=0; i < m_indexCount; ++i)
+    {
+        if(index(i) >= unsigned(m_vertexCount))
+            return false;
+    }
+    return true;
+}
+
+unsigned MeshFile::index(int i) const
+{
+    if(m_indexType == GL_UNSIGNED_SHORT)
+        return qFromLittleEndian<quint16>(indexData() + i * 2);
+    return qFromLittleEndian<quint32>(indexData() + i * 4);
+}
+
+//snorm16位置的反量化参数: 包围盒中心和半边长, 退化的轴用1避免除0
+static void snormDequantization(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, glm::vec3 &scale, glm::vec3 &offset)
+{
+    offset = (boundsMin + boundsMax) * 0.5f;
+    scale = (boundsMax - boundsMin) * 0.5f;
+    for(int k=0; k < 3; ++k)
+    {
+        if(scale[k] <= 0.0f)
+            scale[k] = 1.0f;
+    }
+}
+
+static const MeshAttribute *findAttribute(const std::vector<MeshAttribute> &attributes, GLuint location)
+{
+    for(const MeshAttribute &attribute : attributes)
+    {
+        if(attribute.location == location)
+            return &attribute;
+    }
+    return nullptr;
+}
+
+glm::vec3 MeshFile::position(unsigned vertex) const
+{
+    const MeshAttribute *attribute = findAttribute(m_attributes, PositionLocation);
+    if(attribute == nullptr)
+        return glm::vec3(0.0f);
+
+    const uchar *p = vertexData() + vertex * m_vertexStride + attribute->offset;
+    glm::vec3 v(0.0f);
+    if(attribute->type == GL_FLOAT)
+    {
+        memcpy(&v, p, sizeof(v));
+    }
+    else
+    {
+        //3个16位分量, 第4个不一定在顶点里
+        glm::uint64 packed = 0;
+        memcpy(&packed, p, 6);
+        v = glm::vec3(attribute->type == GL_HALF_FLOAT ? glm::unpackHalf4x16(packed) : glm::unpackSnorm4x16(packed));
+    }
+    return v * positionScale() + positionOffset();
+}
+
+glm::vec3 MeshFile::positionScale() const
+{
+    const MeshAttribute *attribute = findAttribute(m_attributes, PositionLocation);
+    if(attribute == nullptr || attribute->type != GL_SHORT)
+        return glm::vec3(1.0f);
+    glm::vec3 scale, offset;
+    snormDequantization(m_boundsMin, m_boundsMax, scale, offset);
+    return scale;
+}
+
+glm::vec3 MeshFile::positionOffset() const
+{
+    const MeshAttribute *attribute = findAttribute(m_attributes, PositionLocation);
+    if(attribute == nullptr || attribute->type != GL_SHORT)
+        return glm::vec3(0.0f);
+    glm::vec3 scale, offset;
+    snormDequantization(m_boundsMin, m_boundsMax, scale, offset);
+    return offset;
+}
+
+bool VertexFormat::parse(const QString &text, VertexFormat &format)
+{
+    format = VertexFormat();
+    for(const QString &item : text.split(',', QString::SkipEmptyParts))
+    {
+        const QString name = item.trimmed();
+        if(name == QLatin1String("float"))
+            format = VertexFormat();
+        else if(name == QLatin1String("half"))
+            format.position = HalfPosition;
+        else if(name == QLatin1String("snorm16"))
+            format.position = Snorm16Position;
+        else if(name == QLatin1String("unorm16"))
+            format.texCoord = Unorm16TexCoord;
+        else if(name == QLatin1String("oct"))
+            format.normal = OctahedralNormal;
+        else if(name == QLatin1String("3x10"))
+            format.normal = Snorm10Normal;
+        else
+            return false;
+    }
+    return true;
+}
+
+QString VertexFormat::name() const
+{
+    static const char *positions[] = { "float", "half", "snorm16" };
+    static const char *texCoords[] = { "float", "unorm16" };
+    static const char *normals[] = { "float", "oct", "3x10" };
+    return QStringLiteral("%1,%2,%3").arg(positions[position], texCoords[texCoord], normals[normal]);
+}
+
+//顶点按format编码, 属性顺序是位置/纹理坐标/法线, 每个都4字节对齐; 少于65536个顶点时索引用16位
+QByteArray MeshFile::serialize(const Mesh &mesh, const VertexFormat &requested)
+{
+    VertexFormat format = requested;
+    if(format.texCoord == VertexFormat::Unorm16TexCoord)
+    {
+        //unorm16只能表示[0, 1], 平铺的纹理坐标退回float
+        for(const MeshVertex &vertex : mesh.vertices)
+        {
+            if(glm::any(glm::lessThan(vertex.texCoord, glm::vec2(0.0f))) || glm::any(glm::greaterThan(vertex.texCoord, glm::vec2(1.0f))))
+            {
+                qDebug("mesh file: texture coordinates outside [0, 1], keeping them as float");
+                format.texCoord = VertexFormat::FloatTexCoord;
+                break;
+            }
+        }
+    }
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for(const MeshVertex &vertex : mesh.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    if(mesh.vertices.empty())
+        boundsMin = boundsMax = glm::vec3(0.0f);
+
+    std::vector<MeshAttribute> attributes;
+    GLuint stride = 0;
+    switch(format.position)
+    {
+    case VertexFormat::FloatPosition: attributes.push_back({ PositionLocation, 3, GL_FLOAT, GL_FALSE, stride }); stride += 12; break;
+    case VertexFormat::HalfPosition: attributes.push_back({ PositionLocation, 3, GL_HALF_FLOAT, GL_FALSE, stride }); stride += 8; break;
+    case VertexFormat::Snorm16Position: attributes.push_back({ PositionLocation, 3, GL_SHORT, GL_TRUE, stride }); stride += 8; break;
+    }
+    switch(format.texCoord)
+    {
+    case VertexFormat::FloatTexCoord: attributes.push_back({ TexCoordLocation, 2, GL_FLOAT, GL_FALSE, stride }); stride += 8; break;
+    case VertexFormat::Unorm16TexCoord: attributes.push_back({ TexCoordLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride }); stride += 4; break;
+    }
+    switch(format.normal)
+    {
+    case VertexFormat::FloatNormal: attributes.push_back({ NormalLocation, 3, GL_FLOAT, GL_FALSE, stride }); stride += 12; break;
+    case VertexFormat::OctahedralNormal: attributes.push_back({ NormalLocation, 2, GL_SHORT, GL_TRUE, stride }); stride += 4; break;
+    case VertexFormat::Snorm10Normal: attributes.push_back({ NormalLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride }); stride += 4; break;
+    }
+    const int attributeCount = int(attributes.size());
+    std::vector<MeshLod> lods = mesh.lods;
+    if(lods.empty())
+        lods.push_back({ 0, unsigned(mesh.indices.size()), 0.0f });
+    const int lodCount = int(lods.size());
+
+    const bool shortIndices = mesh.vertices.size() <= std::numeric_limits<quint16>::max() + 1u;
+    const qint64 vertexBytes = qint64(mesh.vertices.size()) * stride;
+    const qint64 indexBytes = qint64(mesh.indices.size() * (shortIndices ? 2 : 4));
+    const qint64 lodTable = HeaderSize + attributeCount * AttributeSize;
+    const qint64 vertexOffset = align(lodTable + 4 + lodCount * LodSize);
+    const qint64 indexOffset = align(vertexOffset + vertexBytes);
+
+    QByteArray data(int(indexOffset + indexBytes), '\0');
+    uchar *out = reinterpret_cast<uchar *>(data.data());
+    memcpy(out, fileIdentifier, 8);
+    qToLittleEndian<quint32>(quint32(mesh.vertices.size()), out + 8);
+    qToLittleEndian<quint32>(quint32(mesh.indices.size()), out + 12);
+    qToLittleEndian<quint32>(shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, out + 16);
+    qToLittleEndian<quint32>(stride, out + 20);
+    qToLittleEndian<quint32>(quint32(attributeCount), out + 24);
+    const float bounds[6] = { boundsMin.x, boundsMin.y, boundsMin.z, boundsMax.x, boundsMax.y, boundsMax.z };
+    for(int i=0; i < 6; ++i)
+    {
+        quint32 bits;
+        memcpy(&bits, &bounds[i], 4);
+        qToLittleEndian<quint32>(bits, out + 28 + i * 4);
+    }
+    qToLittleEndian<quint64>(quint64(vertexOffset), out + 52);
+    qToLittleEndian<quint64>(quint64(vertexBytes), out + 60);
+    qToLittleEndian<quint64>(quint64(indexOffset), out + 68);
+    qToLittleEndian<quint64>(quint64(indexBytes), out + 76);
+
+    for(int i=0; i < attributeCount; ++i)
+    {
+        uchar *a = out + HeaderSize + i * AttributeSize;
+        qToLittleEndian<quint32>(attributes[i].location, a);
+        qToLittleEndian<quint32>(quint32(attributes[i].components), a + 4);
+        qToLittleEndian<quint32>(attributes[i].type, a + 8);
+        qToLittleEndian<quint32>(attributes[i].normalized, a + 12);
+        qToLittleEndian<quint32>(attributes[i].offset, a + 16);
+    }
+    qToLittleEndian<quint32>(quint32(lodCount), out + lodTable);
+    for(int i=0; i < lodCount; ++i)
+    {
+        uchar *l = out + lodTable + 4 + i * LodSize;
+        qToLittleEndian<quint32>(lods[i].firstIndex, l);
+        qToLittleEndian<quint32>(lods[i].indexCount, l + 4);
+        quint32 bits;
+        memcpy(&bits, &lods[i].error, 4);
+        qToLittleEndian<quint32>(bits, l + 8);
+    }
+
+    //顶点数据按本机字节序写, 和GPU读的一致(目前支持的平台都是小端)
+    if(!mesh.vertices.empty())
+    {
+        const MeshVertex *v = mesh.vertices.data();
+        const size_t count = mesh.vertices.size();
+        uchar *vertexOut = out + vertexOffset;
+        glm::vec3 scale, offset;
+        snormDequantization(boundsMin, boundsMax, scale, offset);
+        switch(format.position)
+        {
+        case VertexFormat::FloatPosition: VertexPacking::packFloat3(&v->position, sizeof(MeshVertex), count, vertexOut + attributes[0].offset, stride); break;
+        case VertexFormat::HalfPosition: VertexPacking::packHalf3(&v->position, sizeof(MeshVertex), count, vertexOut + attributes[0].offset, stride); break;
+        case VertexFormat::Snorm16Position: VertexPacking::packSnorm16x3(&v->position, sizeof(MeshVertex), count, scale, offset, vertexOut + attributes[0].offset, stride); break;
+        }
+        switch(format.texCoord)
+        {
+        case VertexFormat::FloatTexCoord: VertexPacking::packFloat2(&v->texCoord, sizeof(MeshVertex), count, vertexOut + attributes[1].offset, stride); break;
+        case VertexFormat::Unorm16TexCoord: VertexPacking::packUnorm16x2(&v->texCoord, sizeof(MeshVertex), count, vertexOut + attributes[1].offset, stride); break;
+        }
+        switch(format.normal)
+        {
+        case VertexFormat::FloatNormal: VertexPacking::packFloat3(&v->normal, sizeof(MeshVertex), count, vertexOut + attributes[2].offset, stride); break;
+        case VertexFormat::OctahedralNormal: VertexPacking::packOctahedral(&v->normal, sizeof(MeshVertex), count, vertexOut + attributes[2].offset, stride); break;
+        case VertexFormat::Snorm10Normal: VertexPacking::packSnorm3x10(&v->normal, sizeof(MeshVertex), count, vertexOut + attributes[2].offset, stride); break;
+        }
+    }
+    for(size_t i=0; i < mesh.indices.size(); ++i)
+    {
+        if(shortIndices)
+            qToLittleEndian<quint16>(quint16(mesh.indices[i]), out + indexOffset + i * 2);
+        else
+            qToLittleEndian<quint32>(mesh.indices[i], out + indexOffset + i * 4);
+    }
+    return data;
+}
+
+bool MeshFile::write(const QString &fileName, const Mesh &mesh, const VertexFormat &format)
+{
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(serialize(mesh, format));
+    if(!file.commit())
+    {
+        qWarning() << "mesh file: cannot write" << fileName;
+        return false;
+    }
+    return true;
+}
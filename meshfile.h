@@ -0,0 +1,112 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <qopengl.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshbuilder.h"
+
+//glVertexAttribPointer需要的全部参数, offset是在一个顶点内的字节偏移
+struct MeshAttribute
+{
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+//顶点缓冲里每个属性的编码方式, 默认全是float(32字节一个顶点).
+//压缩的位置按网格包围盒做反量化, 见MeshFile::positionScale/positionOffset
+struct VertexFormat
+{
+    enum PositionFormat { FloatPosition, HalfPosition, Snorm16Position };
+    enum TexCoordFormat { FloatTexCoord, Unorm16TexCoord };
+    enum NormalFormat { FloatNormal, OctahedralNormal, Snorm10Normal };
+
+    PositionFormat position = FloatPosition;
+    TexCoordFormat texCoord = FloatTexCoord;
+    NormalFormat normal = FloatNormal;
+
+    //逗号分隔, 每项改一个属性: float(全部), half, snorm16, unorm16, oct, 3x10; 例如"snorm16,unorm16,oct"
+    static bool parse(const QString &text, VertexFormat &format);
+    QString name() const;
+};
+
+//二进制网格容器(.gmesh), 整个文件映射进内存后顶点/索引数据可以直接交给glBufferData:
+//  0   8字节标识
+//  8   vertexCount, indexCount, indexType, vertexStride, attributeCount (各4字节)
+//  28  boundsMin[3], boundsMax[3] (float)
+//  52  vertexOffset, vertexBytes, indexOffset, indexBytes (各8字节)
+//  84  attributeCount个属性描述, 每个location/components/type/normalized/offset各4字节
+//  然后是LOD表: lodCount(4字节), 每级firstIndex, indexCount(各4字节), error(float); 各级索引连续放在同一个索引区里
+//  然后是顶点和索引数据, 起点都按Alignment字节对齐
+//所有整数都是小端序. 标识里的版本是1的旧文件没有LOD表, 读出来只有一级.
+class MeshFile
+{
+public:
+    enum { Alignment = 64, HeaderSize = 84, AttributeSize = 20, LodSize = 12 };
+    //shader里的location, 2~6被实例矩阵和材质占用
+    enum { PositionLocation = 0, TexCoordLocation = 1, NormalLocation = 7 };
+
+    //整个文件映射进来, 只解析头, 数据不拷贝
+    bool open(const QString &fileName);
+    //和open一样解析, 数据留在data里(例如刚在内存里编码出来的网格)
+    bool load(const QByteArray &data);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    static QByteArray serialize(const Mesh &mesh, const VertexFormat &format = VertexFormat());
+    //QSaveFile写临时文件再改名
+    static bool write(const QString &fileName, const Mesh &mesh, const VertexFormat &format = VertexFormat());
+
+    int vertexCount() const { return m_vertexCount; }
+    //所有LOD的索引加起来, LOD0的是lods()[0].indexCount
+    int indexCount() const { return m_indexCount; }
+    //至少一级, 从精细到粗糙
+    const std::vector<MeshLod> &lods() const { return m_lods; }
+    GLenum indexType() const { return m_indexType; }
+    int vertexStride() const { return m_vertexStride; }
+    const std::vector<MeshAttribute> &attributes() const { return m_attributes; }
+    glm::vec3 boundsMin() const { return m_boundsMin; }
+    glm::vec3 boundsMax() const { return m_boundsMax; }
+
+    const uchar *vertexData() const { return m_data + m_vertexOffset; }
+    qint64 vertexBytes() const { return m_vertexBytes; }
+    const uchar *indexData() const { return m_data + m_indexOffset; }
+    qint64 indexBytes() const { return m_indexBytes; }
+    qint64 fileSize() const { return m_size; }
+
+    unsigned index(int i) const;
+    //location 0的位置(已经反量化), 拾取和包围盒用
+    glm::vec3 position(unsigned vertex) const;
+    //shader里 位置 = 属性 * positionScale + positionOffset; 只有snorm16的位置不是(1, 0)
+    glm::vec3 positionScale() const;
+    glm::vec3 positionOffset() const;
+
+private:
+    bool parse(const uchar *data, qint64 size);
+
+    QFile m_file;
+    QByteArray m_owned;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+
+    int m_vertexCount = 0;
+    int m_indexCount = 0;
+    GLenum m_indexType = 0;
+    int m_vertexStride = 0;
+    std::vector<MeshAttribute> m_attributes;
+    std::vector<MeshLod> m_lods;
+    glm::vec3 m_boundsMin, m_boundsMax;
+    qint64 m_vertexOffset = 0, m_vertexBytes = 0;
+    qint64 m_indexOffset = 0, m_indexBytes = 0;
+};
+
+#endif // MESHFILE_H
@@ -0,0 +1,385 @@
+#include "meshimporter.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtEndian>
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static void setError(QString *error, const QString &message)
+{
+    if(error)
+        *error = message;
+}
+
+bool MeshImporter::import(const QString &fileName, Mesh &mesh, MeshBuilder::Stats *stats, QString *error)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        setError(error, file.errorString());
+        return false;
+    }
+    const QByteArray data = file.readAll();
+
+    std::vector<MeshVertex> triangles;
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    bool ok = false;
+    if(suffix == QLatin1String("obj"))
+        ok = parseObj(data, triangles, error);
+    else if(suffix == QLatin1String("gltf") || suffix == QLatin1String("glb"))
+        ok = parseGltf(data, QFileInfo(fileName).absolutePath(), triangles, error);
+    else
+        setError(error, QStringLiteral("unknown mesh format: ") + suffix);
+
+    if(!ok)
+        return false;
+    mesh = MeshBuilder::build(triangles, stats);
+    return true;
+}
+
+//OBJ的索引从1开始, 负数表示从当前列表末尾往前数
+static int objIndex(long value, size_t count)
+{
+    if(value > 0)
+        return int(value - 1);
+    if(value < 0)
+        return int(long(count) + value);
+    return -1;
+}
+
+bool MeshImporter::parseObj(const QByteArray &text, std::vector<MeshVertex> &triangles, QString *error)
+{
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<MeshVertex> polygon;
+    bool hasNormals = true;
+
+    //QByteArray末尾总有'\0', strtof/strtol不会读出界
+    const char *p = text.constData();
+    const char *end = p + text.size();
+    while(p < end)
+    {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+        if(lineEnd == nullptr)
+            lineEnd = end;
+
+        if(p[0] == 'v' && p[1] == ' ')
+        {
+            char *next = const_cast<char *>(p + 2);
+            glm::vec3 v;
+            v.x = strtof(next, &next);
+            v.y = strtof(next, &next);
+            v.z = strtof(next, &next);
+            positions.push_back(v);
+        }
+        else if(p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+        {
+            char *next = const_cast<char *>(p + 3);
+            glm::vec2 t;
+            t.x = strtof(next, &next);
+            t.y = strtof(next, &next);
+            texCoords.push_back(t);
+        }
+        else if(p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+        {
+            char *next = const_cast<char *>(p + 3);
+            glm::vec3 n;
+            n.x = strtof(next, &next);
+            n.y = strtof(next, &next);
+            n.z = strtof(next, &next);
+            normals.push_back(n);
+        }
+        else if(p[0] == 'f' && p[1] == ' ')
+        {
+            //每个角是 v, v/vt, v//vn 或 v/vt/vn
+            polygon.clear();
+            char *next = const_cast<char *>(p + 2);
+            while(next < lineEnd)
+            {
+                while(next < lineEnd && (*next == ' ' || *next == '\t' || *next == '\r'))
+                    ++next;
+                if(next >= lineEnd)
+                    break;
+
+                MeshVertex vertex = {};
+                char *number = next;
+                const int v = objIndex(strtol(number, &next, 10), positions.size());
+                if(next == number)
+                    break;
+                int vt = -1, vn = -1;
+                if(*next == '/')
+                {
+                    ++next;
+                    if(*next != '/')
+                        vt = objIndex(strtol(next, &next, 10), texCoords.size());
+                    if(*next == '/')
+                    {
+                        ++next;
+                        vn = objIndex(strtol(next, &next, 10), normals.size());
+                    }
+                }
+                if(v < 0 || v >= int(positions.size()) || vt >= int(texCoords.size()) || vn >= int(normals.size()))
+                {
+                    setError(error, QStringLiteral("obj: face index out of range"));
+                    return false;
+                }
+                vertex.position = positions[v];
+                if(vt >= 0)
+                    vertex.texCoord = texCoords[vt];
+                if(vn >= 0)
+                    vertex.normal = normals[vn];
+                else
+                    hasNormals = false;
+                polygon.push_back(vertex);
+            }
+            for(size_t i=2; i < polygon.size(); ++i)
+            {
+                triangles.push_back(polygon[0]);
+                triangles.push_back(polygon[i - 1]);
+                triangles.push_back(polygon[i]);
+            }
+        }
+        p = lineEnd + 1;
+    }
+
+    if(triangles.empty())
+    {
+        setError(error, QStringLiteral("obj: no faces"));
+        return false;
+    }
+    if(!hasNormals)
+        MeshBuilder::computeFaceNormals(triangles);
+    return true;
+}
+
+namespace
+{
+struct GltfBuffers
+{
+    std::vector<QByteArray> buffers;
+    QJsonArray views;
+    QJsonArray accessors;
+};
+
+//返回accessor第一个元素的指针和步长, 不合法时返回nullptr
+const char *gltfAccessor(const GltfBuffers &gltf, int index, int &count, int &componentType,
+                         QString &type, bool &normalized, int &stride)
+{
+    if(index < 0 || index >= gltf.accessors.size())
+        return nullptr;
+    const QJsonObject accessor = gltf.accessors[index].toObject();
+    const int viewIndex = accessor.value("bufferView").toInt(-1);
+    if(viewIndex < 0 || viewIndex >= gltf.views.size())
+        return nullptr;
+    const QJsonObject view = gltf.views[viewIndex].toObject();
+    const int bufferIndex = view.value("buffer").toInt(-1);
+    if(bufferIndex < 0 || bufferIndex >= int(gltf.buffers.size()))
+        return nullptr;
+
+    count = accessor.value("count").toInt();
+    componentType = accessor.value("componentType").toInt();
+    type = accessor.value("type").toString();
+    normalized = accessor.value("normalized").toBool();
+
+    const int components = type == QLatin1String("SCALAR") ? 1 : type == QLatin1String("VEC2") ? 2
+                         : type == QLatin1String("VEC3") ? 3 : type == QLatin1String("VEC4") ? 4 : 0;
+    const int componentSize = componentType == 5126 || componentType == 5125 ? 4
+                            : componentType == 5123 || componentType == 5122 ? 2 : 1;
+    const int elementSize = components * componentSize;
+    stride = view.value("byteStride").toInt(elementSize);
+
+    //步长不能让相邻元素重叠, 偏移不能是负数; 先和缓冲大小比再相加, 避免double转整数溢出
+    const QByteArray &buffer = gltf.buffers[bufferIndex];
+    const double viewOffset = view.value("byteOffset").toDouble();
+    const double accessorOffset = accessor.value("byteOffset").toDouble();
+    if(components == 0 || count <= 0 || stride < elementSize
+            || !(viewOffset >= 0.0 && viewOffset <= buffer.size()) || !(accessorOffset >= 0.0 && accessorOffset <= buffer.size()))
+        return nullptr;
+    const qint64 offset = qint64(viewOffset) + qint64(accessorOffset);
+    if(offset + qint64(count - 1) * stride + elementSize > buffer.size())
+        return nullptr;
+    return buffer.constData() + offset;
+}
+
+float gltfComponent(const char *p, int componentType, bool normalized)
+{
+    switch(componentType)
+    {
+    case 5126:
+    {
+        const quint32 bits = qFromLittleEndian<quint32>(p);
+        float value;
+        memcpy(&value, &bits, 4);
+        return value;
+    }
+    case 5121: return normalized ? quint8(*p) / 255.0f : float(quint8(*p));
+    case 5123: return normalized ? qFromLittleEndian<quint16>(p) / 65535.0f : float(qFromLittleEndian<quint16>(p));
+    default: return 0.0f;
+    }
+}
+}
+
+bool MeshImporter::parseGltf(const QByteArray &data, const QString &baseDir,
+                             std::vector<MeshVertex> &triangles, QString *error)
+{
+    //.glb: 12字节文件头, 然后是JSON块和可选的BIN块
+    QByteArray json = data;
+    QByteArray glbBinary;
+    if(data.startsWith("glTF"))
+    {
+        if(data.size() < 20)
+        {
+            setError(error, QStringLiteral("glb: truncated"));
+            return false;
+        }
+        const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+        qint64 offset = 12;
+        while(offset + 8 <= data.size())
+        {
+            const quint32 length = qFromLittleEndian<quint32>(p + offset);
+            const quint32 type = qFromLittleEndian<quint32>(p + offset + 4);
+            if(offset + 8 + length > qint64(data.size()))
+                break;
+            if(type == 0x4E4F534A)          //"JSON"
+                json = data.mid(int(offset + 8), int(length));
+            else if(type == 0x004E4942)     //"BIN\0"
+                glbBinary = data.mid(int(offset + 8), int(length));
+            offset += 8 + length;
+        }
+    }
+
+    QJsonParseError parseError;
+    const QJsonObject root = QJsonDocument::fromJson(json, &parseError).object();
+    if(parseError.error != QJsonParseError::NoError)
+    {
+        setError(error, QStringLiteral("gltf: ") + parseError.errorString());
+        return false;
+    }
+
+    GltfBuffers gltf;
+    gltf.views = root.value("bufferViews").toArray();
+    gltf.accessors = root.value("accessors").toArray();
+    for(const QJsonValue &value : root.value("buffers").toArray())
+    {
+        const QString uri = value.toObject().value("uri").toString();
+        if(uri.isEmpty())
+        {
+            gltf.buffers.push_back(glbBinary);
+        }
+        else if(uri.startsWith(QLatin1String("data:")))
+        {
+            gltf.buffers.push_back(QByteArray::fromBase64(uri.mid(uri.indexOf(',') + 1).toLatin1()));
+        }
+        else
+        {
+            QFile file(QDir(baseDir).filePath(uri));
+            if(!file.open(QIODevice::ReadOnly))
+            {
+                setError(error, QStringLiteral("gltf: cannot open ") + uri);
+                return false;
+            }
+            gltf.buffers.push_back(file.readAll());
+        }
+    }
+
+    for(const QJsonValue &meshValue : root.value("meshes").toArray())
+    {
+        for(const QJsonValue &primitiveValue : meshValue.toObject().value("primitives").toArray())
+        {
+            const QJsonObject primitive = primitiveValue.toObject();
+            if(primitive.value("mode").toInt(4) != 4)
+                continue;
+            const QJsonObject attributes = primitive.value("attributes").toObject();
+
+            int count, componentType, stride;
+            QString type;
+            bool normalized;
+            const char *positions = gltfAccessor(gltf, attributes.value("POSITION").toInt(-1), count, componentType, type, normalized, stride);
+            if(positions == nullptr || componentType != 5126 || type != QLatin1String("VEC3"))
+            {
+                setError(error, QStringLiteral("gltf: primitive without float POSITION"));
+                return false;
+            }
+            const int vertexCount = count;
+            std::vector<MeshVertex> vertices(vertexCount, MeshVertex());
+            for(int i=0; i < vertexCount; ++i)
+            {
+                const char *v = positions + i * stride;
+                vertices[i].position = glm::vec3(gltfComponent(v, 5126, false), gltfComponent(v + 4, 5126, false), gltfComponent(v + 8, 5126, false));
+            }
+
+            const char *normals = gltfAccessor(gltf, attributes.value("NORMAL").toInt(-1), count, componentType, type, normalized, stride);
+            const bool hasNormals = normals && componentType == 5126 && type == QLatin1String("VEC3") && count == vertexCount;
+            for(int i=0; hasNormals && i < vertexCount; ++i)
+            {
+                const char *n = normals + i * stride;
+                vertices[i].normal = glm::vec3(gltfComponent(n, 5126, false), gltfComponent(n + 4, 5126, false), gltfComponent(n + 8, 5126, false));
+            }
+
+            const char *texCoords = gltfAccessor(gltf, attributes.value("TEXCOORD_0").toInt(-1), count, componentType, type, normalized, stride);
+            if(texCoords && type == QLatin1String("VEC2") && count == vertexCount
+                    && (componentType == 5126 || componentType == 5123 || componentType == 5121))
+            {
+                const int size = componentType == 5126 ? 4 : componentType == 5123 ? 2 : 1;
+                for(int i=0; i < vertexCount; ++i)
+                {
+                    const char *t = texCoords + i * stride;
+                    vertices[i].texCoord = glm::vec2(gltfComponent(t, componentType, normalized), gltfComponent(t + size, componentType, normalized));
+                }
+            }
+
+            const size_t first = triangles.size();
+            //有indices时必须是合法的无符号整数标量, 没有indices才按顶点顺序每3个一个三角形
+            if(primitive.contains("indices"))
+            {
+                const char *indices = gltfAccessor(gltf, primitive.value("indices").toInt(-1), count, componentType, type, normalized, stride);
+                if(indices == nullptr || type != QLatin1String("SCALAR")
+                        || (componentType != 5121 && componentType != 5123 && componentType != 5125))
+                {
+                    setError(error, QStringLiteral("gltf: invalid indices accessor"));
+                    return false;
+                }
+                for(int i=0; i + 2 < count; i += 3)
+                {
+                    for(int k=0; k < 3; ++k)
+                    {
+                        const char *p = indices + (i + k) * stride;
+                        const quint32 index = componentType == 5125 ? qFromLittleEndian<quint32>(p)
+                                            : componentType == 5123 ? qFromLittleEndian<quint16>(p) : quint8(*p);
+                        if(index >= quint32(vertexCount))
+                        {
+                            setError(error, QStringLiteral("gltf: index out of range"));
+                            return false;
+                        }
+                        triangles.push_back(vertices[index]);
+                    }
+                }
+            }
+            else
+            {
+                triangles.insert(triangles.end(), vertices.begin(), vertices.begin() + vertexCount / 3 * 3);
+            }
+
+            if(!hasNormals)
+            {
+                std::vector<MeshVertex> added(triangles.begin() + first, triangles.end());
+                MeshBuilder::computeFaceNormals(added);
+                std::copy(added.begin(), added.end(), triangles.begin() + first);
+            }
+        }
+    }
+
+    if(triangles.empty())
+    {
+        setError(error, QStringLiteral("gltf: no triangle primitives"));
+        return false;
+    }
+    return true;
+}
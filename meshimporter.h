@@ -0,0 +1,28 @@
+#ifndef MESHIMPORTER_H
+#define MESHIMPORTER_H
+
+#include <QString>
+#include <QByteArray>
+
+#include <vector>
+
+#include "meshbuilder.h"
+
+//把文本/交换格式的模型转成三角形列表, 再交给MeshBuilder焊接和重排.
+//OBJ: v/vt/vn/f, 多边形按扇形拆成三角形, 没有vn时用面法线.
+//glTF 2.0(.gltf/.glb): 所有mesh里mode为TRIANGLES的primitive, 读POSITION/NORMAL/TEXCOORD_0和indices,
+//不处理节点变换和材质, 属性只支持float(纹理坐标另外支持归一化的unsigned byte/short).
+class MeshImporter
+{
+public:
+    //按扩展名选择格式, 失败时error里是原因
+    static bool import(const QString &fileName, Mesh &mesh, MeshBuilder::Stats *stats = nullptr,
+                       QString *error = nullptr);
+
+    static bool parseObj(const QByteArray &text, std::vector<MeshVertex> &triangles, QString *error);
+    //baseDir用来找.gltf里外部的.bin
+    static bool parseGltf(const QByteArray &data, const QString &baseDir,
+                          std::vector<MeshVertex> &triangles, QString *error);
+};
+
+#endif // MESHIMPORTER_H
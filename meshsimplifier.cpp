@@ -0,0 +1,278 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+//对称4x4矩阵的上三角和累计的权重(面积): 误差 = p^T Q p / weight
+struct Quadric
+{
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    double weight;
+};
+
+//平面n·p + d = 0, 按面积加权
+Quadric planeQuadric(const glm::dvec3 &n, double d, double w)
+{
+    Quadric q;
+    q.a00 = w * n.x * n.x; q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z; q.a03 = w * n.x * d;
+    q.a11 = w * n.y * n.y; q.a12 = w * n.y * n.z; q.a13 = w * n.y * d;
+    q.a22 = w * n.z * n.z; q.a23 = w * n.z * d;
+    q.a33 = w * d * d;
+    q.weight = w;
+    return q;
+}
+
+void accumulate(Quadric &q, const Quadric &o)
+{
+    q.a00 += o.a00; q.a01 += o.a01; q.a02 += o.a02; q.a03 += o.a03;
+    q.a11 += o.a11; q.a12 += o.a12; q.a13 += o.a13;
+    q.a22 += o.a22; q.a23 += o.a23;
+    q.a33 += o.a33;
+    q.weight += o.weight;
+}
+
+//两个顶点的二次误差之和在p处的值
+double evaluate(const Quadric &a, const Quadric &b, const glm::vec3 &p)
+{
+    Quadric q = a;
+    accumulate(q, b);
+    if(q.weight <= 0.0)
+        return 0.0;
+    const double x = p.x, y = p.y, z = p.z;
+    const double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+            + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+            + 2.0 * (q.a03 * x + q.a13 * y + q.a23 * z) + q.a33;
+    return std::max(e, 0.0) / q.weight;
+}
+
+//把from合并到to上
+struct Collapse
+{
+    unsigned from;
+    unsigned to;
+    double cost;
+};
+
+//每级至少保留的三角形, 再少就不值得多一级
+const size_t MinLodTriangles = 16;
+}
+
+std::vector<unsigned> MeshSimplifier::simplify(const std::vector<glm::vec3> &positions, const std::vector<unsigned> &indices,
+                                               size_t targetIndexCount, float *error)
+{
+    std::vector<unsigned> result(indices);
+    if(error)
+        *error = 0.0f;
+    const size_t vertexCount = positions.size();
+    if(result.size() <= targetIndexCount || vertexCount == 0)
+        return result;
+
+    //位置完全相同的顶点归成一组, 组里不止一个顶点的是接缝
+    std::vector<unsigned> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        const glm::vec3 &p = positions[a], &q = positions[b];
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    });
+    std::vector<unsigned> group(vertexCount);
+    std::vector<unsigned> groupSize;
+    for(size_t k=0; k < vertexCount; ++k)
+    {
+        if(k == 0 || positions[order[k]] != positions[order[k - 1]])
+            groupSize.push_back(0);
+        group[order[k]] = unsigned(groupSize.size() - 1);
+        ++groupSize.back();
+    }
+    const size_t groupCount = groupSize.size();
+
+    //不能被合并掉的组: 接缝, 以及只属于一个三角形(边界)或者超过两个三角形(非流形)的边的端点
+    std::vector<unsigned char> locked(groupCount, 0);
+    for(size_t g=0; g < groupCount; ++g)
+        locked[g] = groupSize[g] > 1;
+    std::vector<unsigned long long> edges;
+    edges.reserve(result.size());
+    for(size_t i=0; i < result.size(); i += 3)
+    {
+        for(int k=0; k < 3; ++k)
+        {
+            const unsigned a = group[result[i + k]], b = group[result[i + (k + 1) % 3]];
+            if(a != b)
+                edges.push_back((static_cast<unsigned long long>(std::min(a, b)) << 32) | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for(size_t e=0; e < edges.size(); )
+    {
+        size_t run = e + 1;
+        while(run < edges.size() && edges[run] == edges[e])
+            ++run;
+        if(run - e != 2)
+        {
+            locked[edges[e] >> 32] = 1;
+            locked[edges[e] & 0xFFFFFFFFu] = 1;
+        }
+        e = run;
+    }
+
+    //每组的二次误差: 周围所有三角形所在平面, 按面积加权
+    std::vector<Quadric> quadrics(groupCount, Quadric());
+    for(size_t i=0; i < result.size(); i += 3)
+    {
+        const glm::dvec3 p0(positions[result[i]]), p1(positions[result[i + 1]]), p2(positions[result[i + 2]]);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        const double length = glm::length(n);
+        if(length == 0.0)
+            continue;
+        n /= length;
+        const Quadric q = planeQuadric(n, -glm::dot(n, p0), length * 0.5);
+        for(int k=0; k < 3; ++k)
+            accumulate(quadrics[group[result[i + k]]], q);
+    }
+
+    std::vector<unsigned> remap(vertexCount);
+    std::vector<unsigned char> passLocked(vertexCount);
+    std::vector<unsigned> adjacencyOffsets(vertexCount + 1), adjacencyCursor(vertexCount), adjacency;
+    std::vector<Collapse> collapses;
+    double maxCost = 0.0;
+    while(result.size() > targetIndexCount)
+    {
+        const size_t triangles = result.size() / 3;
+
+        //顶点 -> 用到它的三角形
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0u);
+        for(unsigned v : result)
+            ++adjacencyOffsets[v + 1];
+        for(size_t v=0; v < vertexCount; ++v)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        std::copy(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1, adjacencyCursor.begin());
+        adjacency.resize(result.size());
+        for(size_t t=0; t < triangles; ++t)
+        {
+            for(int k=0; k < 3; ++k)
+                adjacency[adjacencyCursor[result[t * 3 + k]]++] = unsigned(t);
+        }
+
+        //每条边取代价小的那个方向, 源顶点所在的组必须没锁
+        collapses.clear();
+        for(size_t i=0; i < result.size(); i += 3)
+        {
+            for(int k=0; k < 3; ++k)
+            {
+                const unsigned a = result[i + k], b = result[i + (k + 1) % 3];
+                const unsigned ga = group[a], gb = group[b];
+                if(ga == gb || (locked[ga] && locked[gb]))
+                    continue;
+                const double ab = locked[ga] ? std::numeric_limits<double>::max() : evaluate(quadrics[ga], quadrics[gb], positions[b]);
+                const double ba = locked[gb] ? std::numeric_limits<double>::max() : evaluate(quadrics[ga], quadrics[gb], positions[a]);
+                collapses.push_back(ab <= ba ? Collapse{ a, b, ab } : Collapse{ b, a, ba });
+            }
+        }
+        if(collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        //一轮里只做代价低的那一半, 合并过的顶点一圈邻居这一轮不再动, 翻面检查看到的都是当前的网格
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(passLocked.begin(), passLocked.end(), 0);
+        const size_t needed = triangles - targetIndexCount / 3;
+        const size_t considered = collapses.size() / 2 + 1;
+        size_t removed = 0;
+        for(size_t c=0; c < considered && removed < needed; ++c)
+        {
+            const Collapse &collapse = collapses[c];
+            const unsigned u = collapse.from, v = collapse.to;
+            if(passLocked[u])
+                continue;
+
+            //u挪到v之后留下来的三角形不能翻面
+            bool flips = false;
+            for(unsigned k=adjacencyOffsets[u]; k < adjacencyOffsets[u + 1] && !flips; ++k)
+            {
+                const unsigned *tri = &result[adjacency[k] * 3];
+                if(group[tri[0]] == group[v] || group[tri[1]] == group[v] || group[tri[2]] == group[v])
+                    continue;
+                glm::vec3 p[3], q[3];
+                for(int j=0; j < 3; ++j)
+                {
+                    p[j] = positions[tri[j]];
+                    q[j] = tri[j] == u ? positions[v] : p[j];
+                }
+                const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if(flips)
+                continue;
+
+            remap[u] = v;
+            for(unsigned k=adjacencyOffsets[u]; k < adjacencyOffsets[u + 1]; ++k)
+            {
+                const unsigned *tri = &result[adjacency[k] * 3];
+                bool degenerate = false;
+                for(int j=0; j < 3; ++j)
+                {
+                    passLocked[tri[j]] = 1;
+                    degenerate = degenerate || group[tri[j]] == group[v];
+                }
+                if(degenerate)
+                    ++removed;
+            }
+            accumulate(quadrics[group[v]], quadrics[group[u]]);
+            maxCost = std::max(maxCost, collapse.cost);
+        }
+        if(removed == 0)
+            break;
+
+        //去掉两个角落在同一位置的三角形
+        size_t out = 0;
+        for(size_t i=0; i < result.size(); i += 3)
+        {
+            const unsigned a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if(group[a] == group[b] || group[b] == group[c] || group[a] == group[c])
+                continue;
+            result[out++] = a;
+            result[out++] = b;
+            result[out++] = c;
+        }
+        result.resize(out);
+    }
+
+    if(error)
+        *error = float(std::sqrt(maxCost));
+    return result;
+}
+
+void MeshSimplifier::buildLodChain(Mesh &mesh, int maxLevels, float ratio)
+{
+    mesh.lods.clear();
+    mesh.lods.push_back({ 0, unsigned(mesh.indices.size()), 0.0f });
+
+    std::vector<glm::vec3> positions(mesh.vertices.size());
+    for(size_t i=0; i < mesh.vertices.size(); ++i)
+        positions[i] = mesh.vertices[i].position;
+
+    std::vector<unsigned> previous(mesh.indices);
+    float error = 0.0f;
+    const int levels = std::min(maxLevels, int(MaxMeshLods));
+    while(int(mesh.lods.size()) < levels)
+    {
+        const size_t target = size_t(previous.size() / 3 * ratio) * 3;
+        if(target < MinLodTriangles * 3)
+            break;
+        float levelError = 0.0f;
+        std::vector<unsigned> level = simplify(positions, previous, target, &levelError);
+        if(level.size() * 10 > previous.size() * 9)
+            break;
+
+        //每级在上一级的基础上简化, 相对LOD0的误差不超过各级之和
+        MeshBuilder::optimizeVertexCache(level, int(mesh.vertices.size()));
+        error += levelError;
+        mesh.lods.push_back({ unsigned(mesh.indices.size()), unsigned(level.size()), error });
+        mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+        previous.swap(level);
+    }
+}
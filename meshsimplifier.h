@@ -0,0 +1,26 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshbuilder.h"
+
+//Garland-Heckbert二次误差度量(QEM)的边坍缩简化, 只减索引不动顶点: 顶点只会合并到相邻的已有顶点上,
+//所以所有LOD共用同一个顶点缓冲, 只是索引缓冲里的不同段.
+//同一位置有多个顶点(法线/纹理坐标的接缝)和边界上的顶点不会被合并掉, 只能作为合并的目标, 保证接缝不裂开.
+class MeshSimplifier
+{
+public:
+    //三角形减到targetIndexCount / 3个以内, 做不到时尽量少; 返回的索引指向原来的positions.
+    //error是模型空间里的距离误差: 每次合并的二次误差(到合并进来的各个平面的面积加权平均距离平方)取最大再开方
+    static std::vector<unsigned> simplify(const std::vector<glm::vec3> &positions, const std::vector<unsigned> &indices,
+                                          size_t targetIndexCount, float *error = nullptr);
+
+    //mesh.indices是LOD0; 每级在上一级的基础上三角形数乘ratio, 直到maxLevels级或者减不下去(不到10%).
+    //各级索引按顶点缓存重排后接在mesh.indices后面, 误差逐级累加, 写进mesh.lods
+    static void buildLodChain(Mesh &mesh, int maxLevels = MaxMeshLods, float ratio = 0.5f);
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,6 @@
+# 无窗口的渲染基准, 和openGLTest共用全部源码, 运行方式:
+#   QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./openGLBench --frames 300 --instances 1000 --output bench_output.json
+include(openGLTest.pro)
+
+TARGET = openGLBench
+DEFINES += OPENGL_BENCH
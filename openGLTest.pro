@@ -4,18 +4,59 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++11
 
+# 让GLM按编译器的-msse2/-mavx选择SIMD路径(simd/platform.h里的GLM_ARCH), 视锥剔除用它一次测4/8个包围球.
+# x86上gcc/clang显式打开SSE2(x86_64本来就有); 想走AVX路径时在qmake命令行加 QMAKE_CXXFLAGS+=-mavx
+DEFINES += GLM_FORCE_INTRINSICS
+!msvc {
+    contains(QT_ARCH, i386)|contains(QT_ARCH, x86_64): QMAKE_CXXFLAGS += -msse2
+}
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    bvh.cpp \
+    entitystore.cpp \
+    frameprofiler.cpp \
+    framescheduler.cpp \
+    frustumculler.cpp \
     glwidget.cpp \
+    gpuculler.cpp \
+    headlessbenchmark.cpp \
     include/glm/detail/glm.cpp \
+    jobsystem.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    meshbuilder.cpp \
+    meshfile.cpp \
+    meshimporter.cpp \
+    meshsimplifier.cpp \
+    programcache.cpp \
+    rectpacker.cpp \
+    renderqueue.cpp \
+    samplercache.cpp \
+    scenegraph.cpp \
+    scenerenderer.cpp \
+    shadervariants.cpp \
+    statetracker.cpp \
+    streambuffer.cpp \
+    texturearray.cpp \
+    texturecache.cpp \
+    texturecompressor.cpp \
+    textureloader.cpp \
+    trianglepacket.cpp \
+    vertexpacking.cpp
 
 HEADERS += \
+    bvh.h \
+    entitystore.h \
+    frameprofiler.h \
+    framescheduler.h \
+    frustumculler.h \
     glwidget.h \
+    gpuculler.h \
+    headlessbenchmark.h \
     include/glm/common.hpp \
     include/glm/detail/_features.hpp \
     include/glm/detail/_fixes.hpp \
@@ -434,14 +475,34 @@ HEADERS += \
     include/glm/vec3.hpp \
     include/glm/vec4.hpp \
     include/glm/vector_relational.hpp \
-    mainwindow.h
+    jobsystem.h \
+    mainwindow.h \
+    meshbuilder.h \
+    meshfile.h \
+    meshimporter.h \
+    meshsimplifier.h \
+    programcache.h \
+    rectpacker.h \
+    renderqueue.h \
+    samplercache.h \
+    scenegraph.h \
+    scenerenderer.h \
+    shadervariants.h \
+    statetracker.h \
+    streambuffer.h \
+    texturearray.h \
+    texturecache.h \
+    texturecompressor.h \
+    textureloader.h \
+    trianglepacket.h \
+    vertexpacking.h
 
 FORMS += \
     mainwindow.ui
 
 INCLUDEPATH += $$PWD/include
 
-LIBS += -lopengl32 -lglu32 -lglut32
+win32: LIBS += -lopengl32 -lglu32 -lglut32
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,190 @@
+#include "programcache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QtEndian>
+
+#include <cstring>
+
+#include <QDebug>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+static const char fileIdentifier[8] = { '\xAB', 'G', 'P', 'B', '1', '\xBB', '\r', '\n' };
+//文件格式或者源码的预处理方式改动时加一, 旧缓存自动失效
+static const char cacheVersion = 1;
+
+ProgramCache::ProgramCache(const QString &directory)
+    : m_directory(directory)
+    , m_supported(false)
+{
+}
+
+QString ProgramCache::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/programs");
+}
+
+//#version必须是第一行, defines放在它后面
+QByteArray ProgramCache::source(const QString &fileName, const QByteArray &defines)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "program cache: cannot read" << fileName;
+        return QByteArray();
+    }
+    const QByteArray source = file.readAll();
+    if(defines.isEmpty())
+        return source;
+    const int lineEnd = source.startsWith("#version") ? source.indexOf('\n') + 1 : 0;
+    return source.left(lineEnd) + defines + source.mid(lineEnd);
+}
+
+void ProgramCache::initialize()
+{
+    initializeOpenGLFunctions();
+
+    //3.3 core里program binary是扩展, 4.1起是核心功能; 支持的格式数为0时存了也读不回来
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    const QSurfaceFormat format = ctx->format();
+    GLint formats = 0;
+    if(format.version() >= qMakePair(4, 1) || ctx->hasExtension("GL_ARB_get_program_binary"))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    m_supported = formats > 0;
+
+    m_driver = QByteArray(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + '\n'
+             + QByteArray(reinterpret_cast<const char *>(glGetString(GL_RENDERER))) + '\n'
+             + QByteArray(reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+    if(m_supported && !m_directory.isEmpty())
+        QDir().mkpath(m_directory);
+}
+
+QOpenGLShaderProgram *ProgramCache::create(const QString &vertexFile, const QString &fragmentFile, const QByteArray &defines)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray vertex = source(vertexFile, defines);
+    const QByteArray fragment = source(fragmentFile, defines);
+
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+    program->create();
+    const bool cached = isEnabled();
+    const QByteArray programKey = cached ? key(vertex, fragment) : QByteArray();
+
+    //没有着色器时link()只检查链接状态, 让QOpenGLShaderProgram知道二进制已经链接好了
+    if(cached && loadBinary(program->programId(), programKey) && program->link())
+    {
+        m_stats.buildNsecs += timer.nsecsElapsed();
+        return program;
+    }
+
+    if(!cached)
+        ++m_stats.misses;
+    program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex);
+    program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment);
+    if(cached)
+        glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    if(program->link() && cached)
+        storeBinary(program->programId(), programKey);
+    m_stats.buildNsecs += timer.nsecsElapsed();
+    return program;
+}
+
+QByteArray ProgramCache::key(const QByteArray &vertex, const QByteArray &fragment) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(vertex);
+    hash.addData("\0", 1);
+    hash.addData(fragment);
+    hash.addData("\0", 1);
+    hash.addData(m_driver);
+    hash.addData(&cacheVersion, 1);
+    return hash.result().toHex();
+}
+
+QString ProgramCache::path(const QByteArray &key) const
+{
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".gpb");
+}
+
+//文件: 8字节标识, binaryFormat, length, 然后是glGetProgramBinary的原始数据
+bool ProgramCache::loadBinary(GLuint program, const QByteArray &key)
+{
+    QFile file(path(key));
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        ++m_stats.misses;
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    bool accepted = false;
+    if(data.size() >= 16 && memcmp(data.constData(), fileIdentifier, 8) == 0)
+    {
+        const uchar *header = reinterpret_cast<const uchar *>(data.constData());
+        const GLenum binaryFormat = qFromLittleEndian<quint32>(header + 8);
+        const int length = int(qFromLittleEndian<quint32>(header + 12));
+        if(length == data.size() - 16)
+        {
+            glProgramBinary(program, binaryFormat, data.constData() + 16, length);
+            GLint status = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            accepted = status != 0;
+        }
+    }
+    if(accepted)
+    {
+        ++m_stats.hits;
+    }
+    else
+    {
+        ++m_stats.misses;
+        ++m_stats.rejected;
+        qDebug() << "program cache: driver rejected" << file.fileName();
+        QFile::remove(file.fileName());
+    }
+    return accepted;
+}
+
+void ProgramCache::storeBinary(GLuint program, const QByteArray &key)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    QByteArray data(16 + length, '\0');
+    GLenum binaryFormat = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &binaryFormat, data.data() + 16);
+    if(written <= 0)
+        return;
+    data.resize(16 + written);
+    uchar *header = reinterpret_cast<uchar *>(data.data());
+    memcpy(header, fileIdentifier, 8);
+    qToLittleEndian<quint32>(binaryFormat, header + 8);
+    qToLittleEndian<quint32>(quint32(written), header + 12);
+
+    //QSaveFile先写临时文件再改名, 同时启动的两个进程不会读到半个文件
+    QSaveFile file(path(key));
+    if(!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(data);
+    file.commit();
+}
@@ -0,0 +1,61 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <QOpenGLExtraFunctions>
+#include <QString>
+#include <QByteArray>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+
+//链接好的program的二进制(glGetProgramBinary)按键存在磁盘上, 下次启动直接glProgramBinary, 不再编译.
+//键 = SHA1(各阶段源码 + defines + GL_VENDOR/GL_RENDERER/GL_VERSION + 缓存版本), 驱动升级或源码改动后自然不命中;
+//驱动拒绝二进制(格式变了)时删掉这个文件, 退回从源码编译再重新存.
+class ProgramCache : protected QOpenGLExtraFunctions
+{
+public:
+    struct Stats
+    {
+        int hits = 0;
+        int misses = 0;
+        int rejected = 0;       //文件存在但驱动不接受
+        qint64 buildNsecs = 0;  //create里读源码+编译链接(或加载二进制)的总时间
+    };
+
+    //空字符串表示不缓存, 每次都编译
+    explicit ProgramCache(const QString &directory = defaultDirectory());
+
+    static QString defaultDirectory();
+    //要在initialize()之前设置
+    void setDirectory(const QString &directory) { m_directory = directory; }
+    QString directory() const { return m_directory; }
+
+    //需要当前有GL context; 驱动不支持program binary时只编译不缓存
+    void initialize();
+    bool isSupported() const { return m_supported; }
+
+    //defines插在#version那一行后面. 总是返回新的program(调用方delete), 用isLinked()判断是否成功
+    QOpenGLShaderProgram *create(const QString &vertexFile, const QString &fragmentFile,
+                                 const QByteArray &defines = QByteArray());
+
+    const Stats &stats() const { return m_stats; }
+
+    //下面几个给自己管理编译的调用方(ShaderVariants的异步编译)用
+    bool isEnabled() const { return m_supported && !m_directory.isEmpty(); }
+    //读源码并插入defines
+    static QByteArray source(const QString &fileName, const QByteArray &defines);
+    QByteArray key(const QByteArray &vertex, const QByteArray &fragment) const;
+    //成功时program已经链接好, 算一次命中; 没有文件或被拒绝算未命中
+    bool loadBinary(GLuint program, const QByteArray &key);
+    //program链接前要设置GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    void storeBinary(GLuint program, const QByteArray &key);
+
+private:
+    QString path(const QByteArray &key) const;
+
+    QString m_directory;
+    QByteArray m_driver;
+    bool m_supported;
+    Stats m_stats;
+};
+
+#endif // PROGRAMCACHE_H
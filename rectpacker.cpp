@@ -0,0 +1,96 @@
+#include "rectpacker.h"
+
+#include <algorithm>
+
+RectPacker::RectPacker(int width, int height)
+    : m_width(width)
+    , m_height(height)
+    , m_usedArea(0)
+{
+    Segment segment = { 0, 0, width };
+    m_skyline.push_back(segment);
+}
+
+int RectPacker::fit(size_t index, int w, int h) const
+{
+    const int x = m_skyline[index].x;
+    if(x + w > m_width)
+        return -1;
+
+    //矩形横跨的所有段里最高的那个决定它能放多低
+    int y = 0;
+    int remaining = w;
+    for(size_t i=index; remaining > 0; ++i)
+    {
+        if(i >= m_skyline.size())
+            return -1;
+        y = std::max(y, m_skyline[i].y);
+        if(y + h > m_height)
+            return -1;
+        remaining -= m_skyline[i].width;
+    }
+    return y;
+}
+
+bool RectPacker::insert(int w, int h, int &x, int &y)
+{
+    if(w <= 0 || h <= 0)
+        return false;
+
+    int bestY = m_height + 1;
+    int bestWidth = m_width + 1;
+    size_t bestIndex = m_skyline.size();
+    for(size_t i=0; i < m_skyline.size(); ++i)
+    {
+        const int top = fit(i, w, h);
+        if(top < 0)
+            continue;
+        if(top + h < bestY || (top + h == bestY && m_skyline[i].width < bestWidth))
+        {
+            bestY = top + h;
+            bestWidth = m_skyline[i].width;
+            bestIndex = i;
+        }
+    }
+    if(bestIndex == m_skyline.size())
+        return false;
+
+    x = m_skyline[bestIndex].x;
+    y = bestY - h;
+
+    //新段盖住[x, x+w), 把被它遮住的段裁掉或删掉
+    Segment segment = { x, bestY, w };
+    m_skyline.insert(m_skyline.begin() + bestIndex, segment);
+    for(size_t i=bestIndex + 1; i < m_skyline.size(); )
+    {
+        const int end = m_skyline[i - 1].x + m_skyline[i - 1].width;
+        if(m_skyline[i].x >= end)
+            break;
+        const int shrink = end - m_skyline[i].x;
+        if(shrink >= m_skyline[i].width)
+        {
+            m_skyline.erase(m_skyline.begin() + i);
+            continue;
+        }
+        m_skyline[i].x += shrink;
+        m_skyline[i].width -= shrink;
+        break;
+    }
+
+    //相邻的同高段合并
+    for(size_t i=0; i + 1 < m_skyline.size(); )
+    {
+        if(m_skyline[i].y == m_skyline[i + 1].y)
+        {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    m_usedArea += (long long)w * h;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef RECTPACKER_H
+#define RECTPACKER_H
+
+#include <cstddef>
+#include <vector>
+
+//天际线(skyline)矩形装箱, 给图集分配子矩形用.
+//每次放到能放下的位置里底边最低的那个(一样低时取起始段最窄的, 剩下的宽段留给更宽的图), 只增不删.
+class RectPacker
+{
+public:
+    RectPacker(int width, int height);
+
+    //放得下返回true并写出左上角坐标
+    bool insert(int w, int h, int &x, int &y);
+
+    bool isEmpty() const { return m_usedArea == 0; }
+    //已经分配出去的面积占比
+    float occupancy() const { return float(m_usedArea) / (float(m_width) * m_height); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+private:
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    //从第index段开始放宽w的矩形, 返回矩形底部需要的y; 放不下返回-1
+    int fit(size_t index, int w, int h) const;
+
+    std::vector<Segment> m_skyline;
+    int m_width, m_height;
+    long long m_usedArea;
+};
+
+#endif // RECTPACKER_H
@@ -0,0 +1,58 @@
+#include "renderqueue.h"
+
+#include <cstring>
+#include <algorithm>
+
+quint64 RenderQueue::makeKey(unsigned pass, unsigned program, unsigned material, unsigned mesh, float depth)
+{
+    //摄像机后面的物体已经被剔除, 负数只可能是-0或者误差, 当成0
+    quint32 depthBits = 0;
+    if(depth > 0.0f)
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    return (quint64(pass & 0xF) << 60)
+         | (quint64(program & 0xFF) << 52)
+         | (quint64(material & 0xFFF) << 40)
+         | (quint64(mesh & 0xFF) << 32)
+         | quint64(depthBits);
+}
+
+void RenderQueue::sort()
+{
+    const size_t count = m_items.size();
+    if(count < 2)
+        return;
+    m_scratch.resize(count);
+
+    //一趟把8个字节的直方图都数出来
+    size_t histogram[8][256];
+    memset(histogram, 0, sizeof(histogram));
+    for(const DrawItem &item : m_items)
+    {
+        for(int b=0; b < 8; ++b)
+            ++histogram[b][(item.key >> (b * 8)) & 0xFF];
+    }
+
+    DrawItem *from = m_items.data();
+    DrawItem *to = m_scratch.data();
+    for(int b=0; b < 8; ++b)
+    {
+        const size_t *counts = histogram[b];
+        if(counts[(from[0].key >> (b * 8)) & 0xFF] == count)
+            continue;
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for(int i=0; i < 256; ++i)
+        {
+            offsets[i] = sum;
+            sum += counts[i];
+        }
+        for(size_t i=0; i < count; ++i)
+            to[offsets[(from[i].key >> (b * 8)) & 0xFF]++] = from[i];
+        std::swap(from, to);
+    }
+
+    if(from != m_items.data())
+        m_items.swap(m_scratch);
+}
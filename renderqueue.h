@@ -0,0 +1,48 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <QtGlobal>
+
+#include <vector>
+
+//一次绘制: key决定提交顺序, payload由提交方解释(例如实例号)
+struct DrawItem
+{
+    quint64 key;
+    unsigned payload;
+};
+
+//每帧把所有绘制放进来, 按64位key基数排序后依次执行.
+//key从高到低: pass(4位) | program(8位) | material(12位) | mesh(8位) | depth(32位),
+//同一个pass里先按program再按material聚在一起, 状态切换最少; 最后按深度从近到远, 让early-z多拒绝一些像素.
+class RenderQueue
+{
+public:
+    enum { PassBits = 4, ProgramBits = 8, MaterialBits = 12, MeshBits = 8, DepthBits = 32 };
+
+    //depth是到摄像机的距离, 非负的float按位比较和按值比较顺序一样
+    static quint64 makeKey(unsigned pass, unsigned program, unsigned material, unsigned mesh, float depth);
+    static unsigned pass(quint64 key) { return unsigned(key >> 60); }
+    static unsigned program(quint64 key) { return unsigned(key >> 52) & 0xFF; }
+    static unsigned material(quint64 key) { return unsigned(key >> 40) & 0xFFF; }
+    static unsigned mesh(quint64 key) { return unsigned(key >> 32) & 0xFF; }
+
+    void clear() { m_items.clear(); }
+    void reserve(size_t count) { m_items.reserve(count); }
+    //并行填写时先定好大小, 再直接写items()
+    void resize(size_t count) { m_items.resize(count); }
+    void push(quint64 key, unsigned payload) { m_items.push_back({ key, payload }); }
+
+    //LSD基数排序, 每次8位; 所有key在某个字节上都相同时跳过这一趟
+    void sort();
+
+    const std::vector<DrawItem> &items() const { return m_items; }
+    std::vector<DrawItem> &items() { return m_items; }
+    size_t size() const { return m_items.size(); }
+
+private:
+    std::vector<DrawItem> m_items;
+    std::vector<DrawItem> m_scratch;
+};
+
+#endif // RENDERQUEUE_H
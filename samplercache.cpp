@@ -0,0 +1,69 @@
+#include "samplercache.h"
+
+#include <QOpenGLContext>
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+SamplerCache::SamplerCache()
+    : m_maxAnisotropy(1.0f)
+{
+    for(int i=0; i < MaxUnits; ++i)
+        m_bound[i] = 0;
+}
+
+void SamplerCache::initialize()
+{
+    initializeOpenGLFunctions();
+
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    if(ctx->hasExtension("GL_EXT_texture_filter_anisotropic") || ctx->hasExtension("GL_ARB_texture_filter_anisotropic"))
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &m_maxAnisotropy);
+}
+
+void SamplerCache::cleanup()
+{
+    for(auto &entry : m_samplers)
+        glDeleteSamplers(1, &entry.second);
+    m_samplers.clear();
+    for(int i=0; i < MaxUnits; ++i)
+        m_bound[i] = 0;
+}
+
+GLuint SamplerCache::sampler(const State &requested)
+{
+    //超过驱动上限的各向异性按上限算, 这样不同请求值落到同一个sampler上
+    State state = requested;
+    state.anisotropy = qBound(1.0f, state.anisotropy, m_maxAnisotropy);
+
+    auto it = m_samplers.find(state);
+    if(it != m_samplers.end())
+        return it->second;
+
+    GLuint sampler = 0;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GLint(state.minFilter));
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GLint(state.magFilter));
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GLint(state.wrapS));
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GLint(state.wrapT));
+    if(state.anisotropy > 1.0f)
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, state.anisotropy);
+
+    m_samplers.emplace(state, sampler);
+    return sampler;
+}
+
+bool SamplerCache::bind(int unit, GLuint sampler)
+{
+    if(unit >= 0 && unit < MaxUnits && m_bound[unit] == sampler)
+        return false;
+
+    glBindSampler(GLuint(unit), sampler);
+    if(unit >= 0 && unit < MaxUnits)
+        m_bound[unit] = sampler;
+    return true;
+}
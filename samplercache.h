@@ -0,0 +1,50 @@
+#ifndef SAMPLERCACHE_H
+#define SAMPLERCACHE_H
+
+#include <QOpenGLExtraFunctions>
+
+#include <map>
+#include <tuple>
+
+//采样状态(过滤/环绕/各向异性)和纹理分开: 相同的状态只建一个sampler对象,
+//纹理本身不再设置glTexParameteri; 每个纹理单元记住当前绑定的sampler, 相同的不再重复绑定.
+class SamplerCache : protected QOpenGLExtraFunctions
+{
+public:
+    struct State
+    {
+        GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+        GLenum magFilter = GL_LINEAR;
+        GLenum wrapS = GL_REPEAT;
+        GLenum wrapT = GL_REPEAT;
+        float anisotropy = 1.0f;
+
+        bool operator<(const State &o) const
+        {
+            return std::tie(minFilter, magFilter, wrapS, wrapT, anisotropy)
+                    < std::tie(o.minFilter, o.magFilter, o.wrapS, o.wrapT, o.anisotropy);
+        }
+    };
+
+    enum { MaxUnits = 16 };
+
+    SamplerCache();
+
+    //需要当前有GL context
+    void initialize();
+    void cleanup();
+
+    GLuint sampler(const State &state);
+    //返回是否真的调用了glBindSampler
+    bool bind(int unit, GLuint sampler);
+
+    float maxAnisotropy() const { return m_maxAnisotropy; }
+    int createdCount() const { return int(m_samplers.size()); }
+
+private:
+    std::map<State, GLuint> m_samplers;
+    GLuint m_bound[MaxUnits];
+    float m_maxAnisotropy;
+};
+
+#endif // SAMPLERCACHE_H
@@ -0,0 +1,275 @@
+#include "scenegraph.h"
+#include "jobsystem.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+//GLM_ARCH在GLM_FORCE_INTRINSICS时由编译器的-msse/-mavx决定, 并且已经include了对应的intrinsics头文件
+#include <glm/simd/platform.h>
+
+//脏节点超过总数的1/FullUpdateRatio时整层重算; 整层重算时每块的节点数
+enum { FullUpdateRatio = 8, UpdateGrain = 16384 };
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+namespace
+{
+//local是4个节点的局部矩阵上3x3(按列, 已经乘了缩放), 每项4个lane; 写第lane个节点的世界矩阵.
+//局部矩阵前3列的w是0, 第4列是(t, 1), 所以乘父矩阵时每列只要3或4次乘加
+void storeWorld(float *out, const float *parent, const float local[9][4], int lane, const glm::vec3 &t)
+{
+    if(!parent)
+    {
+        _mm_storeu_ps(out, _mm_setr_ps(local[0][lane], local[1][lane], local[2][lane], 0.0f));
+        _mm_storeu_ps(out + 4, _mm_setr_ps(local[3][lane], local[4][lane], local[5][lane], 0.0f));
+        _mm_storeu_ps(out + 8, _mm_setr_ps(local[6][lane], local[7][lane], local[8][lane], 0.0f));
+        _mm_storeu_ps(out + 12, _mm_setr_ps(t.x, t.y, t.z, 1.0f));
+        return;
+    }
+    const __m128 p0 = _mm_loadu_ps(parent);
+    const __m128 p1 = _mm_loadu_ps(parent + 4);
+    const __m128 p2 = _mm_loadu_ps(parent + 8);
+    const __m128 p3 = _mm_loadu_ps(parent + 12);
+    for(int c=0; c < 3; ++c)
+    {
+        __m128 column = _mm_mul_ps(p0, _mm_set1_ps(local[c * 3][lane]));
+        column = _mm_add_ps(column, _mm_mul_ps(p1, _mm_set1_ps(local[c * 3 + 1][lane])));
+        column = _mm_add_ps(column, _mm_mul_ps(p2, _mm_set1_ps(local[c * 3 + 2][lane])));
+        _mm_storeu_ps(out + c * 4, column);
+    }
+    __m128 column = _mm_add_ps(p3, _mm_mul_ps(p0, _mm_set1_ps(t.x)));
+    column = _mm_add_ps(column, _mm_mul_ps(p1, _mm_set1_ps(t.y)));
+    column = _mm_add_ps(column, _mm_mul_ps(p2, _mm_set1_ps(t.z)));
+    _mm_storeu_ps(out + 12, column);
+}
+}
+#endif
+
+void SceneGraph::clear()
+{
+    m_parent.clear();
+    m_firstChild.clear();
+    m_childCount.clear();
+    m_levels.clear();
+    m_translation.clear();
+    m_rotation.clear();
+    m_scale.clear();
+    m_world.clear();
+    m_dirty.clear();
+    m_dirtyList.clear();
+    m_allDirty = true;
+    m_sorted = true;
+}
+
+int SceneGraph::addNode(int parent, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    Q_ASSERT(parent >= NoParent && parent < count());
+    m_parent.push_back(parent);
+    m_translation.push_back(translation);
+    m_rotation.push_back(rotation);
+    m_scale.push_back(scale);
+    m_sorted = false;
+    return count() - 1;
+}
+
+template<typename T>
+static void permute(std::vector<T> &values, const std::vector<int> &order)
+{
+    std::vector<T> sorted(values.size());
+    for(size_t k=0; k < order.size(); ++k)
+        sorted[k] = values[order[k]];
+    values.swap(sorted);
+}
+
+std::vector<int> SceneGraph::sortByDepth()
+{
+    const int n = count();
+
+    //旧编号的子节点表, 子节点保持加入的顺序
+    std::vector<int> childOffsets(n + 1, 0);
+    std::vector<int> order;
+    order.reserve(n);
+    for(int i=0; i < n; ++i)
+    {
+        if(m_parent[i] == NoParent)
+            order.push_back(i);
+        else
+            ++childOffsets[m_parent[i] + 1];
+    }
+    for(int i=0; i < n; ++i)
+        childOffsets[i + 1] += childOffsets[i];
+    std::vector<int> children(n);
+    std::vector<int> cursor(childOffsets.begin(), childOffsets.end() - 1);
+    for(int i=0; i < n; ++i)
+    {
+        if(m_parent[i] != NoParent)
+            children[cursor[m_parent[i]]++] = i;
+    }
+
+    //广度优先, order[k]是新编号k的旧编号
+    m_levels.assign(1, 0);
+    for(size_t levelBegin=0; levelBegin < order.size(); )
+    {
+        const size_t levelEnd = order.size();
+        m_levels.push_back(int(levelEnd));
+        for(size_t k=levelBegin; k < levelEnd; ++k)
+            order.insert(order.end(), children.begin() + childOffsets[order[k]], children.begin() + childOffsets[order[k] + 1]);
+        levelBegin = levelEnd;
+    }
+
+    std::vector<int> newIndex(n);
+    for(int k=0; k < n; ++k)
+        newIndex[order[k]] = k;
+    //子节点按父节点的顺序接在下一层, 所以每个节点的第一个子节点就是前面所有节点的子节点数之后
+    m_firstChild.resize(n);
+    m_childCount.resize(n);
+    int next = m_levels.size() > 1 ? m_levels[1] : 0;
+    for(int k=0; k < n; ++k)
+    {
+        m_firstChild[k] = next;
+        m_childCount[k] = childOffsets[order[k] + 1] - childOffsets[order[k]];
+        next += m_childCount[k];
+    }
+    std::vector<int> parents(n);
+    for(int k=0; k < n; ++k)
+        parents[k] = m_parent[order[k]] == NoParent ? int(NoParent) : newIndex[m_parent[order[k]]];
+    m_parent.swap(parents);
+    permute(m_translation, order);
+    permute(m_rotation, order);
+    permute(m_scale, order);
+
+    m_world.resize(n);
+    m_dirty.assign(n, 0);
+    m_dirtyList.clear();
+    m_allDirty = true;
+    m_sorted = true;
+    return newIndex;
+}
+
+void SceneGraph::markDirty(int node)
+{
+    //还没排序时m_dirty可能比节点少, 排序之后本来就全部重算
+    if(!m_sorted)
+        return;
+    if(!m_dirty[node])
+    {
+        m_dirty[node] = 1;
+        m_dirtyList.push_back(node);
+    }
+}
+
+void SceneGraph::update(JobSystem *jobs)
+{
+    Q_ASSERT(m_sorted);
+    QElapsedTimer timer;
+    timer.start();
+    const int n = count();
+    m_stats = Stats();
+    m_stats.dirtyNodes = m_allDirty ? n : int(m_dirtyList.size());
+
+    if(m_allDirty || m_dirtyList.size() * FullUpdateRatio > size_t(n))
+    {
+        //一层一层算, 每层里的节点只依赖上一层, 可以分块并行
+        m_stats.full = true;
+        for(size_t d=0; d + 1 < m_levels.size(); ++d)
+        {
+            const int begin = m_levels[d];
+            const int end = m_levels[d + 1];
+            if(jobs)
+                jobs->parallelFor(end - begin, UpdateGrain, [&](int b, int e) { updateRange(begin + b, begin + e); });
+            else
+                updateRange(begin, end);
+        }
+        std::fill(m_dirty.begin(), m_dirty.end(), 0);
+        m_stats.updated = n;
+    }
+    else
+    {
+        //按编号排序后祖先在前, 已经被祖先的子树算过的节点不再是脏的
+        std::sort(m_dirtyList.begin(), m_dirtyList.end());
+        for(int node : m_dirtyList)
+        {
+            if(m_dirty[node])
+                updateSubtree(node);
+        }
+    }
+    m_dirtyList.clear();
+    m_allDirty = false;
+    m_stats.nsecs = timer.nsecsElapsed();
+}
+
+//子树在下一层是这一段节点的子节点拼起来的一段
+void SceneGraph::updateSubtree(int node)
+{
+    int begin = node;
+    int end = node + 1;
+    while(begin < end)
+    {
+        updateRange(begin, end);
+        std::fill(m_dirty.begin() + begin, m_dirty.begin() + end, 0);
+        m_stats.updated += end - begin;
+        const int childBegin = m_firstChild[begin];
+        end = m_firstChild[end - 1] + m_childCount[end - 1];
+        begin = childBegin;
+    }
+}
+
+//[begin, end)在同一层, 父节点的世界矩阵已经是新的
+void SceneGraph::updateRange(int begin, int end)
+{
+    int i = begin;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    for(; i + 4 <= end; i += 4)
+    {
+        //4个节点的四元数和缩放转成每个分量一个寄存器, 按glm::mat3_cast的公式一起算
+        const glm::quat *q = &m_rotation[i];
+        const glm::vec3 *s = &m_scale[i];
+        const __m128 x = _mm_setr_ps(q[0].x, q[1].x, q[2].x, q[3].x);
+        const __m128 y = _mm_setr_ps(q[0].y, q[1].y, q[2].y, q[3].y);
+        const __m128 z = _mm_setr_ps(q[0].z, q[1].z, q[2].z, q[3].z);
+        const __m128 w = _mm_setr_ps(q[0].w, q[1].w, q[2].w, q[3].w);
+        const __m128 sx = _mm_setr_ps(s[0].x, s[1].x, s[2].x, s[3].x);
+        const __m128 sy = _mm_setr_ps(s[0].y, s[1].y, s[2].y, s[3].y);
+        const __m128 sz = _mm_setr_ps(s[0].z, s[1].z, s[2].z, s[3].z);
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        alignas(16) float local[9][4];
+        _mm_store_ps(local[0], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx));
+        _mm_store_ps(local[1], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx));
+        _mm_store_ps(local[2], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx));
+        _mm_store_ps(local[3], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy));
+        _mm_store_ps(local[4], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy));
+        _mm_store_ps(local[5], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy));
+        _mm_store_ps(local[6], _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz));
+        _mm_store_ps(local[7], _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz));
+        _mm_store_ps(local[8], _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz));
+
+        for(int lane=0; lane < 4; ++lane)
+        {
+            const int parent = m_parent[i + lane];
+            storeWorld(&m_world[i + lane][0][0], parent == NoParent ? nullptr : &m_world[parent][0][0],
+                       local, lane, m_translation[i + lane]);
+        }
+    }
+#endif
+    for(; i < end; ++i)
+    {
+        const glm::mat4 local = glm::scale(glm::translate(glm::mat4(1.0f), m_translation[i]) * glm::mat4_cast(m_rotation[i]), m_scale[i]);
+        const int parent = m_parent[i];
+        m_world[i] = parent == NoParent ? local : m_world[parent] * local;
+    }
+}
+
+const char *SceneGraph::path()
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,87 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <QtGlobal>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class JobSystem;
+
+//变换层次: 每个节点有父节点, 局部的平移/旋转/缩放和世界矩阵, 各自放在一个平坦的数组里(SoA).
+//sortByDepth之后节点按广度优先排好: 同一深度的节点连续, 父节点总在子节点前面, 同一个父节点的子节点也连续,
+//所以一棵子树在每一层都是连续的一段.
+//改了局部变换的节点记为脏, update()只重算脏节点所在的子树; 脏节点多时(或markAllDirty)按层整段重算, 每层分块并行.
+//连续的节点4个一批用SSE从四元数算局部矩阵再乘父节点的世界矩阵, 没有SIMD时逐个用glm算.
+class SceneGraph
+{
+public:
+    enum { NoParent = -1 };
+
+    struct Stats
+    {
+        int dirtyNodes = 0;     //update前标记为脏的节点, markAllDirty时是全部
+        int updated = 0;        //实际重算的世界矩阵
+        bool full = false;      //走的是整层重算
+        qint64 nsecs = 0;
+    };
+
+    void clear();
+    //parent是已经加进来的节点或NoParent; 返回的编号在sortByDepth之前有效
+    int addNode(int parent, const glm::vec3 &translation = glm::vec3(0.0f),
+                const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3 &scale = glm::vec3(1.0f));
+    //按深度重排, 返回每个旧编号对应的新编号; 之后所有节点都是脏的.
+    //节点本来就是广度优先加进来的(例如全是根节点)时编号不变
+    std::vector<int> sortByDepth();
+
+    int count() const { return int(m_parent.size()); }
+    int parent(int node) const { return m_parent[node]; }
+    int depthCount() const { return int(m_levels.size()) - 1; }
+
+    const glm::vec3 &translation(int node) const { return m_translation[node]; }
+    const glm::quat &rotation(int node) const { return m_rotation[node]; }
+    const glm::vec3 &scale(int node) const { return m_scale[node]; }
+    void setTranslation(int node, const glm::vec3 &translation) { m_translation[node] = translation; markDirty(node); }
+    void setRotation(int node, const glm::quat &rotation) { m_rotation[node] = rotation; markDirty(node); }
+    void setScale(int node, const glm::vec3 &scale) { m_scale[node] = scale; markDirty(node); }
+    //单个标记不是线程安全的; 多线程批量改局部变换时直接写这几个数组, 写完调用markAllDirty.
+    //addNode之后到sortByDepth之前标记不起作用, 排序会把所有节点标脏
+    void markDirty(int node);
+    void markAllDirty() { m_allDirty = true; }
+    glm::vec3 *translations() { return m_translation.data(); }
+    glm::quat *rotations() { return m_rotation.data(); }
+
+    //jobs为空时在调用线程里算
+    void update(JobSystem *jobs = nullptr);
+    const glm::mat4 &world(int node) const { return m_world[node]; }
+    const std::vector<glm::mat4> &worlds() const { return m_world; }
+    const Stats &stats() const { return m_stats; }
+
+    //"sse2"或"scalar"
+    static const char *path();
+
+private:
+    void updateRange(int begin, int end);
+    void updateSubtree(int node);
+
+    std::vector<int> m_parent;
+    //子节点是[m_firstChild[i], m_firstChild[i] + m_childCount[i]); 没有子节点的节点也有firstChild, 所以随编号单调不减
+    std::vector<int> m_firstChild;
+    std::vector<int> m_childCount;
+    //第d层是[m_levels[d], m_levels[d + 1])
+    std::vector<int> m_levels;
+    std::vector<glm::vec3> m_translation;
+    std::vector<glm::quat> m_rotation;
+    std::vector<glm::vec3> m_scale;
+    std::vector<glm::mat4> m_world;
+
+    std::vector<unsigned char> m_dirty;
+    std::vector<int> m_dirtyList;
+    bool m_allDirty = true;
+    bool m_sorted = true;
+    Stats m_stats;
+};
+
+#endif // SCENEGRAPH_H
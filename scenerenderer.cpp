@@ -0,0 +1,1137 @@
+#include "scenerenderer.h"
+#include "meshimporter.h"
+#include <QOpenGLShaderProgram>
+#include <QElapsedTimer>
+
+#include <random>
+#include <algorithm>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <cstring>
+
+#include <QDebug>
+
+GLfloat vertices[] = {
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+    0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+};
+
+glm::vec3 cubePositions[] = {
+    glm::vec3( 0.0f,  0.0f,  0.0f),
+    glm::vec3( 2.0f,  5.0f, -15.0f),
+    glm::vec3(-1.5f, -2.2f, -2.5f),
+    glm::vec3(-3.8f, -2.0f, -12.3f),
+    glm::vec3( 2.4f, -0.4f, -3.5f),
+    glm::vec3(-1.7f,  3.0f, -7.5f),
+    glm::vec3( 1.3f, -2.0f, -2.5f),
+    glm::vec3( 1.5f,  2.0f, -2.5f),
+    glm::vec3( 1.5f,  0.2f, -1.5f),
+    glm::vec3(-1.3f,  1.0f, -1.5f)
+};
+
+//第i个立方体绕固定的轴转20*i度再加上动画角度; 中心不动, 所以包围球和BVH不受动画影响
+static const glm::vec3 instanceAxis = glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f));
+static glm::quat instanceRotation(int i, float time)
+{
+    return glm::angleAxis(glm::radians(20.0f * i) + time, instanceAxis);
+}
+
+//每个实例的实体都有这几种组件
+static const int InstanceComponents = PositionComponent | RotationComponent | BoundsComponent
+        | MaterialComponent | MeshComponent | InstanceComponent;
+
+//前10个立方体沿用cubePositions, 其余的在摄像机前方随机分布(固定种子, 保证每次结果一致)
+void SceneRenderer::buildInstanceField(int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> xy(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> z(-95.0f, -5.0f);
+
+    m_scene.clear();
+    m_entities.clear();
+    m_instanceEntities.resize(count);
+    m_culler.resize(count);
+    m_instanceBounds.resize(count);
+    m_instanceLod.assign(count, 0);
+    m_instanceVisible.assign(count, 0);
+    m_cullDirty = true;
+    m_bvhDirty = true;
+    m_gpuInstancesDirty = true;
+    m_selected = -1;
+    for(int i=0; i < count; ++i)
+    {
+        glm::vec3 pos = i < 10 ? cubePositions[i] : glm::vec3(xy(rng), xy(rng), z(rng));
+        //实例都是根节点, 按顺序加进去节点号就是实例号
+        m_scene.addNode(SceneGraph::NoParent, pos, instanceRotation(i, m_animationTime));
+
+        const Entity entity = m_entities.create(InstanceComponents);
+        m_instanceEntities[i] = entity;
+        *m_entities.get<PositionComponent>(entity) = pos;
+        *m_entities.get<RotationComponent>(entity) = instanceRotation(i, 0.0f);
+        //网格不管怎么旋转都在半径m_meshRadius的球里(立方体是sqrt(3)/2)
+        Aabb &bounds = *m_entities.get<BoundsComponent>(entity);
+        bounds.min = pos - glm::vec3(m_meshRadius);
+        bounds.max = pos + glm::vec3(m_meshRadius);
+        //木箱和石墙交替, 上面都叠加笑脸
+        *m_entities.get<MaterialComponent>(entity) = glm::u16vec2(i % 2 == 0 ? m_regionContainer : m_regionWall, m_regionFace);
+        *m_entities.get<InstanceComponent>(entity) = quint32(i);
+    }
+    m_scene.sortByDepth();
+    m_scene.update(m_jobs);
+
+    //剔除用的包围球和BVH的输入从实体里取
+    m_entities.forEach(PositionComponent | BoundsComponent | InstanceComponent, m_jobs, [this](EntityStore::Chunk &chunk) {
+        const glm::vec3 *positions = chunk.get<PositionComponent>();
+        const Aabb *bounds = chunk.get<BoundsComponent>();
+        const quint32 *instances = chunk.get<InstanceComponent>();
+        for(int k=0; k < chunk.count(); ++k)
+        {
+            m_culler.setSphere(instances[k], positions[k], m_meshRadius);
+            m_instanceBounds[instances[k]] = bounds[k];
+        }
+    });
+}
+
+//和shader里的layout(std140) uniform Camera一一对应
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPos;
+};
+
+enum { CameraBinding = 0, RegionBinding = 1 };
+enum { ArrayTextureUnit = 2 };
+//排序键里的pass和program编号; 高亮pass在不透明物体之后
+enum { OpaquePass = 0, HighlightPass = 1 };
+enum { ObjectProgram = 0, InstanceProgram = 1 };
+//实例化项的payload是LOD号, 这个值表示GPU剔除后的间接绘制
+enum { GpuDrawPayload = MaxMeshLods };
+//启动时同步编译的变体, 其他变体就绪前用它画
+enum { BaseFeatures = ShaderVariants::Textured };
+//并行任务每块处理的元素数; 剔除的块要是FrustumCuller::Batch的倍数
+enum { CullGrain = 16384, LodGrain = 16384, GatherGrain = 16384 };
+//按实体块并行时每个任务处理的块数
+enum { ChunkGrain = 16 };
+//换到粗一级要求投影误差比阈值再小这么多, 否则在阈值附近的物体会在两级之间来回跳
+static const float LodHysteresis = 0.25f;
+
+//拾取用的三角形只取网格里LOD0的位置
+static std::vector<TrianglePacket> buildMeshPackets(const MeshFile &file)
+{
+    const MeshLod &lod = file.lods()[0];
+    std::vector<glm::vec3> positions(lod.indexCount);
+    for(unsigned i=0; i < lod.indexCount; ++i)
+        positions[i] = file.position(file.index(int(lod.firstIndex + i)));
+    return TrianglePacket::build(positions.data(), int(positions.size() / 3));
+}
+
+SceneRenderer::SceneRenderer()
+    : m_meshVertexBytes(0)
+    , m_meshVertexStride(0)
+    , m_indexType(GL_UNSIGNED_INT)
+    , m_meshRadius(0.8660254f)
+    , m_texture1(-1)
+    , m_texture2(-1)
+    , m_texture3(-1)
+    , m_regionContainer(0)
+    , m_regionFace(0)
+    , m_regionWall(0)
+    , m_textureFilter(Trilinear)
+    , m_variants(m_programs)
+    , m_initialized(false)
+    , m_frameProgram(nullptr)
+    , m_programGeneration(-1)
+    , m_positionScale(1.0f, 1.0f, 1.0f)
+    , m_shaderFeatures(ShaderVariants::Textured)
+    , m_meshFeatures(0)
+    , m_frameInstanceProgram(nullptr)
+    , m_instanced(false)
+    , m_bvhDirty(true)
+    , m_gpuInstancesDirty(true)
+    , m_gpuModelsDirty(true)
+    , m_cullMode(FlatCulling)
+    , m_selected(-1)
+    , m_cullDirty(true)
+    , m_cullNsecs(0)
+    , m_lodEnabled(true)
+    , m_lodThreshold(1.0f)
+    , m_trianglesDrawn(0)
+    , m_trianglesFull(0)
+    , m_jobs(new JobSystem)
+    , m_animationTime(0.0f)
+    , m_animationDirty(false)
+    , m_prepareNsecs(0)
+    , m_aspect(1.0f)
+    , m_viewportHeight(1)
+    , m_drawCalls(0)
+    , m_textureBinds(0)
+    , m_modelLoc(-1)
+    , m_highlightLoc(-1)
+    , m_cameraPos(0.0f, 0.0f, 3.0f)
+    , m_cameraFront(0.0f, 0.0f, -1.0f)
+    , m_cameraUp(0.0f, 1.0f, 0.0f)
+{
+}
+
+SceneRenderer::~SceneRenderer()
+{
+    delete m_jobs;
+}
+
+void SceneRenderer::setThreadCount(int threads)
+{
+    delete m_jobs;
+    m_jobs = new JobSystem(threads);
+}
+
+void SceneRenderer::setAnimationTime(float time)
+{
+    if(time == m_animationTime)
+        return;
+    m_animationTime = time;
+    m_animationDirty = true;
+}
+
+void SceneRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    m_profiler.initialize();
+    m_state.initialize();
+
+    m_programs.initialize();
+    m_variants.initialize([this](QOpenGLShaderProgram *program, int features) { setupProgram(program, features); });
+
+    //基础变体同步编译, 其他特性组合的变体在后台编译好之前都用它们画
+    if(m_variants.build(BaseFeatures)->isLinked())
+    {
+        qDebug("link success");
+    }
+    else
+    {
+        qDebug("link failed");
+    }
+
+    if(!m_variants.build(BaseFeatures | ShaderVariants::Instanced)->isLinked())
+    {
+        qDebug("instance program link failed");
+    }
+    m_initialized = true;
+
+    m_vao.create();
+    m_vbo.create();
+    m_ebo.create();
+    m_stream.create(1024 * sizeof(glm::mat4));
+    //不支持时--cull gpu退回CPU剔除
+    m_gpuCuller.create();
+
+    m_cameraUbo.create();
+    glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUbo.bufferId());
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CameraBinding, m_cameraUbo.bufferId());
+
+    //指定的模型加载失败时退回内置的立方体
+    if(!loadMesh(m_meshFileName))
+        loadMesh(QString());
+
+    m_vao.bind();
+
+    //纹理相关代码初始化: 后台线程解码, 到达之前先绑占位纹理
+    m_textures.initialize();
+    m_samplers.initialize();
+    m_texture1 = m_textures.request(":/container.jpg", false);
+    m_texture2 = m_textures.request(":/awesomeface.png", true);
+    m_texture3 = m_textures.request(":/wall.jpg", false);
+
+    m_textureArray.initialize();
+    m_regionContainer = m_textureArray.reserve();
+    m_regionFace = m_textureArray.reserve();
+    m_regionWall = m_textureArray.reserve();
+    m_textures.requestRegion(":/container.jpg", false, &m_textureArray, m_regionContainer);
+    m_textures.requestRegion(":/awesomeface.png", true, &m_textureArray, m_regionFace);
+    m_textures.requestRegion(":/wall.jpg", false, &m_textureArray, m_regionWall);
+    glBindBufferBase(GL_UNIFORM_BUFFER, RegionBinding, m_textureArray.regionBufferId());
+
+    m_regionTextures.assign(m_textureArray.regionCount(), m_texture1);
+    m_regionTextures[m_regionFace] = m_texture2;
+    m_regionTextures[m_regionWall] = m_texture3;
+
+    //实例属性: mat4占用2~5四个location, 每个实例前进一次
+    //指针每帧在streamFrameData里重新指向环形缓冲的当前段
+    buildInstanceField(10);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream.bufferId());
+    for(int i=0; i < 4; ++i)
+    {
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(2 + i, 1);
+    }
+    //实例的材质(两个region号)紧跟在矩阵后面
+    glEnableVertexAttribArray(6);
+    glVertexAttribIPointer(6, 2, GL_UNSIGNED_SHORT, sizeof(glm::u16vec2), (void*)0);
+    glVertexAttribDivisor(6, 1);
+
+    m_vao.release();
+    glUseProgram(0);
+}
+
+bool SceneRenderer::loadMesh(const QString &fileName)
+{
+    MeshFile file;
+    MeshBuilder::Stats stats;
+    QString error;
+    bool ok;
+    if(fileName.isEmpty())
+    {
+        ok = file.load(MeshFile::serialize(MeshBuilder::build(vertices, int(sizeof(vertices) / sizeof(vertices[0]) / 5), 5, &stats), m_vertexFormat));
+    }
+    else if(fileName.endsWith(QLatin1String(".gmesh"), Qt::CaseInsensitive))
+    {
+        //已经是焊接重排过的结果, 没有导入前的数据
+        ok = file.open(fileName);
+        stats.inputVertices = stats.outputVertices = file.vertexCount();
+        if(ok)
+        {
+            stats.triangles = int(file.lods()[0].indexCount / 3);
+            stats.lodLevels = int(file.lods().size());
+        }
+        else
+        {
+            error = QStringLiteral("not a valid .gmesh file");
+        }
+    }
+    else
+    {
+        Mesh mesh;
+        ok = MeshImporter::import(fileName, mesh, &stats, &error) && file.load(MeshFile::serialize(mesh, m_vertexFormat));
+    }
+    if(!ok)
+    {
+        qDebug() << "mesh" << fileName << "load failed:" << error;
+        return false;
+    }
+
+    m_meshFileName = fileName;
+    m_meshStats = stats;
+    m_lods = file.lods();
+    m_indexType = file.indexType();
+    m_meshPackets = buildMeshPackets(file);
+    m_meshRadius = glm::max(glm::length(file.boundsMin()), glm::length(file.boundsMax()));
+    m_meshVertexBytes = file.vertexBytes();
+    m_meshVertexStride = file.vertexStride();
+    qDebug("mesh %s: %d -> %d vertices, %d triangles, ACMR %.3f -> %.3f, %d bytes per vertex, %d LODs",
+           fileName.isEmpty() ? "cube" : qPrintable(fileName),
+           m_meshStats.inputVertices, m_meshStats.outputVertices, m_meshStats.triangles,
+           m_meshStats.acmrBefore, m_meshStats.acmrAfter, m_meshVertexStride, int(m_lods.size()));
+    for(size_t l=1; l < m_lods.size(); ++l)
+        qDebug("  LOD%d: %u triangles, error %g", int(l), m_lods[l].indexCount / 3, m_lods[l].error);
+
+    //压缩的位置在vertex shader里反量化, 还没就绪的变体在setupProgram里设置
+    m_positionScale = QVector3D(file.positionScale().x, file.positionScale().y, file.positionScale().z);
+    m_positionOffset = QVector3D(file.positionOffset().x, file.positionOffset().y, file.positionOffset().z);
+    for(QOpenGLShaderProgram *program : m_variants.programs())
+    {
+        program->bind();
+        program->setUniformValue("positionScale", m_positionScale);
+        program->setUniformValue("positionOffset", m_positionOffset);
+    }
+    //八面体编码的法线只有两个分量, 受光的变体要在shader里解码
+    m_meshFeatures = 0;
+    for(const MeshAttribute &attribute : file.attributes())
+    {
+        if(attribute.location == MeshFile::NormalLocation && attribute.components == 2)
+            m_meshFeatures |= ShaderVariants::OctahedralNormal;
+    }
+
+    //顶点和索引直接从映射的文件上传, 属性布局照文件里的描述设置, 索引缓冲的绑定记在VAO里
+    m_vao.bind();
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo.bufferId());
+    glBufferData(GL_ARRAY_BUFFER, file.vertexBytes(), file.vertexData(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo.bufferId());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, file.indexBytes(), file.indexData(), GL_STATIC_DRAW);
+    const GLuint meshLocations[] = { MeshFile::PositionLocation, MeshFile::TexCoordLocation, MeshFile::NormalLocation };
+    for(GLuint location : meshLocations)
+        glDisableVertexAttribArray(location);
+    for(const MeshAttribute &attribute : file.attributes())
+    {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                              file.vertexStride(), (void*)quintptr(attribute.offset));
+    }
+    m_vao.release();
+
+    //包围球半径变了, 实例的剔除数据要跟着重建
+    if(m_scene.count() > 0)
+        buildInstanceField(instanceCount());
+    return true;
+}
+
+void SceneRenderer::cleanup()
+{
+    if (!m_initialized)
+        return;
+    m_vbo.destroy();
+    m_ebo.destroy();
+    m_vao.destroy();
+    m_stream.destroy();
+    m_gpuCuller.destroy();
+    m_gpuInstancesDirty = true;
+    m_cameraUbo.destroy();
+    m_profiler.cleanup();
+    m_textures.cleanup();
+    m_samplers.cleanup();
+    m_textureArray.cleanup();
+    m_texture1 = m_texture2 = m_texture3 = -1;
+    m_variants.cleanup();
+    m_initialized = false;
+    m_frameProgram = m_frameInstanceProgram = nullptr;
+}
+
+void SceneRenderer::setCamera(const glm::vec3 &pos, const glm::vec3 &front, const glm::vec3 &up)
+{
+    m_cameraPos = pos;
+    m_cameraFront = front;
+    m_cameraUp = up;
+}
+
+void SceneRenderer::resize(int w, int h)
+{
+    m_aspect = GLfloat(w) / qMax(h, 1);
+    m_viewportHeight = qMax(h, 1);
+}
+
+void SceneRenderer::setInstanceCount(int count)
+{
+    buildInstanceField(count);
+}
+
+void SceneRenderer::render(FrameScheduler::DirtyFlags dirty)
+{
+    m_profiler.beginFrame();
+    {
+        ProfileScope scope(&m_profiler, "clear");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    {
+        ProfileScope scope(&m_profiler, "textureUpload");
+        m_textures.poll();
+    }
+    glEnable(GL_DEPTH_TEST);
+    //glEnable(GL_CULL_FACE);
+
+    // 设置顺时针方向 CW : Clock Wind 顺时针方向
+    // 默认是 GL_CCW : Counter Clock Wind 逆时针方向
+    //glFrontFace(GL_CW);
+
+    {
+        ProfileScope scope(&m_profiler, "samplers");
+        //所有单元用同一个sampler, 状态没变时SamplerCache不会重复绑定
+        SamplerCache::State state;
+        if(m_textureFilter == Bilinear)
+            state.minFilter = GL_LINEAR;
+        if(m_textureFilter == Anisotropic)
+            state.anisotropy = 16.0f;
+        const GLuint sampler = m_samplers.sampler(state);
+        m_samplers.bind(0, sampler);
+        m_samplers.bind(1, sampler);
+        m_samplers.bind(ArrayTextureUnit, sampler);
+    }
+
+    {
+        ProfileScope scope(&m_profiler, "cameraBlock");
+        updateCameraBlock(dirty);
+    }
+    prepareFrame(dirty);
+
+    {
+        ProfileScope scope(&m_profiler, "shaderVariants");
+        m_variants.poll();
+        selectPrograms();
+    }
+
+    m_drawCalls = 0;
+    {
+        ProfileScope scope(&m_profiler, "drawScene");
+        drawScene(m_frame);
+    }
+    m_profiler.endFrame();
+}
+
+//每个变体就绪时调用一次: 块绑定, 采样器单元和当前模型的反量化参数
+void SceneRenderer::setupProgram(QOpenGLShaderProgram *program, int features)
+{
+    const GLuint id = program->programId();
+    program->bind();
+    glUniformBlockBinding(id, glGetUniformBlockIndex(id, "Camera"), CameraBinding);
+    if(features & ShaderVariants::Instanced)
+    {
+        //不贴图的变体里没有Regions块
+        const GLuint regions = glGetUniformBlockIndex(id, "Regions");
+        if(regions != GL_INVALID_INDEX)
+            glUniformBlockBinding(id, regions, RegionBinding);
+        program->setUniformValue("textures", int(ArrayTextureUnit));
+    }
+    else
+    {
+        program->setUniformValue("highlight", 0.0f);
+        //采样器对应的纹理单元不会变, 设置一次即可
+        program->setUniformValue("texture1", 0);
+        program->setUniformValue("texture2", 1);
+    }
+    program->setUniformValue("positionScale", m_positionScale);
+    program->setUniformValue("positionOffset", m_positionOffset);
+}
+
+//按当前特性取这一帧的program, 还在编译的变体先用基础变体代替.
+//变体不缓存指针, 热重载会换掉program; 逐个绘制的program变了或有program被换掉时才重新查uniform位置
+void SceneRenderer::selectPrograms()
+{
+    const int features = m_shaderFeatures | m_meshFeatures;
+    QOpenGLShaderProgram *program = m_variants.program(features, BaseFeatures);
+    if(program != m_frameProgram || m_variants.generation() != m_programGeneration)
+    {
+        m_frameProgram = program;
+        m_programGeneration = m_variants.generation();
+        m_modelLoc = program->uniformLocation("model");
+        m_highlightLoc = program->uniformLocation("highlight");
+    }
+    m_frameInstanceProgram = m_instanced ? m_variants.program(features | ShaderVariants::Instanced,
+                                                              BaseFeatures | ShaderVariants::Instanced)
+                                         : nullptr;
+}
+
+const char *SceneRenderer::cullModeName(CullMode mode)
+{
+    const char *names[] = { "none", "flat", "bvh", "gpu" };
+    return names[mode];
+}
+
+const Bvh &SceneRenderer::sceneIndex()
+{
+    if(m_bvhDirty)
+    {
+        m_bvh.build(m_instanceBounds);
+        m_bvhDirty = false;
+    }
+    return m_bvh;
+}
+
+int SceneRenderer::pick(const glm::vec2 &cursor, const glm::vec4 &viewport, float *distance)
+{
+    const glm::vec3 nearPoint = glm::unProject(glm::vec3(cursor, 0.0f), m_camera, m_proj, viewport);
+    const glm::vec3 farPoint = glm::unProject(glm::vec3(cursor, 1.0f), m_camera, m_proj, viewport);
+    const glm::vec3 dir = glm::normalize(farPoint - nearPoint);
+    float closest = glm::length(farPoint - nearPoint);
+
+    const int hit = sceneIndex().raycast(nearPoint, dir, [&](unsigned instance, float &d) {
+        //模型矩阵只有平移和旋转, 射线变到物体空间后参数t不变
+        const glm::mat4 inverse = glm::affineInverse(m_scene.world(instance));
+        const glm::vec3 origin(inverse * glm::vec4(nearPoint, 1.0f));
+        const glm::vec3 localDir(inverse * glm::vec4(dir, 0.0f));
+        return intersectPackets(m_meshPackets, origin, localDir, d);
+    }, closest);
+
+    if(distance && hit >= 0)
+        *distance = closest;
+    return hit;
+}
+
+//用当前的m_proj * m_camera剔除实例, 结果留在m_visible里直到下一次摄像机/投影/实例变化
+void SceneRenderer::cullScene(FrameScheduler::DirtyFlags dirty)
+{
+    m_cullNsecs = 0;
+    if(!m_cullDirty && !(dirty & (FrameScheduler::Camera | FrameScheduler::Projection)))
+        return;
+    m_cullDirty = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    if(gpuCulling())
+    {
+        //在drawScene里由GPU剔除, CPU这边没有可见实例
+        m_visible.clear();
+    }
+    else if(m_cullMode == FlatCulling || m_cullMode == GpuCulling)
+    {
+        //每块的结果先写在块自己的起点上, 再按顺序挤到一起, 和串行剔除的结果完全一样
+        m_culler.setViewProjection(m_proj * m_camera);
+        const int count = m_culler.count();
+        std::vector<int> chunkVisible((count + CullGrain - 1) / CullGrain, 0);
+        m_visible.resize(count);
+        m_jobs->parallelFor(count, CullGrain, [&](int begin, int end) {
+            chunkVisible[begin / CullGrain] = m_culler.cull(begin, end, m_visible.data() + begin);
+        });
+        size_t visible = 0;
+        for(size_t c=0; c < chunkVisible.size(); ++c)
+        {
+            memmove(m_visible.data() + visible, m_visible.data() + c * CullGrain, chunkVisible[c] * sizeof(unsigned));
+            visible += chunkVisible[c];
+        }
+        m_visible.resize(visible);
+    }
+    else if(m_cullMode == BvhCulling)
+    {
+        glm::vec4 planes[6];
+        FrustumCuller::extractPlanes(m_proj * m_camera, planes);
+        sceneIndex().queryFrustum(planes, m_visible);
+    }
+    else
+    {
+        m_visible.resize(m_scene.count());
+        for(size_t i=0; i < m_visible.size(); ++i)
+            m_visible[i] = unsigned(i);
+    }
+    std::fill(m_instanceVisible.begin(), m_instanceVisible.end(), 0);
+    for(unsigned i : m_visible)
+        m_instanceVisible[i] = 1;
+    m_cullNsecs = timer.nsecsElapsed();
+}
+
+//动画/剔除/建渲染队列/收集实例数据, 各自在任务系统里分块并行; GL调用都不在这里
+void SceneRenderer::prepareFrame(FrameScheduler::DirtyFlags dirty)
+{
+    QElapsedTimer timer;
+    timer.start();
+    if(m_animationDirty)
+    {
+        ProfileScope scope(&m_profiler, "animate");
+        animateInstances();
+    }
+    {
+        ProfileScope scope(&m_profiler, "cull");
+        cullScene(dirty);
+    }
+    {
+        ProfileScope scope(&m_profiler, "lod");
+        selectLods();
+    }
+    {
+        ProfileScope scope(&m_profiler, "buildQueue");
+        buildFrameCommands();
+    }
+    m_prepareNsecs = timer.nsecsElapsed();
+}
+
+//动画角度绕同一根轴叠在实体的基础朝向上, 按块遍历实体写进变换层次
+void SceneRenderer::animateInstances()
+{
+    glm::quat *rotations = m_scene.rotations();
+    const glm::quat spin = glm::angleAxis(m_animationTime, instanceAxis);
+    m_entities.forEach(RotationComponent | InstanceComponent, m_jobs, [&](EntityStore::Chunk &chunk) {
+        const glm::quat *base = chunk.get<RotationComponent>();
+        const quint32 *instances = chunk.get<InstanceComponent>();
+        for(int k=0; k < chunk.count(); ++k)
+            rotations[instances[k]] = spin * base[k];
+    });
+    m_scene.markAllDirty();
+    m_scene.update(m_jobs);
+    m_gpuModelsDirty = true;
+    m_animationDirty = false;
+}
+
+//可见实例按投影到屏幕上的几何误差选LOD: 误差 * 每单位长度在距离d处的像素数(proj[1][1] * 高度/2 / d).
+//从当前级别出发, 超过阈值就换细的, 粗一级也不超过阈值 * (1 - LodHysteresis)才换粗的; 不可见的实例保留原来的级别
+void SceneRenderer::selectLods()
+{
+    const int levels = int(m_lods.size());
+    if(!m_lodEnabled || levels <= 1)
+    {
+        std::fill(m_instanceLod.begin(), m_instanceLod.end(), 0);
+        return;
+    }
+    const float pixelsPerUnit = m_proj[1][1] * 0.5f * float(m_viewportHeight);
+    const float coarsen = m_lodThreshold * (1.0f - LodHysteresis);
+    m_jobs->parallelFor(int(m_visible.size()), LodGrain, [&](int begin, int end) {
+        for(int v=begin; v < end; ++v)
+        {
+            const unsigned i = m_visible[v];
+            //到包围球最近处的距离, 摄像机在球里时按近平面算
+            const float distance = glm::max(glm::length(m_scene.translation(i) - m_cameraPos) - m_meshRadius, 0.1f);
+            const float scale = pixelsPerUnit / distance;
+            int lod = glm::min(int(m_instanceLod[i]), levels - 1);
+            while(lod > 0 && m_lods[lod].error * scale > m_lodThreshold)
+                --lod;
+            while(lod + 1 < levels && m_lods[lod + 1].error * scale < coarsen)
+                ++lod;
+            m_instanceLod[i] = static_cast<unsigned char>(lod);
+        }
+    });
+}
+
+//实例数据在变了之后才上传: 包围球和材质从实体里取, 世界矩阵从变换层次里取; 然后在GPU上剔除并选LOD
+void SceneRenderer::dispatchGpuCulling()
+{
+    if(m_gpuInstancesDirty)
+    {
+        const int count = instanceCount();
+        std::vector<glm::vec4> spheres(count);
+        std::vector<glm::u16vec2> materials(count);
+        m_entities.forEach(PositionComponent | MaterialComponent | InstanceComponent, m_jobs, [&](EntityStore::Chunk &chunk) {
+            const glm::vec3 *positions = chunk.get<PositionComponent>();
+            const glm::u16vec2 *chunkMaterials = chunk.get<MaterialComponent>();
+            const quint32 *instances = chunk.get<InstanceComponent>();
+            for(int k=0; k < chunk.count(); ++k)
+            {
+                spheres[instances[k]] = glm::vec4(positions[k], m_meshRadius);
+                materials[instances[k]] = chunkMaterials[k];
+            }
+        });
+        m_gpuCuller.setInstances(spheres.data(), materials.data(), count);
+        m_gpuInstancesDirty = false;
+        m_gpuModelsDirty = true;
+    }
+    if(m_gpuModelsDirty)
+    {
+        m_gpuCuller.setModels(m_scene.worlds().data(), instanceCount());
+        m_gpuModelsDirty = false;
+    }
+
+    GpuCuller::Parameters parameters;
+    parameters.viewProjection = m_proj * m_camera;
+    parameters.cameraPos = m_cameraPos;
+    parameters.pixelsPerUnit = m_proj[1][1] * 0.5f * float(m_viewportHeight);
+    parameters.lodEnabled = m_lodEnabled;
+    parameters.lodThreshold = m_lodThreshold;
+    parameters.lodHysteresis = LodHysteresis;
+    m_gpuCuller.dispatch(m_lods, parameters);
+}
+
+//CPU按FlatCulling剔除再selectLods, GPU跑一遍同样的compute pass并读回, 两边的结果按实例号对比
+SceneRenderer::GpuCullCheck SceneRenderer::validateGpuCulling()
+{
+    GpuCullCheck check;
+    check.supported = m_gpuCuller.isSupported();
+    if(!check.supported)
+        return check;
+
+    const CullMode mode = m_cullMode;
+    const bool instanced = m_instanced;
+    updateCameraBlock(FrameScheduler::Camera | FrameScheduler::Projection);
+
+    m_cullMode = FlatCulling;
+    m_cullDirty = true;
+    std::fill(m_instanceLod.begin(), m_instanceLod.end(), 0);
+    cullScene(FrameScheduler::Camera);
+    selectLods();
+    const std::vector<unsigned> cpuVisible = m_visible;
+
+    m_cullMode = GpuCulling;
+    m_instanced = true;
+    m_gpuCuller.resetLods();
+    dispatchGpuCulling();
+    std::vector<unsigned> gpuVisible;
+    std::vector<unsigned char> gpuLods;
+    m_gpuCuller.readBack(gpuVisible, gpuLods);
+
+    //两边都是升序
+    check.cpuVisible = int(cpuVisible.size());
+    check.gpuVisible = int(gpuVisible.size());
+    size_t c = 0, g = 0;
+    while(c < cpuVisible.size() || g < gpuVisible.size())
+    {
+        if(g == gpuVisible.size() || (c < cpuVisible.size() && cpuVisible[c] < gpuVisible[g]))
+        {
+            ++check.missing;
+            ++c;
+        }
+        else if(c == cpuVisible.size() || gpuVisible[g] < cpuVisible[c])
+        {
+            ++check.extra;
+            ++g;
+        }
+        else
+        {
+            if(m_instanceLod[cpuVisible[c]] != gpuLods[cpuVisible[c]])
+                ++check.lodMismatches;
+            ++c;
+            ++g;
+        }
+    }
+
+    m_cullMode = mode;
+    m_instanced = instanced;
+    m_cullDirty = true;
+    return check;
+}
+
+//每个可见物体一项(实例化时每级LOD一项), 选中的物体在高亮pass里再来一项.
+//绘制列表按实体块生成: 每块先数出可见的个数(实例化时按LOD分别数), 前缀和定下每块写的位置, 再并行写, 结果和块的顺序无关.
+//排序之后把每项要用的矩阵按提交顺序收集进m_frame, drawScene里只顺序读
+void SceneRenderer::buildFrameCommands()
+{
+    RenderQueue &queue = m_frame.queue;
+    const int visible = int(m_visible.size());
+    const int required = MaterialComponent | InstanceComponent;
+    std::vector<EntityStore::Chunk *> chunks;
+    m_entities.chunks(required, chunks);
+    const int chunkCount = int(chunks.size());
+    //chunkFirst[c * MaxMeshLods + l]是第c块第l级的第一个写到哪; 逐个绘制时只用l = 0
+    std::vector<int> chunkFirst(chunkCount * MaxMeshLods, 0);
+    const int lodSlots = m_instanced ? MaxMeshLods : 1;
+    m_jobs->parallelFor(chunkCount, ChunkGrain, [&](int begin, int end) {
+        for(int c=begin; c < end; ++c)
+        {
+            const quint32 *instances = chunks[c]->get<InstanceComponent>();
+            int *counts = &chunkFirst[c * MaxMeshLods];
+            for(int k=0; k < chunks[c]->count(); ++k)
+            {
+                if(m_instanceVisible[instances[k]])
+                    ++counts[m_instanced ? m_instanceLod[instances[k]] : 0];
+            }
+        }
+    });
+    //先按级别再按块排, 同一级的实例在models里连续
+    int first = 0;
+    for(int lod=0; lod < lodSlots; ++lod)
+    {
+        m_frame.lodFirst[lod] = first;
+        for(int c=0; c < chunkCount; ++c)
+        {
+            const int count = chunkFirst[c * MaxMeshLods + lod];
+            chunkFirst[c * MaxMeshLods + lod] = first;
+            first += count;
+        }
+        m_frame.lodInstances[lod] = first - m_frame.lodFirst[lod];
+    }
+    Q_ASSERT(first == visible);
+
+    queue.clear();
+    m_frame.instanceCount = m_instanced ? visible : 0;
+    m_modelSources.resize(m_frame.instanceCount);
+    m_frame.materials.resize(m_frame.instanceCount);
+    if(m_instanced)
+    {
+        //GPU剔除时可见实例都在GPU上, 只有一项间接绘制
+        if(gpuCulling())
+            queue.push(RenderQueue::makeKey(OpaquePass, InstanceProgram, 0, 0, 0.0f), unsigned(GpuDrawPayload));
+        for(int lod=0; lod < MaxMeshLods && !gpuCulling(); ++lod)
+        {
+            if(m_frame.lodInstances[lod] > 0)
+                queue.push(RenderQueue::makeKey(OpaquePass, InstanceProgram, 0, lod, 0.0f), unsigned(lod));
+        }
+        m_jobs->parallelFor(chunkCount, ChunkGrain, [&](int begin, int end) {
+            for(int c=begin; c < end; ++c)
+            {
+                const quint32 *instances = chunks[c]->get<InstanceComponent>();
+                const glm::u16vec2 *materials = chunks[c]->get<MaterialComponent>();
+                int *next = &chunkFirst[c * MaxMeshLods];
+                for(int k=0; k < chunks[c]->count(); ++k)
+                {
+                    const quint32 i = instances[k];
+                    if(!m_instanceVisible[i])
+                        continue;
+                    const int slot = next[m_instanceLod[i]]++;
+                    m_modelSources[slot] = i;
+                    m_frame.materials[slot] = materials[k];
+                }
+            }
+        });
+    }
+    else
+    {
+        queue.resize(visible);
+        m_itemInstances.resize(visible);
+        m_itemMaterials.resize(visible);
+        DrawItem *items = queue.items().data();
+        m_jobs->parallelFor(chunkCount, ChunkGrain, [&](int begin, int end) {
+            for(int c=begin; c < end; ++c)
+            {
+                const quint32 *instances = chunks[c]->get<InstanceComponent>();
+                const glm::u16vec2 *materials = chunks[c]->get<MaterialComponent>();
+                int next = chunkFirst[c * MaxMeshLods];
+                for(int k=0; k < chunks[c]->count(); ++k)
+                {
+                    const quint32 i = instances[k];
+                    if(!m_instanceVisible[i])
+                        continue;
+                    items[next].key = RenderQueue::makeKey(OpaquePass, ObjectProgram, materials[k].x, m_instanceLod[i], viewDepth(i));
+                    items[next].payload = unsigned(next);
+                    m_itemInstances[next] = i;
+                    m_itemMaterials[next] = materials[k];
+                    ++next;
+                }
+            }
+        });
+    }
+    if(m_selected >= 0 && m_selected < m_scene.count())
+    {
+        //和不透明pass里画的是同一级, 深度才完全相等; GPU剔除时CPU不知道实例用的级别, 画LOD0
+        const glm::u16vec2 material = *m_entities.get<MaterialComponent>(m_instanceEntities[m_selected]);
+        const int lod = gpuCulling() ? 0 : m_instanceLod[m_selected];
+        queue.push(RenderQueue::makeKey(HighlightPass, ObjectProgram, material.x, lod, viewDepth(m_selected)),
+                   unsigned(m_itemInstances.size()));
+        m_itemInstances.push_back(unsigned(m_selected));
+        m_itemMaterials.push_back(material);
+    }
+    queue.sort();
+
+    for(DrawItem &item : queue.items())
+    {
+        if(RenderQueue::program(item.key) == InstanceProgram)
+            continue;
+        const unsigned source = item.payload;
+        item.payload = unsigned(m_modelSources.size());
+        m_modelSources.push_back(m_itemInstances[source]);
+        m_frame.materials.push_back(m_itemMaterials[source]);
+    }
+    m_itemInstances.clear();
+    m_itemMaterials.clear();
+
+    const int count = int(m_modelSources.size());
+    m_frame.models.resize(count);
+    m_jobs->parallelFor(count, GatherGrain, [this](int begin, int end) {
+        for(int k=begin; k < end; ++k)
+            m_frame.models[k] = m_scene.world(m_modelSources[k]);
+    });
+}
+
+//实例中心沿视线方向到摄像机的距离
+float SceneRenderer::viewDepth(unsigned instance) const
+{
+    return glm::dot(glm::vec3(m_scene.world(instance)[3]) - m_cameraPos, m_cameraFront);
+}
+
+//按排序后的顺序执行frame.queue: 逐个绘制时每项一次uniform上传+一次draw call, 实例化时每级LOD一次glDrawElementsInstanced,
+//GPU剔除时先dispatch两个compute pass, 再一次glMultiDrawElementsIndirect画完所有级别.
+//每项画的是排序键里那一级LOD的索引段. 选中的物体用逐个绘制的program原地再画一遍, 深度相等也通过, 颜色往高亮色混合
+void SceneRenderer::drawScene(const FrameCommands &frame)
+{
+    //compute pass会换掉当前的program, 要在m_state开始记录之前做完
+    if(gpuCulling())
+    {
+        ProfileScope scope(&m_profiler, "gpuCull");
+        dispatchGpuCulling();
+    }
+    m_state.reset();
+    m_state.resetStats();
+    m_state.bindVertexArray(m_vao.objectId());
+    m_trianglesDrawn = m_trianglesFull = 0;
+    const size_t indexSize = m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    //所有级别的实例数据一次上传, 每级只把实例属性指到自己那一段
+    int streamBase = -1;
+    if(frame.instanceCount > 0)
+    {
+        ProfileScope scope(&m_profiler, "streamUpload");
+        streamBase = streamFrameData(frame);
+    }
+
+    for(const DrawItem &item : frame.queue.items())
+    {
+        if(RenderQueue::program(item.key) == InstanceProgram && item.payload == GpuDrawPayload)
+        {
+            m_state.useProgram(m_frameInstanceProgram->programId());
+            m_state.bindTexture(ArrayTextureUnit, GL_TEXTURE_2D_ARRAY, m_textureArray.textureId());
+            {
+                ProfileScope scope(&m_profiler, "draw");
+                m_gpuCuller.draw(m_indexType);
+                ++m_drawCalls;
+            }
+            //GPU上的计数晚一帧读回
+            for(size_t l=0; l < m_lods.size(); ++l)
+            {
+                m_trianglesDrawn += qint64(m_lods[l].indexCount / 3) * m_gpuCuller.lodInstances()[l];
+                m_trianglesFull += qint64(m_lods[0].indexCount / 3) * m_gpuCuller.lodInstances()[l];
+            }
+            continue;
+        }
+        if(RenderQueue::program(item.key) == InstanceProgram)
+        {
+            const MeshLod &lod = m_lods[item.payload];
+            const int instances = frame.lodInstances[item.payload];
+            m_state.useProgram(m_frameInstanceProgram->programId());
+            m_state.bindTexture(ArrayTextureUnit, GL_TEXTURE_2D_ARRAY, m_textureArray.textureId());
+            bindInstanceRange(frame, streamBase, frame.lodFirst[item.payload]);
+            {
+                ProfileScope scope(&m_profiler, "draw");
+                glDrawElementsInstanced(GL_TRIANGLES, GLsizei(lod.indexCount), m_indexType,
+                                        (void*)(lod.firstIndex * indexSize), instances);
+                ++m_drawCalls;
+            }
+            m_trianglesDrawn += qint64(lod.indexCount / 3) * instances;
+            m_trianglesFull += qint64(m_lods[0].indexCount / 3) * instances;
+            continue;
+        }
+
+        //同一种底图的物体排在一起, 只有换材质时才真的绑定; 叠加图固定在单元1
+        const bool highlight = RenderQueue::pass(item.key) == HighlightPass;
+        m_state.useProgram(m_frameProgram->programId());
+        m_state.bindTexture(0, GL_TEXTURE_2D, m_textures.textureId(m_regionTextures[RenderQueue::material(item.key)]));
+        m_state.bindTexture(1, GL_TEXTURE_2D, m_textures.textureId(m_texture2));
+        glUniformMatrix4fv(m_modelLoc, 1, GL_FALSE, glm::value_ptr(frame.models[item.payload]));
+        if(highlight)
+        {
+            glDepthFunc(GL_LEQUAL);
+            glUniform1f(m_highlightLoc, 0.5f);
+        }
+        const MeshLod &lod = m_lods[RenderQueue::mesh(item.key)];
+        glDrawElements(GL_TRIANGLES, GLsizei(lod.indexCount), m_indexType, (void*)(lod.firstIndex * indexSize));
+        ++m_drawCalls;
+        if(!highlight)
+        {
+            m_trianglesDrawn += lod.indexCount / 3;
+            m_trianglesFull += m_lods[0].indexCount / 3;
+        }
+        if(highlight)
+        {
+            glUniform1f(m_highlightLoc, 0.0f);
+            glDepthFunc(GL_LESS);
+        }
+    }
+
+    if(streamBase >= 0)
+        m_stream.fenceFrame();
+    m_state.useProgram(0);
+    m_state.bindVertexArray(0);
+    m_textureBinds = m_state.stats().textureBinds;
+}
+
+//把frame里已经收集好的实例矩阵和材质一次性拷进环形缓冲的当前段, 返回这一段在缓冲里的偏移
+int SceneRenderer::streamFrameData(const FrameCommands &frame)
+{
+    const size_t count = size_t(frame.instanceCount);
+    const int modelBytes = int(count * sizeof(glm::mat4));
+    const int materialBytes = int(count * sizeof(glm::u16vec2));
+    m_stream.reserve(modelBytes + materialBytes);
+
+    char *ptr = static_cast<char *>(m_stream.beginFrame());
+    glm::mat4 *models = reinterpret_cast<glm::mat4 *>(ptr);
+    glm::u16vec2 *materials = reinterpret_cast<glm::u16vec2 *>(ptr + modelBytes);
+    if(count > 0)
+    {
+        memcpy(models, frame.models.data(), modelBytes);
+        memcpy(materials, frame.materials.data(), materialBytes);
+    }
+    m_stream.endFrame(modelBytes + materialBytes);
+    return m_stream.offset();
+}
+
+//实例属性指向上传的这一段里从第first个实例开始的矩阵和材质(需要m_vao已绑定).
+//GL 3.3没有baseInstance, 每级LOD的实例从0数, 只能移动属性指针
+void SceneRenderer::bindInstanceRange(const FrameCommands &frame, int base, int first)
+{
+    const size_t models = size_t(base) + size_t(first) * sizeof(glm::mat4);
+    const size_t materials = size_t(base) + size_t(frame.instanceCount) * sizeof(glm::mat4) + size_t(first) * sizeof(glm::u16vec2);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream.bufferId());
+    for(int i=0; i < 4; ++i)
+    {
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(models + i * sizeof(glm::vec4)));
+    }
+    glVertexAttribIPointer(6, 2, GL_UNSIGNED_SHORT, sizeof(glm::u16vec2), (void*)materials);
+}
+
+//只重新计算脏了的矩阵, 摄像机和投影都没变就不上传
+void SceneRenderer::updateCameraBlock(FrameScheduler::DirtyFlags dirty)
+{
+    if(!(dirty & (FrameScheduler::Camera | FrameScheduler::Projection)))
+        return;
+
+    if(dirty & FrameScheduler::Projection)
+        m_proj = glm::perspective(glm::radians(45.0f), m_aspect, 0.1f, 100.0f);
+    if(dirty & FrameScheduler::Camera)
+        m_camera = glm::lookAt(m_cameraPos, m_cameraPos + m_cameraFront, m_cameraUp);
+
+    CameraBlock block;
+    block.view = m_camera;
+    block.projection = m_proj;
+    block.viewProjection = m_proj * m_camera;
+    block.cameraPos = glm::vec4(m_cameraPos, 1.0f);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUbo.bufferId());
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+//按B键: 分别用逐个绘制和实例化绘制渲染10/1k/100k个立方体, 输出draw call数和平均帧时间
+void SceneRenderer::runInstanceBenchmark()
+{
+    const int counts[] = { 10, 1000, 100000 };
+    const int frames = 20;
+    const bool instanced = m_instanced;
+
+    glEnable(GL_DEPTH_TEST);
+    updateCameraBlock(FrameScheduler::Camera | FrameScheduler::Projection);
+
+    for(int count : counts)
+    {
+        buildInstanceField(count);
+        if(m_cullMode == BvhCulling)
+            sceneIndex();
+
+        for(int mode=0; mode < 2; ++mode)
+        {
+            //GPU剔除只在实例化时生效, 逐个绘制要在切换m_instanced之后用CPU重新剔除
+            m_instanced = mode == 1;
+            m_cullDirty = true;
+            cullScene(FrameScheduler::Camera);
+            selectLods();
+            buildFrameCommands();
+
+            //先画一帧预热, 避免把驱动的延迟初始化算进去
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawScene(m_frame);
+            glFinish();
+
+            m_stream.resetCounters();
+            QElapsedTimer timer;
+            timer.start();
+            for(int f=0; f < frames; ++f)
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                m_drawCalls = 0;
+                drawScene(m_frame);
+            }
+            glFinish();
+
+            qDebug("%-9s instances=%6d visible=%6d (cull %s %.3f ms) drawCalls=%6d textureBinds=%6d skippedBinds=%6d frame=%.3f ms uploaded=%lld bytes stalls=%lld (%.3f ms)",
+                   m_instanced ? "instanced" : "loop", count, visibleCount(), cullModeName(m_cullMode), m_cullNsecs / 1e6,
+                   m_drawCalls, m_textureBinds, m_state.stats().skipped,
+                   timer.nsecsElapsed() / 1e6 / frames,
+                   m_stream.bytesUploaded(), m_stream.fenceStalls(), m_stream.stallNsecs() / 1e6);
+        }
+    }
+
+    m_instanced = instanced;
+    buildInstanceField(10);
+}
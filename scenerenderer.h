@@ -0,0 +1,284 @@
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLBuffer>
+#include <QVector3D>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "streambuffer.h"
+#include "framescheduler.h"
+#include "frameprofiler.h"
+#include "textureloader.h"
+#include "samplercache.h"
+#include "texturearray.h"
+#include "frustumculler.h"
+#include "bvh.h"
+#include "trianglepacket.h"
+#include "meshbuilder.h"
+#include "meshfile.h"
+#include "renderqueue.h"
+#include "statetracker.h"
+#include "jobsystem.h"
+#include "programcache.h"
+#include "shadervariants.h"
+#include "scenegraph.h"
+#include "entitystore.h"
+#include "gpuculler.h"
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+
+//立方体场景的全部GL资源和绘制逻辑, GLWidget和无窗口的HeadlessBenchmark共用同一份.
+//所有函数都要求调用时对应的context是当前context.
+class SceneRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    //Bilinear是原来的GL_LINEAR不带mipmap, 用来对比远处的纹理带宽
+    enum TextureFilter { Bilinear, Trilinear, Anisotropic };
+    //FlatCulling对所有包围球做SIMD测试, BvhCulling走空间索引, 只访问和视锥相交的子树;
+    //GpuCulling在compute shader里剔除和选LOD再间接绘制, 只用于实例化绘制, 不支持或逐个绘制时按FlatCulling剔除
+    enum CullMode { NoCulling, FlatCulling, BvhCulling, GpuCulling, CullModeCount };
+
+    //GPU剔除和CPU剔除(FlatCulling + selectLods)在同一个摄像机下的对比
+    struct GpuCullCheck
+    {
+        bool supported = false;
+        int cpuVisible = 0;
+        int gpuVisible = 0;
+        int missing = 0;        //CPU可见GPU不可见
+        int extra = 0;          //GPU可见CPU不可见
+        int lodMismatches = 0;  //两边都可见但LOD不同
+    };
+
+    SceneRenderer();
+    ~SceneRenderer();
+
+    //initialize之前设置要画的模型(.gmesh/.obj/.gltf/.glb), 空字符串是内置的立方体
+    void setMeshFile(const QString &fileName) { m_meshFileName = fileName; }
+    const QString &meshFile() const { return m_meshFileName; }
+    //内置立方体和导入的模型上传时的顶点编码; .gmesh文件保持写入时的编码
+    void setVertexFormat(const VertexFormat &format) { m_vertexFormat = format; }
+    const VertexFormat &vertexFormat() const { return m_vertexFormat; }
+    void initialize();
+    void cleanup();
+    bool isInitialized() const { return m_initialized; }
+
+    void setCamera(const glm::vec3 &pos, const glm::vec3 &front, const glm::vec3 &up);
+    void resize(int w, int h);
+    //清屏并绘制一帧, dirty决定哪些矩阵需要重新计算
+    void render(FrameScheduler::DirtyFlags dirty);
+
+    //帧准备(动画/剔除/建渲染队列)用几个线程, 包括调用render的线程; 默认是CPU核数
+    void setThreadCount(int threads);
+    int threadCount() const { return m_jobs->threadCount(); }
+    JobSystem &jobs() { return *m_jobs; }
+    //每个立方体绕自己的轴转time弧度, 下一帧重新计算所有model矩阵
+    void setAnimationTime(float time);
+    float animationTime() const { return m_animationTime; }
+    //本帧动画+剔除+建渲染队列的CPU时间
+    qint64 prepareNsecs() const { return m_prepareNsecs; }
+    //实例的变换层次, stats()是最近一次重算世界矩阵的情况
+    const SceneGraph &sceneGraph() const { return m_scene; }
+
+    void setInstanced(bool instanced) { m_instanced = instanced; m_cullDirty = true; }
+    bool instanced() const { return m_instanced; }
+    void setInstanceCount(int count);
+    int instanceCount() const { return m_scene.count(); }
+    int drawCalls() const { return m_drawCalls; }
+    //NoCulling时所有实例都提交, 用来对比
+    void setCullMode(CullMode mode) { m_cullMode = mode; m_cullDirty = true; }
+    CullMode cullMode() const { return m_cullMode; }
+    //"none", "flat", "bvh", "gpu", 命令行和JSON里用
+    static const char *cullModeName(CullMode mode);
+    //GPU剔除时是上一帧的个数
+    int visibleCount() const { return gpuCulling() ? m_gpuCuller.visibleCount() : int(m_visible.size()); }
+    //这一帧实际走GPU剔除和间接绘制
+    bool gpuCulling() const { return m_cullMode == GpuCulling && m_instanced && m_gpuCuller.isSupported(); }
+    bool gpuCullingSupported() const { return m_gpuCuller.isSupported(); }
+    //两边的LOD都从0开始各算一次; 会重置实例当前的LOD, 需要当前context
+    GpuCullCheck validateGpuCulling();
+    //本帧剔除花的CPU时间, 摄像机没动时不重新剔除, 为0
+    qint64 cullNsecs() const { return m_cullNsecs; }
+    int textureBinds() const { return m_textureBinds; }
+    //本帧经过StateTracker的program/VAO/纹理绑定, skipped是省掉的重复绑定
+    const StateTracker::Stats &stateStats() const { return m_state.stats(); }
+    //当前模型焊接+重排的结果, .gmesh文件只有输出的顶点数和三角形数
+    const MeshBuilder::Stats &meshStats() const { return m_meshStats; }
+    //换一个模型并上传, 要求已经initialize; 失败时保留原来的模型
+    bool loadMesh(const QString &fileName);
+    //当前模型顶点缓冲的大小和每个顶点的字节数
+    qint64 meshVertexBytes() const { return m_meshVertexBytes; }
+    int meshVertexStride() const { return m_meshVertexStride; }
+    //当前模型的各级LOD, 全部在同一个索引缓冲里
+    const std::vector<MeshLod> &meshLods() const { return m_lods; }
+    //按投影到屏幕上的误差选LOD: 误差不超过threshold个像素的最粗一级; 关掉时都画LOD0
+    void setLodEnabled(bool enabled) { m_lodEnabled = enabled; }
+    bool lodEnabled() const { return m_lodEnabled; }
+    void setLodThreshold(float pixels) { m_lodThreshold = pixels; }
+    float lodThreshold() const { return m_lodThreshold; }
+    //本帧实际画的三角形数, 以及全部画LOD0时的三角形数
+    qint64 trianglesDrawn() const { return m_trianglesDrawn; }
+    qint64 trianglesFullDetail() const { return m_trianglesFull; }
+    void setTextureFilter(TextureFilter filter) { m_textureFilter = filter; }
+    TextureFilter textureFilter() const { return m_textureFilter; }
+    FrameProfiler &profiler() { return m_profiler; }
+    TextureLoader &textureLoader() { return m_textures; }
+    //program二进制缓存, 目录要在initialize之前设置; stats()里是启动时两个program的命中情况和耗时
+    ProgramCache &programCache() { return m_programs; }
+    //ShaderVariants::Textured/Lambert的组合; 新的组合在后台编译, 就绪前照旧用贴图不受光的基础变体画
+    void setShaderFeatures(int features) { m_shaderFeatures = features; }
+    int shaderFeatures() const { return m_shaderFeatures; }
+    ShaderVariants &shaderVariants() { return m_variants; }
+    //开发模式: 从这个目录读shader并在文件变化时热重载, 空字符串用编进资源的shader
+    void setShaderDirectory(const QString &directory) { m_variants.setSourceDirectory(directory); }
+    //还有变体在编译, 需要继续出帧才能换上
+    bool shadersPending() const { return m_variants.isPending(); }
+    //实例的世界空间包围盒索引, 第一次用到时才建
+    const Bvh &sceneIndex();
+    //每个实例一个实体, 绘制列表按块遍历它生成
+    const EntityStore &entities() const { return m_entities; }
+
+    //cursor是窗口坐标(原点在左下), viewport是(x, y, w, h); 用上一帧的m_camera/m_proj反投影出射线,
+    //先在BVH里找候选, 再把射线变到物体空间和立方体的三角形求交. 返回最近的实例, 没有返回-1
+    int pick(const glm::vec2 &cursor, const glm::vec4 &viewport, float *distance = nullptr);
+    //选中的实例画的时候叠一层高亮, -1表示不选
+    void setSelected(int instance) { m_selected = instance; }
+    int selected() const { return m_selected; }
+
+    //分别用逐个绘制和实例化绘制渲染10/1k/100k个立方体, 输出draw call数和平均帧时间
+    void runInstanceBenchmark();
+
+private:
+    //准备好的一帧: 排好序的绘制项和按顺序收集好的矩阵/材质. 建好之后只读, drawScene只照着提交GL命令.
+    //models的前instanceCount个是实例化绘制的全部可见实例, 按LOD排好, 第l级是从lodFirst[l]开始的lodInstances[l]个,
+    //每个非空的级别一项, payload是LOD号; 其余每个逐个绘制的项一个, 项的payload是它在models里的下标
+    struct FrameCommands
+    {
+        RenderQueue queue;
+        std::vector<glm::mat4> models;
+        std::vector<glm::u16vec2> materials;
+        int instanceCount = 0;
+        int lodFirst[MaxMeshLods] = {};
+        int lodInstances[MaxMeshLods] = {};
+    };
+
+    void buildInstanceField(int count);
+    void prepareFrame(FrameScheduler::DirtyFlags dirty);
+    void animateInstances();
+    int streamFrameData(const FrameCommands &frame);
+    void bindInstanceRange(const FrameCommands &frame, int base, int first);
+    void updateCameraBlock(FrameScheduler::DirtyFlags dirty);
+    void cullScene(FrameScheduler::DirtyFlags dirty);
+    void selectLods();
+    void dispatchGpuCulling();
+    void buildFrameCommands();
+    float viewDepth(unsigned instance) const;
+    void drawScene(const FrameCommands &frame);
+    void setupProgram(QOpenGLShaderProgram *program, int features);
+    void selectPrograms();
+
+    QOpenGLVertexArrayObject m_vao;
+    QOpenGLBuffer m_vbo;
+    QOpenGLBuffer m_ebo;
+    //m_vbo/m_ebo里的模型, 上传完文件映射就释放了, 只留绘制需要的参数
+    QString m_meshFileName;
+    VertexFormat m_vertexFormat;
+    qint64 m_meshVertexBytes;
+    int m_meshVertexStride;
+    MeshBuilder::Stats m_meshStats;
+    std::vector<MeshLod> m_lods;
+    GLenum m_indexType;
+    float m_meshRadius;
+    //纹理句柄, 实际的纹理对象由m_textures异步加载; m_texture3是另一种箱子的材质
+    TextureLoader m_textures;
+    int m_texture1, m_texture2, m_texture3;
+    //实例化路径用的纹理数组, 同样三张图各占一个region
+    TextureArray m_textureArray;
+    int m_regionContainer, m_regionFace, m_regionWall;
+    //逐个绘制时region对应的2D纹理句柄
+    std::vector<int> m_regionTextures;
+    SamplerCache m_samplers;
+    TextureFilter m_textureFilter;
+    ProgramCache m_programs;
+    ShaderVariants m_variants;
+    bool m_initialized;
+    //这一帧实际用的变体, 每帧在selectPrograms里重新取
+    QOpenGLShaderProgram *m_frameProgram;
+    int m_programGeneration;
+    QVector3D m_positionScale, m_positionOffset;
+    int m_shaderFeatures;
+    int m_meshFeatures;
+
+    //实例化绘制: 每帧所有实例的model矩阵连续写进m_stream的一段, 作为实例属性(attribute divisor)读取
+    StreamBuffer m_stream;
+    QOpenGLShaderProgram *m_frameInstanceProgram;
+    //每个实例一个根节点, 平移是实例的中心, 动画只改旋转; 世界矩阵就是model矩阵, 只有局部变换变了才重算
+    SceneGraph m_scene;
+    //每个实例一个实体: 位置/基础朝向/包围盒/材质/模型/实例号; m_instanceEntities[i]是实例i的实体
+    EntityStore m_entities;
+    std::vector<Entity> m_instanceEntities;
+    bool m_instanced;
+
+    //只有m_visible里的实例会被提交; 摄像机/投影/实例变化时才重新剔除
+    FrustumCuller m_culler;
+    std::vector<Aabb> m_instanceBounds;
+    Bvh m_bvh;
+    bool m_bvhDirty;
+    std::vector<unsigned> m_visible;
+    //GPU剔除: 实例数据在重建场景/动画之后才重新上传
+    GpuCuller m_gpuCuller;
+    bool m_gpuInstancesDirty;
+    bool m_gpuModelsDirty;
+    //按实例号的可见标记, 按实体块生成绘制列表时用
+    std::vector<unsigned char> m_instanceVisible;
+    CullMode m_cullMode;
+
+    //模型的三角形, 拾取时在物体空间里一次测4个
+    std::vector<TrianglePacket> m_meshPackets;
+    int m_selected;
+    bool m_cullDirty;
+    qint64 m_cullNsecs;
+
+    //每个实例当前用的LOD, 跨帧保留: 投影误差要明显越过阈值才换级, 在阈值附近来回时不会每帧跳
+    std::vector<unsigned char> m_instanceLod;
+    bool m_lodEnabled;
+    float m_lodThreshold;
+    qint64 m_trianglesDrawn;
+    qint64 m_trianglesFull;
+
+    //每帧的绘制按排序键提交, 状态切换经过m_state去重
+    FrameCommands m_frame;
+    std::vector<unsigned> m_modelSources;
+    //逐个绘制的项排序前按块的顺序写在这里, payload是下标
+    std::vector<unsigned> m_itemInstances;
+    std::vector<glm::u16vec2> m_itemMaterials;
+    StateTracker m_state;
+
+    JobSystem *m_jobs;
+    float m_animationTime;
+    bool m_animationDirty;
+    qint64 m_prepareNsecs;
+
+    //所有shader共用的std140 Camera块, 只有摄像机或投影变化时才重新上传
+    QOpenGLBuffer m_cameraUbo;
+    float m_aspect;
+    int m_viewportHeight;
+    int m_drawCalls;
+    int m_textureBinds;
+    FrameProfiler m_profiler;
+
+    int m_modelLoc;
+    int m_highlightLoc;
+    glm::vec3 m_cameraPos, m_cameraFront, m_cameraUp;
+    glm::mat4 m_camera;
+    glm::mat4 m_proj;
+};
+
+#endif // SCENERENDERER_H
@@ -0,0 +1,605 @@
+#include "shadervariants.h"
+#include "programcache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOffscreenSurface>
+#include <QFileSystemWatcher>
+#include <QCoreApplication>
+#include <QFile>
+#include <QDir>
+#include <QThread>
+
+#include <QDebug>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+class ShaderCompileThread : public QThread
+{
+public:
+    explicit ShaderCompileThread(ShaderVariants *variants) : m_variants(variants) {}
+
+protected:
+    void run() override { m_variants->workerLoop(); }
+
+private:
+    ShaderVariants *m_variants;
+};
+
+ShaderVariants::ShaderVariants(ProgramCache &cache)
+    : m_cache(cache)
+    , m_pending(0)
+    , m_generation(0)
+    , m_path(SynchronousCompile)
+    , m_watcher(nullptr)
+    , m_changedAt(0)
+    , m_maxShaderCompilerThreads(nullptr)
+    , m_workerContext(nullptr)
+    , m_workerSurface(nullptr)
+    , m_worker(nullptr)
+    , m_quit(false)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    stopWorker();
+    delete m_watcher;
+}
+
+void ShaderVariants::initialize(const Setup &setup)
+{
+    initializeOpenGLFunctions();
+    m_setup = setup;
+    m_clock.start();
+
+    //驱动自己能在后台编译时最省事: glLinkProgram立刻返回, 用GL_COMPLETION_STATUS_KHR查询是否完成
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    if(ctx->hasExtension("GL_KHR_parallel_shader_compile"))
+        m_maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreads>(ctx->getProcAddress("glMaxShaderCompilerThreadsKHR"));
+    else if(ctx->hasExtension("GL_ARB_parallel_shader_compile"))
+        m_maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreads>(ctx->getProcAddress("glMaxShaderCompilerThreadsARB"));
+    if(m_maxShaderCompilerThreads)
+    {
+        //0xFFFFFFFF表示由驱动决定线程数
+        m_maxShaderCompilerThreads(0xFFFFFFFFu);
+        m_path = ParallelShaderCompile;
+    }
+    else
+    {
+        //否则在共享context的线程里编译链接, program对象在共享组里, 链接好之后这边直接能用
+        m_workerSurface = new QOffscreenSurface;
+        m_workerSurface->setFormat(ctx->format());
+        m_workerSurface->create();
+        m_workerContext = new QOpenGLContext;
+        m_workerContext->setFormat(ctx->format());
+        m_workerContext->setShareContext(ctx);
+        if(m_workerContext->create() && QOpenGLContext::areSharing(ctx, m_workerContext))
+        {
+            m_quit = false;
+            m_worker = new ShaderCompileThread(this);
+            m_workerContext->moveToThread(m_worker);
+            m_worker->start();
+            m_path = SharedContextCompile;
+        }
+        else
+        {
+            delete m_workerContext;
+            m_workerContext = nullptr;
+            delete m_workerSurface;
+            m_workerSurface = nullptr;
+        }
+    }
+    qDebug() << "shader variants compile path:" << compilePathName(m_path);
+    watch();
+}
+
+void ShaderVariants::cleanup()
+{
+    stopWorker();
+    delete m_watcher;
+    m_watcher = nullptr;
+    for(Variant &variant : m_variants)
+    {
+        if(variant.job)
+            deleteShaders(variant.job->shaders, variant.shaders);
+        deleteShaders(variant.shaders, nullptr);
+        delete variant.job;
+        delete variant.next;
+        delete variant.program;
+        variant = Variant();
+    }
+    m_changedFiles.clear();
+    m_pending = 0;
+}
+
+void ShaderVariants::setSourceDirectory(const QString &directory)
+{
+    m_sourceDirectory = directory;
+    if(!m_clock.isValid())
+        return;
+    watch();
+    //换了目录等于所有源文件都变了, 内容和原来一样的变体在reload里会跳过
+    for(int features : { 0, int(Instanced) })
+    {
+        QString files[StageCount];
+        sources(features, files);
+        for(const QString &file : files)
+            m_changedFiles.append(file);
+    }
+    m_changedAt = m_clock.nsecsElapsed();
+}
+
+QOpenGLShaderProgram *ShaderVariants::build(int features)
+{
+    features = normalize(features);
+    Variant &variant = m_variants[features];
+    if(variant.program)
+        return variant.program;
+
+    QString files[StageCount];
+    sources(features, files);
+    const QByteArray defs = defines(features);
+    variant.program = m_cache.create(files[0], files[1], defs);
+    //记下源码, 热重载时用来判断哪个阶段变了; 着色器对象归QOpenGLShaderProgram管, 第一次重载时两个阶段都要编译
+    for(int i=0; i < StageCount; ++i)
+        variant.sources[i] = ProgramCache::source(files[i], defs);
+    variant.state = variant.program->isLinked() ? Ready : Failed;
+    if(variant.state == Ready)
+    {
+        ++m_generation;
+        m_setup(variant.program, features);
+    }
+    return variant.program;
+}
+
+QOpenGLShaderProgram *ShaderVariants::program(int features, int fallback)
+{
+    features = normalize(features);
+    Variant &variant = m_variants[features];
+    if(variant.state == Idle && !variant.next)
+    {
+        QString files[StageCount];
+        sources(features, files);
+        QByteArray texts[StageCount];
+        for(int i=0; i < StageCount; ++i)
+            texts[i] = ProgramCache::source(files[i], defines(features));
+        start(features, texts, false);
+    }
+    if(variant.program)
+        return variant.program;
+    ++m_stats.fallbacks;
+    return m_variants[normalize(fallback)].program;
+}
+
+void ShaderVariants::poll()
+{
+    if(!m_changedFiles.isEmpty())
+    {
+        const QStringList changed = m_changedFiles;
+        m_changedFiles.clear();
+        for(int features=0; features < FeatureCount; ++features)
+        {
+            QString files[StageCount];
+            sources(features, files);
+            if(changed.contains(files[0]) || changed.contains(files[1]))
+                reload(features);
+        }
+    }
+
+    if(m_pending == 0)
+        return;
+    for(int features=0; features < FeatureCount; ++features)
+    {
+        if(m_variants[features].next && isComplete(m_variants[features]))
+            finish(features);
+    }
+}
+
+QList<QOpenGLShaderProgram *> ShaderVariants::programs() const
+{
+    QList<QOpenGLShaderProgram *> result;
+    for(const Variant &variant : m_variants)
+    {
+        if(variant.state == Ready)
+            result.append(variant.program);
+    }
+    return result;
+}
+
+const char *ShaderVariants::compilePathName(CompilePath path)
+{
+    switch(path)
+    {
+    case ParallelShaderCompile:
+        return "parallel-shader-compile";
+    case SharedContextCompile:
+        return "shared-context";
+    default:
+        return "sync";
+    }
+}
+
+bool ShaderVariants::parseFeatures(const QString &text, int &features)
+{
+    features = 0;
+    for(const QString &token : text.split(QLatin1Char(','), QString::SkipEmptyParts))
+    {
+        const QString name = token.trimmed();
+        if(name == QLatin1String("textured"))
+            features |= Textured;
+        else if(name == QLatin1String("lambert"))
+            features |= Lambert;
+        else if(name != QLatin1String("unlit"))
+            return false;
+    }
+    return true;
+}
+
+QString ShaderVariants::featureNames(int features)
+{
+    QStringList names;
+    if(features & Instanced)
+        names << QStringLiteral("instanced");
+    if(features & Textured)
+        names << QStringLiteral("textured");
+    names << ((features & Lambert) ? QStringLiteral("lambert") : QStringLiteral("unlit"));
+    if(features & OctahedralNormal)
+        names << QStringLiteral("oct");
+    return names.join(QLatin1Char(','));
+}
+
+//不受光时用不到法线, 法线编码不需要单独的变体
+int ShaderVariants::normalize(int features)
+{
+    if(!(features & Lambert))
+        features &= ~OctahedralNormal;
+    return features & (FeatureCount - 1);
+}
+
+QByteArray ShaderVariants::defines(int features)
+{
+    QByteArray result;
+    if(features & Textured)
+        result += "#define TEXTURED\n";
+    result += (features & Lambert) ? "#define LIGHTING 1\n" : "#define LIGHTING 0\n";
+    if(features & OctahedralNormal)
+        result += "#define OCTAHEDRAL_NORMAL\n";
+    return result;
+}
+
+void ShaderVariants::sources(int features, QString files[StageCount]) const
+{
+    const char *const object[] = { "vertexShaderSource.vert", "fragmentShaderSource.frag" };
+    const char *const instanced[] = { "instanceShaderSource.vert", "arrayShaderSource.frag" };
+    for(int i=0; i < StageCount; ++i)
+    {
+        const QString name = QString::fromLatin1((features & Instanced) ? instanced[i] : object[i]);
+        files[i] = m_sourceDirectory.isEmpty() ? QStringLiteral(":/") + name : QDir(m_sourceDirectory).filePath(name);
+    }
+}
+
+//中间不查询任何状态, 否则parallel_shader_compile下会在这里等编译完成
+void ShaderVariants::compileAndLink(QOpenGLExtraFunctions *f, CompileJob *job)
+{
+    const GLenum types[StageCount] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for(int i=0; i < StageCount; ++i)
+    {
+        if(!job->shaders[i])
+        {
+            const GLuint shader = f->glCreateShader(types[i]);
+            const char *text = job->sources[i].constData();
+            const GLint length = job->sources[i].size();
+            f->glShaderSource(shader, 1, &text, &length);
+            f->glCompileShader(shader);
+            job->shaders[i] = shader;
+        }
+        f->glAttachShader(job->program, job->shaders[i]);
+    }
+    if(job->retrievable)
+        f->glProgramParameteri(job->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    f->glLinkProgram(job->program);
+}
+
+//源码和当前program一样的阶段直接挂上原来的着色器对象, 只编译变了的阶段
+void ShaderVariants::start(int features, const QByteArray sources[StageCount], bool reload)
+{
+    Variant &variant = m_variants[features];
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+    program->create();
+    const bool cached = m_cache.isEnabled();
+    const QByteArray key = cached ? m_cache.key(sources[0], sources[1]) : QByteArray();
+
+    //二进制加载很快, 直接在这里完成; 这样的program没有着色器对象
+    if(cached && m_cache.loadBinary(program->programId(), key) && program->link())
+    {
+        const GLuint none[StageCount] = {};
+        if(reload)
+            ++m_stats.reloads;
+        else
+            ++m_stats.cacheLoads;
+        install(features, program, none, sources);
+        return;
+    }
+
+    CompileJob *job = new CompileJob;
+    job->program = program->programId();
+    for(int i=0; i < StageCount; ++i)
+    {
+        job->sources[i] = sources[i];
+        job->shaders[i] = sources[i] == variant.sources[i] ? variant.shaders[i] : 0;
+    }
+    job->retrievable = cached;
+    variant.next = program;
+    variant.job = job;
+    variant.nextKey = key;
+    variant.requested = reload ? m_changedAt : m_clock.nsecsElapsed();
+    variant.reload = reload;
+    variant.stale = false;
+    ++m_pending;
+
+    if(m_path == SharedContextCompile)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_jobs.push_back(job);
+        m_wake.wakeOne();
+        return;
+    }
+    compileAndLink(this, job);
+    if(m_path == SynchronousCompile)
+        finish(features);
+}
+
+//没请求过的变体不用管, 用到时自然读新的源码
+void ShaderVariants::reload(int features)
+{
+    Variant &variant = m_variants[features];
+    if(variant.state == Idle && !variant.next)
+        return;
+    if(variant.next)
+    {
+        variant.stale = true;
+        return;
+    }
+
+    QString files[StageCount];
+    sources(features, files);
+    QByteArray texts[StageCount];
+    for(int i=0; i < StageCount; ++i)
+    {
+        //保存到一半的文件可能读不到, 等下一次变化
+        if(!QFile::exists(files[i]))
+            return;
+        texts[i] = ProgramCache::source(files[i], defines(features));
+    }
+    if(variant.state == Ready && texts[0] == variant.sources[0] && texts[1] == variant.sources[1])
+        return;
+    start(features, texts, true);
+}
+
+bool ShaderVariants::isComplete(const Variant &variant)
+{
+    if(m_path == SharedContextCompile)
+        return variant.job->done.loadAcquire() != 0;
+    if(m_path == ParallelShaderCompile)
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(variant.next->programId(), GL_COMPLETION_STATUS_KHR, &done);
+        return done != GL_FALSE;
+    }
+    return true;
+}
+
+void ShaderVariants::finish(int features)
+{
+    Variant &variant = m_variants[features];
+    CompileJob *job = variant.job;
+    QOpenGLShaderProgram *program = variant.next;
+    const GLuint id = program->programId();
+    variant.job = nullptr;
+    variant.next = nullptr;
+    --m_pending;
+
+    //新编译的阶段检查编译结果; 着色器对象从program上摘下来, 留给下次热重载复用
+    GLuint shaders[StageCount];
+    int compiledStages = 0;
+    for(int i=0; i < StageCount; ++i)
+    {
+        shaders[i] = job->shaders[i];
+        if(!shaders[i])
+            continue;
+        glDetachShader(id, shaders[i]);
+        if(shaders[i] == variant.shaders[i])
+            continue;
+        ++compiledStages;
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+        if(compiled == GL_FALSE)
+        {
+            GLint length = 0;
+            glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &length);
+            QByteArray log(qMax(length, 1), '\0');
+            glGetShaderInfoLog(shaders[i], length, nullptr, log.data());
+            qWarning() << "shader variant" << featureNames(features) << "compile failed:" << log.constData();
+        }
+    }
+
+    //没有着色器时link()只确认链接状态, 让QOpenGLShaderProgram记下已经链接好了
+    GLint status = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    if(status == GL_FALSE || !program->link())
+    {
+        GLint length = 0;
+        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+        QByteArray log(qMax(length, 1), '\0');
+        glGetProgramInfoLog(id, length, nullptr, log.data());
+        qWarning() << "shader variant" << featureNames(features) << "link failed:" << log.constData();
+        //原来的program和它的着色器对象保持不变
+        deleteShaders(shaders, variant.shaders);
+        delete program;
+        if(variant.reload)
+        {
+            ++m_stats.reloadFailures;
+        }
+        else
+        {
+            ++m_stats.failed;
+            variant.state = Failed;
+        }
+    }
+    else
+    {
+        const qint64 elapsed = m_clock.nsecsElapsed() - variant.requested;
+        if(variant.reload)
+        {
+            ++m_stats.reloads;
+            m_stats.stagesCompiled += compiledStages;
+            m_stats.lastReloadNsecs = elapsed;
+            qDebug("shader reload %s: %d stage(s) recompiled, %.1f ms",
+                   qPrintable(featureNames(features)), compiledStages, elapsed / 1e6);
+        }
+        else
+        {
+            ++m_stats.compiled;
+            m_stats.readyNsecs += elapsed;
+        }
+        if(!variant.nextKey.isEmpty())
+            m_cache.storeBinary(id, variant.nextKey);
+        //不热重载时着色器对象没用了
+        if(m_sourceDirectory.isEmpty())
+            deleteShaders(shaders, nullptr);
+        install(features, program, shaders, job->sources);
+    }
+    delete job;
+
+    if(variant.stale)
+    {
+        variant.stale = false;
+        reload(features);
+    }
+}
+
+//换上新的program, 旧program和新program没有复用的着色器对象一起删掉
+void ShaderVariants::install(int features, QOpenGLShaderProgram *program, const GLuint shaders[StageCount],
+                             const QByteArray sources[StageCount])
+{
+    Variant &variant = m_variants[features];
+    deleteShaders(variant.shaders, shaders);
+    delete variant.program;
+    variant.program = program;
+    for(int i=0; i < StageCount; ++i)
+    {
+        variant.shaders[i] = shaders[i];
+        variant.sources[i] = sources[i];
+    }
+    variant.state = Ready;
+    ++m_generation;
+    m_setup(program, features);
+}
+
+//删掉shaders里不在keep里的着色器对象并清零; keep为空时全删
+void ShaderVariants::deleteShaders(GLuint shaders[StageCount], const GLuint keep[StageCount])
+{
+    for(int i=0; i < StageCount; ++i)
+    {
+        if(!shaders[i])
+            continue;
+        bool kept = false;
+        for(int j=0; keep && j < StageCount; ++j)
+            kept = kept || keep[j] == shaders[i];
+        if(!kept)
+            glDeleteShader(shaders[i]);
+        shaders[i] = 0;
+    }
+}
+
+void ShaderVariants::watch()
+{
+    delete m_watcher;
+    m_watcher = nullptr;
+    if(m_sourceDirectory.isEmpty())
+        return;
+
+    m_watcher = new QFileSystemWatcher;
+    for(int features : { 0, int(Instanced) })
+    {
+        QString files[StageCount];
+        sources(features, files);
+        for(const QString &file : files)
+        {
+            if(!m_watcher->addPath(file))
+                qWarning() << "shader variants: cannot watch" << file;
+        }
+    }
+    QObject::connect(m_watcher, &QFileSystemWatcher::fileChanged, [this](const QString &path) { fileChanged(path); });
+}
+
+void ShaderVariants::fileChanged(const QString &path)
+{
+    if(!m_changedFiles.contains(path))
+        m_changedFiles.append(path);
+    m_changedAt = m_clock.nsecsElapsed();
+    //编辑器常常写到新文件再改名覆盖, 原来的路径会从监视列表里掉出去
+    if(!m_watcher->files().contains(path) && QFile::exists(path))
+        m_watcher->addPath(path);
+    if(m_changeCallback)
+        m_changeCallback();
+}
+
+void ShaderVariants::stopWorker()
+{
+    if(!m_worker)
+        return;
+    {
+        QMutexLocker lock(&m_mutex);
+        m_quit = true;
+        m_wake.wakeAll();
+    }
+    m_worker->wait();
+    delete m_worker;
+    m_worker = nullptr;
+    delete m_workerContext;
+    m_workerContext = nullptr;
+    delete m_workerSurface;
+    m_workerSurface = nullptr;
+    //剩下的任务归各自的Variant所有, 在cleanup里释放
+    m_jobs.clear();
+}
+
+void ShaderVariants::workerLoop()
+{
+    const bool current = m_workerContext->makeCurrent(m_workerSurface);
+    if(!current)
+        qWarning("shader variants: cannot make the compile context current");
+    QOpenGLExtraFunctions *f = m_workerContext->extraFunctions();
+    for(;;)
+    {
+        CompileJob *job = nullptr;
+        {
+            QMutexLocker lock(&m_mutex);
+            while(!m_quit && m_jobs.empty())
+                m_wake.wait(&m_mutex);
+            if(m_quit)
+                break;
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+        //context用不了时什么都不做, 主线程看到链接失败会继续用原来的program
+        if(current)
+        {
+            compileAndLink(f, job);
+            //完成之后另一个context才一定能看到编译和链接结果
+            f->glFinish();
+        }
+        job->done.storeRelease(1);
+    }
+    if(current)
+        m_workerContext->doneCurrent();
+    //回到GUI线程, 由stopWorker删除
+    m_workerContext->moveToThread(QCoreApplication::instance()->thread());
+}
@@ -0,0 +1,165 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <QOpenGLExtraFunctions>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+#include <deque>
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
+QT_FORWARD_DECLARE_CLASS(QOffscreenSurface)
+QT_FORWARD_DECLARE_CLASS(QFileSystemWatcher)
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+class ProgramCache;
+
+//场景shader的变体: 每种特性组合是一个program, 特性变成#define插进同一份源码(Instanced选实例化的那对源码).
+//变体第一次用到时才编译, 编译是异步的: 有GL_KHR/ARB_parallel_shader_compile时交给驱动的编译线程,
+//否则交给一个共享context的工作线程; 没就绪之前program()返回调用方给的基础变体, 帧循环不会卡在编译上.
+//ProgramCache里有二进制的变体直接加载, 不走异步编译.
+//
+//开发模式(setSourceDirectory)下源码从磁盘读并监视文件变化: 只重新编译内容变了的阶段, 没变的阶段复用
+//上次编译好的着色器对象, 同样异步链接, 在poll()里(两帧之间)换上; 编译或链接失败时继续用原来的program.
+class ShaderVariants : protected QOpenGLExtraFunctions
+{
+public:
+    //Lambert是光照模型(没有就是不受光); OctahedralNormal表示顶点里的法线是八面体编码的两个分量
+    enum Feature { Instanced = 0x1, Textured = 0x2, Lambert = 0x4, OctahedralNormal = 0x8, FeatureCount = 0x10 };
+    enum CompilePath { SynchronousCompile, ParallelShaderCompile, SharedContextCompile };
+
+    struct Stats
+    {
+        int compiled = 0;       //从源码编译完成的变体
+        int cacheLoads = 0;     //直接从二进制缓存加载的变体
+        int failed = 0;
+        qint64 fallbacks = 0;   //program()因为变体还没就绪而返回基础变体的次数
+        qint64 readyNsecs = 0;  //从第一次请求到就绪, 所有编译的变体加起来
+        int reloads = 0;        //热重载后换上的program
+        int reloadFailures = 0; //热重载失败, 继续用原来的program
+        int stagesCompiled = 0; //热重载时实际重新编译的阶段数
+        qint64 lastReloadNsecs = 0;     //最近一次从发现文件变化到换上新program
+    };
+
+    //变体就绪后在当前线程调用一次, 设置uniform和块绑定
+    typedef std::function<void(QOpenGLShaderProgram *program, int features)> Setup;
+
+    explicit ShaderVariants(ProgramCache &cache);
+    ~ShaderVariants();
+
+    //需要当前有GL context, 共享context的工作线程和它共享对象
+    void initialize(const Setup &setup);
+    void cleanup();
+
+    //空字符串用资源里的源码; 否则从这个目录读同名文件并监视变化, 可以在initialize之后切换
+    void setSourceDirectory(const QString &directory);
+    QString sourceDirectory() const { return m_sourceDirectory; }
+    //监视的文件变了, 在GUI线程调用; 变化要等下一次poll()才处理, 窗口要借此安排一帧
+    void setChangeCallback(const std::function<void()> &callback) { m_changeCallback = callback; }
+
+    //同步编译(或从缓存加载)并设置好, 初始化时建基础变体用
+    QOpenGLShaderProgram *build(int features);
+    //返回已就绪的变体; 第一次请求时开始异步编译, 没就绪之前返回fallback特性组合的变体
+    QOpenGLShaderProgram *program(int features, int fallback);
+    //处理文件变化, 收下编译完成的program并调用setup; 每帧画之前调用一次, 会改变当前绑定的program
+    void poll();
+    bool isPending() const { return m_pending > 0 || !m_changedFiles.isEmpty(); }
+    //每换上一个program加一, 缓存了uniform位置的调用方据此重新查询(新program可能复用旧的地址)
+    int generation() const { return m_generation; }
+    //所有已就绪的变体, 例如换模型后要重新设置反量化参数
+    QList<QOpenGLShaderProgram *> programs() const;
+
+    CompilePath compilePath() const { return m_path; }
+    static const char *compilePathName(CompilePath path);
+    const Stats &stats() const { return m_stats; }
+
+    //逗号分隔: textured, lambert(或unlit); 不在列表里的特性关闭
+    static bool parseFeatures(const QString &text, int &features);
+    static QString featureNames(int features);
+
+private:
+    friend class ShaderCompileThread;
+
+    enum State { Idle, Ready, Failed };
+    enum { StageCount = 2 };
+
+    //交给工作线程的编译任务: shaders[i]非0的阶段直接挂上, 其余的编译sources[i]后写回shaders[i].
+    //done在工作线程glFinish之后置1
+    struct CompileJob
+    {
+        GLuint program;
+        QByteArray sources[StageCount];
+        GLuint shaders[StageCount];
+        bool retrievable;
+        QAtomicInt done;
+    };
+
+    //program是正在用的, next是正在编译的(第一次编译或热重载); shaders/sources对应program
+    struct Variant
+    {
+        State state = Idle;
+        QOpenGLShaderProgram *program = nullptr;
+        GLuint shaders[StageCount] = {};
+        QByteArray sources[StageCount];
+        QOpenGLShaderProgram *next = nullptr;
+        CompileJob *job = nullptr;
+        QByteArray nextKey;
+        qint64 requested = 0;
+        bool reload = false;
+        bool stale = false;     //编译期间源码又变了, 完成后再来一次
+    };
+
+    static int normalize(int features);
+    static QByteArray defines(int features);
+    void sources(int features, QString files[StageCount]) const;
+    static void compileAndLink(QOpenGLExtraFunctions *f, CompileJob *job);
+
+    void start(int features, const QByteArray sources[StageCount], bool reload);
+    void reload(int features);
+    bool isComplete(const Variant &variant);
+    void finish(int features);
+    void install(int features, QOpenGLShaderProgram *program, const GLuint shaders[StageCount],
+                 const QByteArray sources[StageCount]);
+    void deleteShaders(GLuint shaders[StageCount], const GLuint keep[StageCount]);
+    void watch();
+    void fileChanged(const QString &path);
+    void stopWorker();
+    void workerLoop();
+
+    ProgramCache &m_cache;
+    Setup m_setup;
+    Variant m_variants[FeatureCount];
+    int m_pending;
+    int m_generation;
+    CompilePath m_path;
+    QElapsedTimer m_clock;
+    Stats m_stats;
+
+    QString m_sourceDirectory;
+    QFileSystemWatcher *m_watcher;
+    QStringList m_changedFiles;
+    qint64 m_changedAt;
+    std::function<void()> m_changeCallback;
+
+    //parallel_shader_compile: 只需要告诉驱动用多少线程
+    typedef void (QOPENGLF_APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+    MaxShaderCompilerThreads m_maxShaderCompilerThreads;
+
+    //共享context的工作线程
+    QOpenGLContext *m_workerContext;
+    QOffscreenSurface *m_workerSurface;
+    QThread *m_worker;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    std::deque<CompileJob *> m_jobs;
+    bool m_quit;
+};
+
+#endif // SHADERVARIANTS_H
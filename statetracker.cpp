@@ -0,0 +1,66 @@
+#include "statetracker.h"
+
+StateTracker::StateTracker()
+{
+    reset();
+}
+
+void StateTracker::initialize()
+{
+    initializeOpenGLFunctions();
+    reset();
+}
+
+void StateTracker::reset()
+{
+    m_program = ~0u;
+    m_vertexArray = ~0u;
+    m_activeUnit = -1;
+    for(int i=0; i < MaxUnits; ++i)
+    {
+        m_textures[i] = ~0u;
+        m_targets[i] = 0;
+    }
+}
+
+void StateTracker::useProgram(GLuint program)
+{
+    if(program == m_program)
+    {
+        ++m_stats.skipped;
+        return;
+    }
+    glUseProgram(program);
+    m_program = program;
+    ++m_stats.programBinds;
+}
+
+void StateTracker::bindVertexArray(GLuint vao)
+{
+    if(vao == m_vertexArray)
+    {
+        ++m_stats.skipped;
+        return;
+    }
+    glBindVertexArray(vao);
+    m_vertexArray = vao;
+    ++m_stats.vertexArrayBinds;
+}
+
+void StateTracker::bindTexture(int unit, GLenum target, GLuint texture)
+{
+    if(m_textures[unit] == texture && m_targets[unit] == target)
+    {
+        ++m_stats.skipped;
+        return;
+    }
+    if(unit != m_activeUnit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        m_activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    m_textures[unit] = texture;
+    m_targets[unit] = target;
+    ++m_stats.textureBinds;
+}
@@ -0,0 +1,45 @@
+#ifndef STATETRACKER_H
+#define STATETRACKER_H
+
+#include <QOpenGLExtraFunctions>
+
+//记住当前的program/VAO/每个单元的纹理, 和已经绑定的相同时不再调用GL.
+//绕过它直接改过这些状态(例如QOpenGLShaderProgram::bind)之后要reset.
+class StateTracker : protected QOpenGLExtraFunctions
+{
+public:
+    enum { MaxUnits = 16 };
+
+    struct Stats
+    {
+        int programBinds = 0;
+        int vertexArrayBinds = 0;
+        int textureBinds = 0;
+        int skipped = 0;        //因为状态没变而省掉的调用
+    };
+
+    StateTracker();
+
+    //需要当前有GL context
+    void initialize();
+    //忘掉缓存的状态, 下一次绑定一定会调用GL
+    void reset();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTexture(int unit, GLenum target, GLuint texture);
+
+    const Stats &stats() const { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+private:
+    //0是合法的状态, 用~0u表示未知
+    GLuint m_program;
+    GLuint m_vertexArray;
+    int m_activeUnit;
+    GLuint m_textures[MaxUnits];
+    GLenum m_targets[MaxUnits];
+    Stats m_stats;
+};
+
+#endif // STATETRACKER_H
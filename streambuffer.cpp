@@ -0,0 +1,197 @@
+#include "streambuffer.h"
+
+#include <QOpenGLContext>
+#include <QElapsedTimer>
+
+#include <QDebug>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (QOPENGLF_APIENTRYP PFNBUFFERSTORAGE)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+StreamBuffer::StreamBuffer(int frames)
+    : m_buffer(QOpenGLBuffer::VertexBuffer)
+    , m_mode(Orphan)
+    , m_frames(qBound(1, frames, 8))
+    , m_frameSize(0)
+    , m_segment(0)
+    , m_mapped(nullptr)
+    , m_bytesUploaded(0)
+    , m_fenceStalls(0)
+    , m_stallNsecs(0)
+{
+    for(int i=0; i < 8; ++i)
+        m_fences[i] = 0;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+}
+
+bool StreamBuffer::create(int frameSize)
+{
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    if(ctx == nullptr)
+        return false;
+    initializeOpenGLFunctions();
+
+    //每段的起始偏移同时要满足UBO的对齐要求
+    GLint align = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    align = qMax(align, 16);
+    m_frameSize = (frameSize + align - 1) / align * align;
+    m_segment = 0;
+
+    if(!m_buffer.create())
+        return false;
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer.bufferId());
+
+    const GLsizeiptr total = GLsizeiptr(m_frameSize) * m_frames;
+    PFNBUFFERSTORAGE bufferStorage = nullptr;
+    if(ctx->hasExtension("GL_ARB_buffer_storage") || ctx->format().version() >= qMakePair(4, 4))
+        bufferStorage = reinterpret_cast<PFNBUFFERSTORAGE>(ctx->getProcAddress("glBufferStorage"));
+
+    if(bufferStorage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        m_mapped = static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags));
+    }
+
+    if(m_mapped)
+    {
+        m_mode = Persistent;
+    }
+    else
+    {
+        //持久映射失败时glBufferStorage创建的是不可变存储, 需要换一个buffer对象再走orphan
+        if(bufferStorage)
+        {
+            m_buffer.destroy();
+            m_buffer.create();
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer.bufferId());
+        }
+        m_mode = Orphan;
+        glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+
+    qDebug() << "stream buffer:" << (m_mode == Persistent ? "persistent" : "orphan")
+             << m_frames << "x" << m_frameSize << "bytes";
+    return true;
+}
+
+void StreamBuffer::destroy()
+{
+    if(!m_buffer.isCreated())
+        return;
+
+    for(int i=0; i < m_frames; ++i)
+    {
+        if(m_fences[i])
+            glDeleteSync(m_fences[i]);
+        m_fences[i] = 0;
+    }
+
+    if(m_mapped)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer.bufferId());
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_mapped = nullptr;
+    }
+    m_buffer.destroy();
+}
+
+void StreamBuffer::reserve(int frameSize)
+{
+    if(frameSize <= m_frameSize)
+        return;
+
+    //按2倍增长, 避免实例数慢慢变多时每帧重建
+    int size = qMax(m_frameSize, 4096);
+    while(size < frameSize)
+        size *= 2;
+
+    destroy();
+    create(size);
+}
+
+void StreamBuffer::waitFence(int segment)
+{
+    GLsync fence = m_fences[segment];
+    if(fence == 0)
+        return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if(result == GL_TIMEOUT_EXPIRED)
+    {
+        ++m_fenceStalls;
+        QElapsedTimer timer;
+        timer.start();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while(result == GL_TIMEOUT_EXPIRED);
+        m_stallNsecs += timer.nsecsElapsed();
+    }
+
+    glDeleteSync(fence);
+    m_fences[segment] = 0;
+}
+
+void *StreamBuffer::beginFrame()
+{
+    if(m_mode == Persistent)
+    {
+        waitFence(m_segment);
+        return m_mapped + offset();
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer.bufferId());
+    if(m_segment == 0)
+    {
+        //回绕时orphan, 驱动给一块新存储, 旧的等GPU用完再回收, 所以之前的fence都不用等了
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(m_frameSize) * m_frames, nullptr, GL_STREAM_DRAW);
+        for(int i=0; i < m_frames; ++i)
+        {
+            if(m_fences[i])
+                glDeleteSync(m_fences[i]);
+            m_fences[i] = 0;
+        }
+    }
+    else
+    {
+        waitFence(m_segment);
+    }
+
+    return glMapBufferRange(GL_ARRAY_BUFFER, offset(), m_frameSize,
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void StreamBuffer::endFrame(int bytesWritten)
+{
+    m_bytesUploaded += bytesWritten;
+    if(m_mode == Orphan)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer.bufferId());
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+}
+
+void StreamBuffer::fenceFrame()
+{
+    if(m_fences[m_segment])
+        glDeleteSync(m_fences[m_segment]);
+    m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_segment = (m_segment + 1) % m_frames;
+}
+
+void StreamBuffer::resetCounters()
+{
+    m_bytesUploaded = 0;
+    m_fenceStalls = 0;
+    m_stallNsecs = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLBuffer>
+
+//每帧数据的环形上传缓冲: 一个buffer分成frames段, 每帧写一段, 用fence判断GPU是否已经用完这一段.
+//支持持久映射(glBufferStorage, GL 4.4 / ARB_buffer_storage)时整块只映射一次,
+//否则退回到glMapBufferRange + orphan(回绕时glBufferData(NULL)重新申请存储).
+class StreamBuffer : protected QOpenGLExtraFunctions
+{
+public:
+    enum Mode { Persistent, Orphan };
+
+    explicit StreamBuffer(int frames = 3);
+    ~StreamBuffer();
+
+    //需要当前有GL context
+    bool create(int frameSize);
+    void destroy();
+    //frameSize不够时重新创建, 之前设置的顶点指针/绑定需要重新指定
+    void reserve(int frameSize);
+
+    //返回当前段的写指针, 如果GPU还在读这一段会等待fence
+    void *beginFrame();
+    void endFrame(int bytesWritten);
+    //本帧使用这一段的draw call都提交之后调用
+    void fenceFrame();
+
+    GLuint bufferId() const { return m_buffer.bufferId(); }
+    int offset() const { return m_segment * m_frameSize; }
+    int frameSize() const { return m_frameSize; }
+    Mode mode() const { return m_mode; }
+
+    qint64 bytesUploaded() const { return m_bytesUploaded; }
+    qint64 fenceStalls() const { return m_fenceStalls; }
+    qint64 stallNsecs() const { return m_stallNsecs; }
+    void resetCounters();
+
+private:
+    void waitFence(int segment);
+
+    QOpenGLBuffer m_buffer;
+    Mode m_mode;
+    int m_frames;
+    int m_frameSize;
+    int m_segment;
+    char *m_mapped;
+    GLsync m_fences[8];
+
+    qint64 m_bytesUploaded;
+    qint64 m_fenceStalls;
+    qint64 m_stallNsecs;
+};
+
+#endif // STREAMBUFFER_H
@@ -0,0 +1,178 @@
+#include "texturearray.h"
+
+#include <cstring>
+
+#include <QDebug>
+
+TextureArray::TextureArray(int pageSize, int maxLayers)
+    : m_pageSize(pageSize)
+    , m_maxLayers(maxLayers)
+    , m_levels(1)
+    , m_texture(0)
+    , m_mipmapsDirty(false)
+    , m_regionUbo(QOpenGLBuffer::VertexBuffer)
+{
+}
+
+void TextureArray::initialize()
+{
+    initializeOpenGLFunctions();
+
+    while((m_pageSize >> m_levels) > 0)
+        ++m_levels;
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    for(int level=0; level < m_levels; ++level)
+    {
+        const int size = qMax(1, m_pageSize >> level);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, m_maxLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    m_packers.assign(m_maxLayers, RectPacker(m_pageSize, m_pageSize));
+
+    //UBO按std140: vec4 regionRect[MaxRegions]; vec4 regionLayer[MaxRegions];
+    m_regionUbo.create();
+    glBindBuffer(GL_UNIFORM_BUFFER, m_regionUbo.bufferId());
+    glBufferData(GL_UNIFORM_BUFFER, 2 * MaxRegions * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    QImage checker(4, 4, QImage::Format_RGBA8888);
+    for(int y=0; y < 4; ++y)
+        for(int x=0; x < 4; ++x)
+            checker.setPixel(x, y, ((x / 2 + y / 2) & 1) ? qRgb(128, 128, 128) : qRgb(255, 255, 255));
+    m_regions.clear();
+    reserve();
+    fill(0, checker, GL_RGBA);
+    generateMipmaps();
+}
+
+void TextureArray::cleanup()
+{
+    if(m_texture)
+        glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+    m_regionUbo.destroy();
+    m_mipmapsDirty = false;
+    m_packers.clear();
+    m_regions.clear();
+}
+
+int TextureArray::reserve()
+{
+    if(int(m_regions.size()) >= MaxRegions)
+    {
+        qWarning("texture array: out of regions");
+        return 0;
+    }
+
+    Region region = m_regions.empty() ? Region{ glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), 0 } : m_regions[0];
+    m_regions.push_back(region);
+    uploadRegions();
+    return int(m_regions.size()) - 1;
+}
+
+//加上两边的Gutter后宽或高超过一页的图找一个空层独占, 放在左上角, 和页一样大时REPEAT环绕和mipmap都不受影响;
+//小图四周留Gutter像素避免mip渗色
+bool TextureArray::allocate(int w, int h, int &layer, int &x, int &y)
+{
+    if(w + 2 * Gutter > m_pageSize || h + 2 * Gutter > m_pageSize)
+    {
+        for(layer=0; layer < m_maxLayers; ++layer)
+        {
+            if(m_packers[layer].isEmpty())
+            {
+                m_packers[layer].insert(m_pageSize, m_pageSize, x, y);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for(layer=0; layer < m_maxLayers; ++layer)
+    {
+        if(m_packers[layer].insert(w + 2 * Gutter, h + 2 * Gutter, x, y))
+        {
+            x += Gutter;
+            y += Gutter;
+            return true;
+        }
+    }
+    return false;
+}
+
+//四周复制边缘的像素, 缩小的mip在边上取样时混进的是图自己的边而不是相邻的图; 图是每像素4字节的
+static QImage padEdges(const QImage &image, int left, int top, int right, int bottom)
+{
+    const int w = image.width();
+    const int h = image.height();
+    QImage padded(left + w + right, top + h + bottom, image.format());
+    for(int y=0; y < padded.height(); ++y)
+    {
+        const quint32 *src = reinterpret_cast<const quint32 *>(image.constScanLine(qBound(0, y - top, h - 1)));
+        quint32 *dst = reinterpret_cast<quint32 *>(padded.scanLine(y));
+        for(int x=0; x < left; ++x)
+            dst[x] = src[0];
+        memcpy(dst + left, src, size_t(w) * 4);
+        for(int x=0; x < right; ++x)
+            dst[left + w + x] = src[w - 1];
+    }
+    return padded;
+}
+
+bool TextureArray::fill(int region, const QImage &source, GLenum format)
+{
+    QImage image = source;
+    if(image.width() > m_pageSize || image.height() > m_pageSize)
+        image = image.scaled(m_pageSize, m_pageSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    int layer = 0, x = 0, y = 0;
+    if(!allocate(image.width(), image.height(), layer, x, y))
+    {
+        qWarning() << "texture array: no space for" << image.size();
+        return false;
+    }
+
+    //gutter连同图一起上传; 独占一层的图贴着层的边, 那一侧没有gutter
+    const int left = qMin(int(Gutter), x);
+    const int top = qMin(int(Gutter), y);
+    const int right = qMin(int(Gutter), m_pageSize - x - image.width());
+    const int bottom = qMin(int(Gutter), m_pageSize - y - image.height());
+    const QImage padded = padEdges(image, left, top, right, bottom);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, padded.bytesPerLine() / 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x - left, y - top, layer, padded.width(), padded.height(), 1, format, GL_UNSIGNED_BYTE, padded.constBits());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    m_mipmapsDirty = true;
+
+    const float page = float(m_pageSize);
+    m_regions[region].rect = glm::vec4(x / page, y / page, image.width() / page, image.height() / page);
+    m_regions[region].layer = layer;
+    uploadRegions();
+    return true;
+}
+
+void TextureArray::generateMipmaps()
+{
+    if(!m_mipmapsDirty)
+        return;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    m_mipmapsDirty = false;
+}
+
+void TextureArray::uploadRegions()
+{
+    std::vector<glm::vec4> data(2 * MaxRegions, glm::vec4(0.0f));
+    for(size_t i=0; i < m_regions.size(); ++i)
+    {
+        data[i] = m_regions[i].rect;
+        data[MaxRegions + i] = glm::vec4(float(m_regions[i].layer), 0.0f, 0.0f, 0.0f);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_regionUbo.bufferId());
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size() * sizeof(glm::vec4), data.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
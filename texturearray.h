@@ -0,0 +1,61 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLBuffer>
+#include <QImage>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "rectpacker.h"
+
+//GL_TEXTURE_2D_ARRAY纹理管理: 宽或高放不下gutter的大图独占一层, 小图用RectPacker拼进共享的层(图集).
+//每张图对应一个region(层号 + 层内的uv偏移/缩放), region表放在一个std140 UBO里,
+//shader按实例传进来的region号取样, 这样不同纹理的物体可以一次draw call画完.
+class TextureArray : protected QOpenGLExtraFunctions
+{
+public:
+    enum { MaxRegions = 64, Gutter = 2 };
+
+    explicit TextureArray(int pageSize = 512, int maxLayers = 8);
+
+    //需要当前有GL context, 会分配全部层和mip链的存储, region 0是棋盘格占位
+    void initialize();
+    void cleanup();
+
+    //先占一个region号, 图没到之前指向占位region
+    int reserve();
+    //把解码好的图放进region(GL线程), 放不下时返回false, region继续用占位图.
+    //只上传第0级, 一批图放完之后调用generateMipmaps
+    bool fill(int region, const QImage &image, GLenum format);
+    //glGenerateMipmap会重算整个数组的所有层, 所以每批只做一次; 没有新图时什么也不做
+    void generateMipmaps();
+
+    GLuint textureId() const { return m_texture; }
+    GLuint regionBufferId() const { return m_regionUbo.bufferId(); }
+    int regionCount() const { return int(m_regions.size()); }
+    int layerCount() const { return m_maxLayers; }
+
+private:
+    struct Region
+    {
+        glm::vec4 rect;     //xy偏移, zw缩放
+        int layer;
+    };
+
+    bool allocate(int w, int h, int &layer, int &x, int &y);
+    void uploadRegions();
+
+    int m_pageSize;
+    int m_maxLayers;
+    int m_levels;
+    GLuint m_texture;
+    bool m_mipmapsDirty;
+    QOpenGLBuffer m_regionUbo;
+    std::vector<RectPacker> m_packers;
+    std::vector<Region> m_regions;
+};
+
+#endif // TEXTUREARRAY_H
@@ -0,0 +1,148 @@
+#include "texturecache.h"
+
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QDir>
+#include <QtEndian>
+
+#include <cstring>
+
+#include <QDebug>
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+static const char fileIdentifier[8] = { '\xAB', 'G', 'T', 'C', '1', '\xBB', '\r', '\n' };
+//编码器或文件格式改动时加一, 旧缓存自动失效
+static const char cacheVersion = 1;
+
+qint64 CompressedTexture::byteSize() const
+{
+    qint64 size = 0;
+    for(const Level &level : levels)
+        size += level.size;
+    return size;
+}
+
+TextureCache::TextureCache(const QString &directory)
+    : m_directory(directory)
+{
+    if(!m_directory.isEmpty())
+        QDir().mkpath(m_directory);
+}
+
+QByteArray TextureCache::key(const QByteArray &source, bool flipY)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(source);
+    hash.addData(flipY ? "flip" : "keep");
+    hash.addData(&cacheVersion, 1);
+    return hash.result().toHex();
+}
+
+QString TextureCache::path(const QByteArray &key) const
+{
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(key) + QStringLiteral(".gtc");
+}
+
+std::shared_ptr<CompressedTexture> TextureCache::load(const QByteArray &key) const
+{
+    std::shared_ptr<CompressedTexture> texture = std::make_shared<CompressedTexture>();
+    texture->m_file.setFileName(path(key));
+    if(!texture->m_file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    //整个文件映射一次, 后面只解析头和记录每级的指针, 不再拷贝
+    const qint64 fileSize = texture->m_file.size();
+    const uchar *data = texture->m_file.map(0, fileSize);
+    if(data == nullptr || fileSize < 24 || memcmp(data, fileIdentifier, 8) != 0)
+        return nullptr;
+
+    texture->glFormat = qFromLittleEndian<quint32>(data + 8);
+    texture->width = int(qFromLittleEndian<quint32>(data + 12));
+    texture->height = int(qFromLittleEndian<quint32>(data + 16));
+    const int levelCount = int(qFromLittleEndian<quint32>(data + 20));
+    //只认build写出的两种格式; 级数超过32说明头坏了
+    if((texture->glFormat != GL_COMPRESSED_RGBA_S3TC_DXT1_EXT && texture->glFormat != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            || texture->width <= 0 || texture->height <= 0 || levelCount < 1 || levelCount > 32)
+        return nullptr;
+    const qint64 blockBytes = TextureCompressor::blockBytes(texture->glFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? TextureCompressor::BC1 : TextureCompressor::BC3);
+
+    qint64 offset = 24;
+    for(int i=0; i < levelCount; ++i)
+    {
+        if(offset + 12 > fileSize)
+            return nullptr;
+        CompressedTexture::Level level;
+        level.width = int(qFromLittleEndian<quint32>(data + offset));
+        level.height = int(qFromLittleEndian<quint32>(data + offset + 4));
+        level.size = int(qFromLittleEndian<quint32>(data + offset + 8));
+        level.data = data + offset + 12;
+        //每级的大小必须和4x4块数对得上, 否则glCompressedTexImage2D会报错
+        if(level.width <= 0 || level.height <= 0
+                || level.size != (qint64(level.width) + 3) / 4 * ((qint64(level.height) + 3) / 4) * blockBytes)
+            return nullptr;
+        offset += 12 + ((qint64(level.size) + 3) & ~qint64(3));
+        if(offset > fileSize)
+            return nullptr;
+        texture->levels.push_back(level);
+    }
+    return texture;
+}
+
+std::shared_ptr<CompressedTexture> TextureCache::build(const QByteArray &key, const QImage &rgba) const
+{
+    const int w = rgba.width();
+    const int h = rgba.height();
+    //编码器要求紧密排列, RGBA8888每行本来就是4字节对齐, 宽*4正好等于bytesPerLine
+    const uint8_t *pixels = rgba.constBits();
+
+    const TextureCompressor::Format format = TextureCompressor::chooseFormat(pixels, w, h);
+
+    std::shared_ptr<CompressedTexture> texture = std::make_shared<CompressedTexture>();
+    texture->m_owned = TextureCompressor::encodeMipChain(format, pixels, w, h);
+    texture->glFormat = format == TextureCompressor::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    texture->width = w;
+    texture->height = h;
+    for(const TextureCompressor::Level &owned : texture->m_owned)
+    {
+        CompressedTexture::Level level;
+        level.width = owned.width;
+        level.height = owned.height;
+        level.data = owned.data.data();
+        level.size = int(owned.data.size());
+        texture->levels.push_back(level);
+    }
+
+    //QSaveFile先写临时文件再改名, 两个线程同时生成同一个键也不会读到半个文件
+    QSaveFile file(path(key));
+    if(file.open(QIODevice::WriteOnly))
+    {
+        uchar header[24];
+        memcpy(header, fileIdentifier, 8);
+        qToLittleEndian<quint32>(texture->glFormat, header + 8);
+        qToLittleEndian<quint32>(quint32(w), header + 12);
+        qToLittleEndian<quint32>(quint32(h), header + 16);
+        qToLittleEndian<quint32>(quint32(texture->levels.size()), header + 20);
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+        const char padding[4] = { 0, 0, 0, 0 };
+        for(const CompressedTexture::Level &level : texture->levels)
+        {
+            uchar levelHeader[12];
+            qToLittleEndian<quint32>(quint32(level.width), levelHeader);
+            qToLittleEndian<quint32>(quint32(level.height), levelHeader + 4);
+            qToLittleEndian<quint32>(quint32(level.size), levelHeader + 8);
+            file.write(reinterpret_cast<const char *>(levelHeader), sizeof(levelHeader));
+            file.write(reinterpret_cast<const char *>(level.data), level.size);
+            file.write(padding, ((level.size + 3) & ~3) - level.size);
+        }
+        if(!file.commit())
+            qWarning() << "texture cache: cannot write" << file.fileName();
+    }
+    return texture;
+}
@@ -0,0 +1,63 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <qopengl.h>
+
+#include <memory>
+#include <vector>
+
+#include "texturecompressor.h"
+
+//预压缩纹理: 每级mip直接指向内存映射的文件内容(或者刚编码出来的内存), 可以原样交给glCompressedTexImage2D
+class CompressedTexture
+{
+public:
+    struct Level
+    {
+        int width, height;
+        const uchar *data;
+        int size;
+    };
+
+    GLenum glFormat = 0;
+    int width = 0, height = 0;
+    std::vector<Level> levels;
+
+    qint64 byteSize() const;
+
+private:
+    friend class TextureCache;
+
+    QFile m_file;
+    std::vector<TextureCompressor::Level> m_owned;
+};
+
+//以源文件内容的哈希为键的磁盘缓存, 文件格式仿照KTX:
+//  8字节标识, glInternalFormat, width, height, mip级数, 然后每级 width/height/imageSize + 数据(按4字节对齐)
+//目录和键之外没有可变状态, 可以在多个解码线程里同时使用.
+class TextureCache
+{
+public:
+    explicit TextureCache(const QString &directory = QString());
+
+    bool isEnabled() const { return !m_directory.isEmpty(); }
+    QString directory() const { return m_directory; }
+
+    static QByteArray key(const QByteArray &source, bool flipY);
+
+    //命中时返回映射好的纹理, 文件不存在或格式不对返回nullptr
+    std::shared_ptr<CompressedTexture> load(const QByteArray &key) const;
+    //把RGBA8888的图编码成BC1/BC3 mip链, 写入缓存并返回内存里的结果
+    std::shared_ptr<CompressedTexture> build(const QByteArray &key, const QImage &rgba) const;
+
+private:
+    QString path(const QByteArray &key) const;
+
+    QString m_directory;
+};
+
+#endif // TEXTURECACHE_H
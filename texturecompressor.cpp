@@ -0,0 +1,225 @@
+#include "texturecompressor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static inline uint16_t packRgb565(int r, int g, int b)
+{
+    return uint16_t(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static inline void unpackRgb565(uint16_t c, int rgb[3])
+{
+    const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+int TextureCompressor::levelSize(Format format, int width, int height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+TextureCompressor::Format TextureCompressor::chooseFormat(const uint8_t *rgba, int width, int height)
+{
+    const size_t count = size_t(width) * height;
+    for(size_t i=0; i < count; ++i)
+    {
+        if(rgba[i * 4 + 3] != 255)
+            return BC3;
+    }
+    return BC1;
+}
+
+//端点取块内颜色在主方向(近似为包围盒对角线)上的两端, 然后每个像素选调色板里最近的一个
+void TextureCompressor::encodeColorBlock(const uint8_t block[64], uint8_t out[8])
+{
+    int minC[3] = { 255, 255, 255 }, maxC[3] = { 0, 0, 0 };
+    for(int i=0; i < 16; ++i)
+    {
+        for(int c=0; c < 3; ++c)
+        {
+            minC[c] = std::min(minC[c], int(block[i * 4 + c]));
+            maxC[c] = std::max(maxC[c], int(block[i * 4 + c]));
+        }
+    }
+
+    //包围盒往里收1/16, 减少离群像素对端点的影响
+    for(int c=0; c < 3; ++c)
+    {
+        const int inset = (maxC[c] - minC[c]) >> 4;
+        minC[c] += inset;
+        maxC[c] -= inset;
+    }
+
+    uint16_t c0 = packRgb565(maxC[0], maxC[1], maxC[2]);
+    uint16_t c1 = packRgb565(minC[0], minC[1], minC[2]);
+    if(c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if(c0 != c1)
+    {
+        //c0 > c1时是4色模式: c0, c1, 2/3c0+1/3c1, 1/3c0+2/3c1
+        int palette[4][3];
+        unpackRgb565(c0, palette[0]);
+        unpackRgb565(c1, palette[1]);
+        for(int c=0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for(int i=0; i < 16; ++i)
+        {
+            int best = 0, bestDist = 1 << 30;
+            for(int p=0; p < 4; ++p)
+            {
+                const int dr = block[i * 4 + 0] - palette[p][0];
+                const int dg = block[i * 4 + 1] - palette[p][1];
+                const int db = block[i * 4 + 2] - palette[p][2];
+                const int dist = dr * dr + dg * dg + db * db;
+                if(dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+
+    out[0] = uint8_t(c0 & 0xff);
+    out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1 & 0xff);
+    out[3] = uint8_t(c1 >> 8);
+    out[4] = uint8_t(indices & 0xff);
+    out[5] = uint8_t((indices >> 8) & 0xff);
+    out[6] = uint8_t((indices >> 16) & 0xff);
+    out[7] = uint8_t(indices >> 24);
+}
+
+//BC3的alpha块: a0 > a1时8级插值, 每像素3bit索引
+void TextureCompressor::encodeAlphaBlock(const uint8_t block[64], uint8_t out[8])
+{
+    int a0 = 0, a1 = 255;
+    for(int i=0; i < 16; ++i)
+    {
+        a0 = std::max(a0, int(block[i * 4 + 3]));
+        a1 = std::min(a1, int(block[i * 4 + 3]));
+    }
+
+    uint64_t indices = 0;
+    if(a0 != a1)
+    {
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for(int p=1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+        for(int i=0; i < 16; ++i)
+        {
+            int best = 0, bestDist = 1 << 30;
+            for(int p=0; p < 8; ++p)
+            {
+                const int dist = std::abs(block[i * 4 + 3] - palette[p]);
+                if(dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+
+    out[0] = uint8_t(a0);
+    out[1] = uint8_t(a1);
+    for(int b=0; b < 6; ++b)
+        out[2 + b] = uint8_t((indices >> (8 * b)) & 0xff);
+}
+
+std::vector<uint8_t> TextureCompressor::encode(Format format, const uint8_t *rgba, int width, int height)
+{
+    std::vector<uint8_t> out(levelSize(format, width, height));
+    uint8_t *dst = out.data();
+
+    uint8_t block[64];
+    for(int by=0; by < height; by += 4)
+    {
+        for(int bx=0; bx < width; bx += 4)
+        {
+            //超出边界的像素用最近的边缘像素补齐
+            for(int y=0; y < 4; ++y)
+            {
+                const int sy = std::min(by + y, height - 1);
+                for(int x=0; x < 4; ++x)
+                {
+                    const int sx = std::min(bx + x, width - 1);
+                    memcpy(block + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+                }
+            }
+
+            if(format == BC3)
+            {
+                encodeAlphaBlock(block, dst);
+                dst += 8;
+            }
+            encodeColorBlock(block, dst);
+            dst += 8;
+        }
+    }
+    return out;
+}
+
+std::vector<uint8_t> TextureCompressor::downsample(const uint8_t *rgba, int width, int height)
+{
+    const int w = std::max(1, width / 2);
+    const int h = std::max(1, height / 2);
+    std::vector<uint8_t> out(size_t(w) * h * 4);
+
+    for(int y=0; y < h; ++y)
+    {
+        const int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for(int x=0; x < w; ++x)
+        {
+            const int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for(int c=0; c < 4; ++c)
+            {
+                const int sum = rgba[(size_t(y0) * width + x0) * 4 + c] + rgba[(size_t(y0) * width + x1) * 4 + c]
+                              + rgba[(size_t(y1) * width + x0) * 4 + c] + rgba[(size_t(y1) * width + x1) * 4 + c];
+                out[(size_t(y) * w + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<TextureCompressor::Level> TextureCompressor::encodeMipChain(Format format, const uint8_t *rgba, int width, int height)
+{
+    std::vector<Level> levels;
+    std::vector<uint8_t> current;
+    const uint8_t *src = rgba;
+    int w = width, h = height;
+
+    while(true)
+    {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.data = encode(format, src, w, h);
+        levels.push_back(std::move(level));
+
+        if(w == 1 && h == 1)
+            break;
+
+        current = downsample(src, w, h);
+        src = current.data();
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    return levels;
+}
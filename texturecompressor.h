@@ -0,0 +1,35 @@
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include <cstdint>
+#include <vector>
+
+//CPU端的BC1(DXT1)/BC3(DXT5)编码和mip链生成, 只依赖标准库, 在解码线程里调用.
+//输入都是紧密排列的RGBA8, 尺寸不要求是4的倍数(边缘块按边界像素补齐).
+class TextureCompressor
+{
+public:
+    enum Format { BC1, BC3 };
+
+    struct Level
+    {
+        int width, height;
+        std::vector<uint8_t> data;
+    };
+
+    //不透明的图用BC1(每像素4bit), 有alpha的用BC3(每像素8bit)
+    static Format chooseFormat(const uint8_t *rgba, int width, int height);
+    static std::vector<uint8_t> encode(Format format, const uint8_t *rgba, int width, int height);
+    //生成从原图到1x1的完整mip链(2x2盒式滤波)并逐级编码
+    static std::vector<Level> encodeMipChain(Format format, const uint8_t *rgba, int width, int height);
+
+    static int blockBytes(Format format) { return format == BC1 ? 8 : 16; }
+    static int levelSize(Format format, int width, int height);
+
+private:
+    static void encodeColorBlock(const uint8_t block[64], uint8_t out[8]);
+    static void encodeAlphaBlock(const uint8_t block[64], uint8_t out[8]);
+    static std::vector<uint8_t> downsample(const uint8_t *rgba, int width, int height);
+};
+
+#endif // TEXTURECOMPRESSOR_H
@@ -0,0 +1,367 @@
+#include "textureloader.h"
+
+#include <QImageReader>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDebug>
+
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+
+class TextureLoader::DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(TextureLoader *loader, int handle, const QString &fileName, bool flipY, bool allowCompressed)
+        : m_loader(loader), m_handle(handle), m_fileName(fileName), m_flipY(flipY), m_allowCompressed(allowCompressed) {}
+
+    void run() override { m_loader->decodeTask(m_handle, m_fileName, m_flipY, m_allowCompressed); }
+
+private:
+    TextureLoader *m_loader;
+    int m_handle;
+    QString m_fileName;
+    bool m_flipY;
+    bool m_allowCompressed;
+};
+
+TextureLoader::TextureLoader(QObject *parent)
+    : QObject(parent)
+    , m_cacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/textures"))
+    , m_inFlight(0)
+    , m_placeholder(0)
+    , m_pbo(QOpenGLBuffer::PixelUnpackBuffer)
+    , m_pboSize(0)
+{
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+TextureLoader::~TextureLoader()
+{
+    m_pool.waitForDone();
+}
+
+void TextureLoader::setCacheDirectory(const QString &directory)
+{
+    m_cacheDirectory = directory;
+}
+
+void TextureLoader::initialize()
+{
+    initializeOpenGLFunctions();
+
+    //BC1/BC3需要S3TC扩展, 不支持时退回直接解码上传
+    if(QOpenGLContext::currentContext()->hasExtension("GL_EXT_texture_compression_s3tc"))
+        m_cache = TextureCache(m_cacheDirectory);
+    else
+        m_cache = TextureCache();
+
+    //2x2棋盘格占位, 一眼能看出纹理还没到
+    const GLubyte pixels[] = {
+        255, 255, 255, 255,   128, 128, 128, 255,
+        128, 128, 128, 255,   255, 255, 255, 255
+    };
+    glGenTextures(1, &m_placeholder);
+    glBindTexture(GL_TEXTURE_2D, m_placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    //采样状态由SamplerCache的sampler对象决定, 纹理本身只需要保证mip链完整
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    m_pbo.create();
+}
+
+void TextureLoader::cleanup()
+{
+    m_pool.waitForDone();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_ready.clear();
+        m_inFlight = 0;
+    }
+
+    for(Entry &entry : m_entries)
+    {
+        if(entry.resident && entry.array == nullptr)
+            glDeleteTextures(1, &entry.texture);
+    }
+    m_entries.clear();
+
+    if(m_placeholder)
+        glDeleteTextures(1, &m_placeholder);
+    m_placeholder = 0;
+    m_pbo.destroy();
+    m_pboSize = 0;
+}
+
+//QImage按行从上到下存储, GL纹理第一行在底部; 需要翻转时直接在解码出来的图上交换行
+static void flipRows(QImage &image)
+{
+    const int h = image.height();
+    const int bpl = image.bytesPerLine();
+    for(int y=0; y < h / 2; ++y)
+    {
+        uchar *top = image.scanLine(y);
+        uchar *bottom = image.scanLine(h - 1 - y);
+        std::swap_ranges(top, top + bpl, bottom);
+    }
+}
+
+//缓存的键是源文件内容的哈希; 源文件尽量映射着读, 命中时只多一次哈希, 不解码
+TextureLoader::Decoded TextureLoader::decodeCompressed(int handle, const QString &fileName, bool flipY)
+{
+    Decoded decoded;
+    decoded.handle = handle;
+    decoded.format = GL_RGBA;
+    decoded.cacheHit = false;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "texture loader:" << fileName << file.errorString();
+        return decoded;
+    }
+    const uchar *mapped = file.map(0, file.size());
+    const QByteArray source = mapped ? QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(file.size()))
+                                     : file.readAll();
+
+    const QByteArray key = TextureCache::key(source, flipY);
+    decoded.compressed = m_cache.load(key);
+    decoded.cacheHit = decoded.compressed != nullptr;
+    if(decoded.cacheHit)
+        return decoded;
+
+    QImage image = QImage::fromData(source).convertToFormat(QImage::Format_RGBA8888);
+    if(image.isNull())
+    {
+        qWarning() << "texture loader: cannot decode" << fileName;
+        return decoded;
+    }
+    if(flipY)
+        flipRows(image);
+    decoded.compressed = m_cache.build(key, image);
+    return decoded;
+}
+
+TextureLoader::Decoded TextureLoader::decode(int handle, const QString &fileName, bool flipY, bool allowCompressed)
+{
+    if(allowCompressed && m_cache.isEnabled())
+        return decodeCompressed(handle, fileName, flipY);
+
+    Decoded decoded;
+    decoded.handle = handle;
+    decoded.cacheHit = false;
+
+    QImageReader reader(fileName);
+    if(!reader.read(&decoded.image))
+    {
+        qWarning() << "texture loader:" << fileName << reader.errorString();
+        decoded.image = QImage();
+        decoded.format = GL_RGBA;
+        return decoded;
+    }
+
+    //RGB32/ARGB32在小端机器上的字节序是B,G,R,A, 直接按GL_BGRA上传, 省掉一次格式转换
+    if(decoded.image.format() == QImage::Format_RGB32 || decoded.image.format() == QImage::Format_ARGB32)
+    {
+        decoded.format = GL_BGRA;
+    }
+    else
+    {
+        decoded.image = decoded.image.convertToFormat(QImage::Format_RGBA8888);
+        decoded.format = GL_RGBA;
+    }
+
+    if(flipY)
+        flipRows(decoded.image);
+    return decoded;
+}
+
+int TextureLoader::request(const QString &fileName, bool flipY)
+{
+    const int handle = int(m_entries.size());
+    Entry entry;
+    entry.texture = m_placeholder;
+    m_entries.push_back(entry);
+
+    start(handle, fileName, flipY, true);
+    return handle;
+}
+
+int TextureLoader::requestRegion(const QString &fileName, bool flipY, TextureArray *array, int region)
+{
+    const int handle = int(m_entries.size());
+    Entry entry;
+    entry.array = array;
+    entry.region = region;
+    m_entries.push_back(entry);
+
+    start(handle, fileName, flipY, false);
+    return handle;
+}
+
+void TextureLoader::start(int handle, const QString &fileName, bool flipY, bool allowCompressed)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_inFlight;
+    }
+
+    m_pool.start(new DecodeTask(this, handle, fileName, flipY, allowCompressed));
+}
+
+void TextureLoader::decodeTask(int handle, const QString &fileName, bool flipY, bool allowCompressed)
+{
+    QElapsedTimer timer;
+    timer.start();
+    Decoded decoded = decode(handle, fileName, flipY, allowCompressed);
+    const qint64 elapsed = timer.nsecsElapsed();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stats.loadNsecs += elapsed;
+        if(decoded.compressed)
+        {
+            if(decoded.cacheHit)
+                ++m_stats.cacheHits;
+            else
+                ++m_stats.cacheMisses;
+            for(const CompressedTexture::Level &level : decoded.compressed->levels)
+                m_stats.rgbaBytes += qint64(level.width) * level.height * 4;
+            m_stats.gpuBytes += decoded.compressed->byteSize();
+        }
+        else if(!decoded.image.isNull())
+        {
+            //glGenerateMipmap生成的整条mip链约为原图的4/3
+            const qint64 bytes = qint64(decoded.image.width()) * decoded.image.height() * 4 * 4 / 3;
+            ++m_stats.uncompressed;
+            m_stats.rgbaBytes += bytes;
+            m_stats.gpuBytes += bytes;
+        }
+        m_ready.push_back(decoded);
+    }
+    emit textureDecoded();
+}
+
+int TextureLoader::poll()
+{
+    std::vector<Decoded> ready;
+    {
+        QMutexLocker locker(&m_mutex);
+        if(m_ready.empty())
+            return 0;
+        ready.swap(m_ready);
+        m_inFlight -= int(ready.size());
+    }
+
+    for(const Decoded &decoded : ready)
+        upload(decoded);
+    //纹理数组的mip链每批重建一次, 不是每张图一次
+    for(const Decoded &decoded : ready)
+    {
+        if(TextureArray *array = m_entries[decoded.handle].array)
+            array->generateMipmaps();
+    }
+    return int(ready.size());
+}
+
+//整张图拷进PBO后从PBO上传, glTexImage2D读PBO时驱动可以异步DMA, 不用等拷贝完成; mip链由驱动生成
+void TextureLoader::upload(const Decoded &decoded)
+{
+    if(decoded.compressed)
+    {
+        uploadCompressed(decoded);
+        return;
+    }
+    if(decoded.image.isNull())
+        return;
+
+    Entry &target = m_entries[decoded.handle];
+    if(target.array)
+    {
+        target.resident = target.array->fill(target.region, decoded.image, decoded.format);
+        return;
+    }
+
+    const int w = decoded.image.width();
+    const int h = decoded.image.height();
+    const int bpl = decoded.image.bytesPerLine();
+    const int size = bpl * h;
+
+    m_pbo.bind();
+    if(size > m_pboSize)
+        m_pboSize = size;
+    //每次都orphan, 上一次的上传还没读完也不会等
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pboSize, nullptr, GL_STREAM_DRAW);
+    void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    const bool mapped = ptr != nullptr;
+    if(mapped)
+    {
+        memcpy(ptr, decoded.image.constBits(), size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else
+    {
+        //映射失败就直接从内存上传
+        m_pbo.release();
+    }
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, bpl / 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, decoded.format, GL_UNSIGNED_BYTE, mapped ? nullptr : decoded.image.constBits());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    if(mapped)
+        m_pbo.release();
+
+    Entry &entry = m_entries[decoded.handle];
+    entry.texture = texture;
+    entry.resident = true;
+}
+
+//每级mip直接从映射的缓存文件交给驱动, 中间没有拷贝
+void TextureLoader::uploadCompressed(const Decoded &decoded)
+{
+    const CompressedTexture &compressed = *decoded.compressed;
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for(size_t i=0; i < compressed.levels.size(); ++i)
+    {
+        const CompressedTexture::Level &level = compressed.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), compressed.glFormat, level.width, level.height, 0, level.size, level.data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(compressed.levels.size()) - 1);
+
+    Entry &entry = m_entries[decoded.handle];
+    entry.texture = texture;
+    entry.resident = true;
+}
+
+TextureLoader::Stats TextureLoader::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+void TextureLoader::finish()
+{
+    m_pool.waitForDone();
+    poll();
+}
+
+int TextureLoader::pendingCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_inFlight;
+}
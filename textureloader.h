@@ -0,0 +1,104 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <QObject>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLBuffer>
+#include <QThreadPool>
+#include <QMutex>
+#include <QImage>
+
+#include <vector>
+#include <memory>
+
+#include "texturecache.h"
+#include "texturearray.h"
+
+//纹理异步加载: 图片在线程池里解码(需要翻转的在解码线程里原地交换行, 不再额外mirrored()一份),
+//GL线程在poll()里通过PBO上传. 图片到达之前textureId()返回占位纹理.
+//驱动支持S3TC时, 首次加载把图片编码成BC1/BC3 mip链存进磁盘缓存, 之后直接映射缓存文件用glCompressedTexImage2D上传.
+class TextureLoader : public QObject, protected QOpenGLExtraFunctions
+{
+    Q_OBJECT
+public:
+    //纹理内存和加载时间统计, 用来对比压缩缓存和直接解码QImage
+    struct Stats
+    {
+        int cacheHits = 0;
+        int cacheMisses = 0;
+        int uncompressed = 0;
+        qint64 rgbaBytes = 0;   //同样的mip链用RGBA8存放需要的字节数
+        qint64 gpuBytes = 0;    //实际上传的字节数
+        qint64 loadNsecs = 0;   //解码线程里读文件+解码(+编码)的总耗时
+    };
+
+    explicit TextureLoader(QObject *parent = nullptr);
+    ~TextureLoader();
+
+    //空字符串关闭压缩缓存; 要在initialize()之前设置
+    void setCacheDirectory(const QString &directory);
+
+    //需要当前有GL context
+    void initialize();
+    void cleanup();
+
+    //返回句柄, 立即可以用textureId(handle)绑定(先是占位纹理)
+    int request(const QString &fileName, bool flipY);
+    //解码后放进纹理数组的region里而不是单独建纹理; 纹理数组要RGBA8, 所以不走压缩缓存
+    int requestRegion(const QString &fileName, bool flipY, TextureArray *array, int region);
+    //把已经解码好的图片上传到GL, 返回本次上传的数量
+    int poll();
+    //等所有解码完成并上传, 给基准测试用
+    void finish();
+
+    GLuint textureId(int handle) const { return m_entries[handle].texture; }
+    bool isResident(int handle) const { return m_entries[handle].resident; }
+    int pendingCount() const;
+    Stats stats() const;
+
+signals:
+    //在解码线程里发出, 连接到GUI线程的对象时是排队调用
+    void textureDecoded();
+
+private:
+    struct Entry
+    {
+        GLuint texture = 0;
+        bool resident = false;
+        TextureArray *array = nullptr;
+        int region = -1;
+    };
+
+    struct Decoded
+    {
+        int handle;
+        QImage image;
+        GLenum format;
+        std::shared_ptr<CompressedTexture> compressed;
+        bool cacheHit;
+    };
+
+    class DecodeTask;
+
+    void start(int handle, const QString &fileName, bool flipY, bool allowCompressed);
+    Decoded decode(int handle, const QString &fileName, bool flipY, bool allowCompressed);
+    Decoded decodeCompressed(int handle, const QString &fileName, bool flipY);
+    void decodeTask(int handle, const QString &fileName, bool flipY, bool allowCompressed);
+    void upload(const Decoded &decoded);
+    void uploadCompressed(const Decoded &decoded);
+
+    QString m_cacheDirectory;
+    TextureCache m_cache;
+    Stats m_stats;
+
+    std::vector<Entry> m_entries;
+    QThreadPool m_pool;
+    mutable QMutex m_mutex;
+    std::vector<Decoded> m_ready;
+    int m_inFlight;
+    GLuint m_placeholder;
+    QOpenGLBuffer m_pbo;
+    int m_pboSize;
+};
+
+#endif // TEXTURELOADER_H
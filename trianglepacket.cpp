@@ -0,0 +1,132 @@
+#include "trianglepacket.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/intersect.hpp>
+#include <glm/simd/platform.h>
+
+std::vector<TrianglePacket> TrianglePacket::build(const glm::vec3 *positions, int triangleCount)
+{
+    std::vector<TrianglePacket> packets((triangleCount + Width - 1) / Width);
+    for(size_t p=0; p < packets.size(); ++p)
+    {
+        TrianglePacket &packet = packets[p];
+        for(int lane=0; lane < Width; ++lane)
+        {
+            const int triangle = int(p) * Width + lane;
+            glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+            if(triangle < triangleCount)
+            {
+                v0 = positions[triangle * 3];
+                e1 = positions[triangle * 3 + 1] - v0;
+                e2 = positions[triangle * 3 + 2] - v0;
+            }
+            packet.v0x[lane] = v0.x; packet.v0y[lane] = v0.y; packet.v0z[lane] = v0.z;
+            packet.e1x[lane] = e1.x; packet.e1y[lane] = e1.y; packet.e1z[lane] = e1.z;
+            packet.e2x[lane] = e2.x; packet.e2y[lane] = e2.y; packet.e2z[lane] = e2.z;
+        }
+    }
+    return packets;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//最低的置位在第几位, mask不能是0; MSVC没有__builtin_ctz
+static inline int countTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return int(bit);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+#endif
+
+bool TrianglePacket::intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &distance) const
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+    const __m128 e1x_ = _mm_loadu_ps(e1x), e1y_ = _mm_loadu_ps(e1y), e1z_ = _mm_loadu_ps(e1z);
+    const __m128 e2x_ = _mm_loadu_ps(e2x), e2y_ = _mm_loadu_ps(e2y), e2z_ = _mm_loadu_ps(e2z);
+
+    //p = cross(dir, e2), det = dot(e1, p)
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z_), _mm_mul_ps(dz, e2y_));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x_), _mm_mul_ps(dx, e2z_));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y_), _mm_mul_ps(dy, e2x_));
+    const __m128 det = dot3(e1x_, e1y_, e1z_, px, py, pz);
+
+    //双面: |det|太小说明射线和三角形平行(补齐用的退化三角形det为0)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 valid = _mm_cmpgt_ps(_mm_and_ps(det, absMask), _mm_set1_ps(1e-8f));
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    //s = origin - v0, u = dot(s, p) / det
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(v0x));
+    const __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(v0y));
+    const __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(v0z));
+    const __m128 u = _mm_mul_ps(dot3(sx, sy, sz, px, py, pz), invDet);
+
+    //q = cross(s, e1), v = dot(dir, q) / det, t = dot(e2, q) / det
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z_), _mm_mul_ps(sz, e1y_));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x_), _mm_mul_ps(sx, e1z_));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y_), _mm_mul_ps(sy, e1x_));
+    const __m128 v = _mm_mul_ps(dot3(dx, dy, dz, qx, qy, qz), invDet);
+    const __m128 t = _mm_mul_ps(dot3(e2x_, e2y_, e2z_, qx, qy, qz), invDet);
+
+    const __m128 zero = _mm_setzero_ps();
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(distance)));
+
+    int mask = _mm_movemask_ps(valid);
+    if(mask == 0)
+        return false;
+
+    float ts[Width];
+    _mm_storeu_ps(ts, t);
+    while(mask)
+    {
+        const int lane = countTrailingZeros(unsigned(mask));
+        if(ts[lane] < distance)
+            distance = ts[lane];
+        mask &= mask - 1;
+    }
+    return true;
+#else
+    bool hit = false;
+    for(int lane=0; lane < Width; ++lane)
+    {
+        const glm::vec3 v0(v0x[lane], v0y[lane], v0z[lane]);
+        const glm::vec3 v1 = v0 + glm::vec3(e1x[lane], e1y[lane], e1z[lane]);
+        const glm::vec3 v2 = v0 + glm::vec3(e2x[lane], e2y[lane], e2z[lane]);
+        glm::vec2 bary;
+        float t;
+        if(glm::intersectRayTriangle(origin, dir, v0, v1, v2, bary, t) && t > 0.0f && t < distance)
+        {
+            distance = t;
+            hit = true;
+        }
+    }
+    return hit;
+#endif
+}
+
+bool intersectPackets(const std::vector<TrianglePacket> &packets, const glm::vec3 &origin,
+                      const glm::vec3 &dir, float &distance)
+{
+    bool hit = false;
+    for(const TrianglePacket &packet : packets)
+        hit |= packet.intersect(origin, dir, distance);
+    return hit;
+}
@@ -0,0 +1,29 @@
+#ifndef TRIANGLEPACKET_H
+#define TRIANGLEPACKET_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//一条射线同时测4个三角形的Möller-Trumbore(和gtx/intersect.inl里的intersectRayTriangle同一个算法, 同样双面).
+//三角形按SoA预先存好v0和两条边, GLM_ARCH带SSE2时用_mm_*一次算4个, 否则逐个调用glm::intersectRayTriangle.
+struct TrianglePacket
+{
+    enum { Width = 4 };
+
+    float v0x[Width], v0y[Width], v0z[Width];
+    float e1x[Width], e1y[Width], e1z[Width];
+    float e2x[Width], e2y[Width], e2z[Width];
+
+    //positions每3个点一个三角形, 不满4个的包用退化三角形补齐(永远不会命中)
+    static std::vector<TrianglePacket> build(const glm::vec3 *positions, int triangleCount);
+
+    //命中且比distance近时更新distance并返回true
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &dir, float &distance) const;
+};
+
+//对一组包求最近交点
+bool intersectPackets(const std::vector<TrianglePacket> &packets, const glm::vec3 &origin,
+                      const glm::vec3 &dir, float &distance);
+
+#endif // TRIANGLEPACKET_H
@@ -1,12 +1,51 @@
 #version 330 core
+//ShaderVariants在#version后面插入特性: TEXTURED, LIGHTING(0不受光, 1 Lambert), OCTAHEDRAL_NORMAL
+#ifndef LIGHTING
+#define LIGHTING 0
+#endif
 layout (location = 0) in vec3 posVertex;
 layout (location = 1) in vec2 aTexCoord;
+#if LIGHTING == 1
+#ifdef OCTAHEDRAL_NORMAL
+layout (location = 7) in vec2 aNormal;
+#else
+layout (location = 7) in vec3 aNormal;
+#endif
+out vec3 Normal;
+#endif
 out vec2 TexCoord;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+//snorm16的位置相对于网格包围盒存储, 其他格式是(1, 0)
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPos;
+};
+
+#if LIGHTING == 1
+//和VertexPacking::octahedralDecode相同
+vec3 decodeNormal()
+{
+#ifdef OCTAHEDRAL_NORMAL
+    vec3 n = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n;
+#else
+    return aNormal;
+#endif
+}
+#endif
+
 void main()
 {
-   gl_Position = projection * view * model * vec4(posVertex, 1.0f);
+   gl_Position = viewProjection * model * vec4(posVertex * positionScale + positionOffset, 1.0f);
    TexCoord = aTexCoord;
+#if LIGHTING == 1
+   Normal = mat3(model) * decodeNormal();
+#endif
 }
@@ -0,0 +1,104 @@
+#include "vertexpacking.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cstring>
+
+namespace
+{
+template<typename T>
+const T &element(const T *in, size_t stride, size_t i)
+{
+    return *reinterpret_cast<const T *>(reinterpret_cast<const unsigned char *>(in) + i * stride);
+}
+
+//0的符号当成正, 否则落在坐标轴上的法线会被压成0
+glm::vec2 signNotZero(const glm::vec2 &v)
+{
+    return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+}
+
+void VertexPacking::packFloat3(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+        memcpy(out, &element(in, inStride, i), sizeof(glm::vec3));
+}
+
+void VertexPacking::packFloat2(const glm::vec2 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+        memcpy(out, &element(in, inStride, i), sizeof(glm::vec2));
+}
+
+void VertexPacking::packHalf3(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+    {
+        const glm::uint64 packed = glm::packHalf4x16(glm::vec4(element(in, inStride, i), 1.0f));
+        memcpy(out, &packed, sizeof(packed));
+    }
+}
+
+void VertexPacking::packSnorm16x3(const glm::vec3 *in, size_t inStride, size_t count, const glm::vec3 &scale,
+                                  const glm::vec3 &offset, unsigned char *out, size_t outStride)
+{
+    const glm::vec3 inverseScale = 1.0f / scale;
+    for(size_t i=0; i < count; ++i, out += outStride)
+    {
+        const glm::vec3 v = (element(in, inStride, i) - offset) * inverseScale;
+        const glm::uint64 packed = glm::packSnorm4x16(glm::vec4(v, 1.0f));
+        memcpy(out, &packed, sizeof(packed));
+    }
+}
+
+void VertexPacking::packUnorm16x2(const glm::vec2 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+    {
+        const glm::uint32 packed = glm::packUnorm2x16(element(in, inStride, i));
+        memcpy(out, &packed, sizeof(packed));
+    }
+}
+
+void VertexPacking::packOctahedral(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+    {
+        const glm::uint32 packed = glm::packSnorm2x16(octahedralEncode(element(in, inStride, i)));
+        memcpy(out, &packed, sizeof(packed));
+    }
+}
+
+void VertexPacking::packSnorm3x10(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride)
+{
+    for(size_t i=0; i < count; ++i, out += outStride)
+    {
+        const glm::uint32 packed = glm::packSnorm3x10_1x2(glm::vec4(element(in, inStride, i), 0.0f));
+        memcpy(out, &packed, sizeof(packed));
+    }
+}
+
+//投影到|x|+|y|+|z|=1的八面体上, 下半球沿对角线折到外面的四个角
+glm::vec2 VertexPacking::octahedralEncode(const glm::vec3 &n)
+{
+    const float l1 = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    if(l1 == 0.0f)
+        return glm::vec2(0.0f);
+    const glm::vec3 p = n / l1;
+    if(p.z >= 0.0f)
+        return glm::vec2(p.x, p.y);
+    return (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(glm::vec2(p.x, p.y));
+}
+
+glm::vec3 VertexPacking::octahedralDecode(const glm::vec2 &e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+    if(n.z < 0.0f)
+    {
+        const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(glm::vec2(n.x, n.y));
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return glm::normalize(n);
+}
@@ -0,0 +1,34 @@
+#ifndef VERTEXPACKING_H
+#define VERTEXPACKING_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+//把一批顶点属性编码进交错的顶点缓冲, 建立在glm/gtc/packing上.
+//输入和输出都带步长(字节): 输入可以直接指向MeshVertex数组里的某个成员, 输出指向顶点缓冲里这个属性的位置.
+//对应的glVertexAttribPointer参数见MeshFile::serialize.
+class VertexPacking
+{
+public:
+    //原样拷贝, 12/8字节
+    static void packFloat3(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+    static void packFloat2(const glm::vec2 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+
+    //4个half, w=1: GL_HALF_FLOAT x3, 8字节(第4个分量只为了对齐)
+    static void packHalf3(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+    //(v - offset) / scale 落在[-1, 1]里, 再按snorm16存: GL_SHORT x3 归一化, 8字节
+    static void packSnorm16x3(const glm::vec3 *in, size_t inStride, size_t count, const glm::vec3 &scale,
+                              const glm::vec3 &offset, unsigned char *out, size_t outStride);
+    //[0, 1]的纹理坐标: GL_UNSIGNED_SHORT x2 归一化, 4字节
+    static void packUnorm16x2(const glm::vec2 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+    //单位向量的八面体映射: GL_SHORT x2 归一化, 4字节, 用octahedralDecode还原
+    static void packOctahedral(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+    //GL_INT_2_10_10_10_REV x4 归一化, w=0, 4字节
+    static void packSnorm3x10(const glm::vec3 *in, size_t inStride, size_t count, unsigned char *out, size_t outStride);
+
+    static glm::vec2 octahedralEncode(const glm::vec3 &n);
+    static glm::vec3 octahedralDecode(const glm::vec2 &e);
+};
+
+#endif // VERTEXPACKING_H